@@ -3,3 +3,24 @@ CONFIG += ordered
 SUBDIRS = Cardirector QSanguosha
 
 QSanguosha.file = app.pro
+
+# Micro-benchmarks of the rules engine, built with "qmake CONFIG+=bench"
+bench {
+    SUBDIRS += QSanguoshaBench
+    QSanguoshaBench.file = bench/bench.pro
+    QSanguoshaBench.depends = Cardirector
+}
+
+# Dedicated server without Qt Quick, built with "qmake CONFIG+=dedicated"
+dedicated {
+    SUBDIRS += QSanguoshaServer
+    QSanguoshaServer.file = dedicated/dedicated.pro
+    QSanguoshaServer.depends = Cardirector
+}
+
+# Headless bot clients to load a server, built with "qmake CONFIG+=loadgen"
+loadgen {
+    SUBDIRS += QSanguoshaLoad
+    QSanguoshaLoad.file = loadgen/loadgen.pro
+    QSanguoshaLoad.depends = Cardirector
+}
@@ -1,102 +1,32 @@
 TEMPLATE = app
 TARGET = QSanguosha
-QT += qml quick multimedia
+QT += qml quick multimedia network
 CONFIG += c++11
 
+QSAN_MODULES = client server
+include(src/src.pri)
+
 SOURCES += src/main.cpp \
-    src/client/client.cpp \
-    src/client/clientplayer.cpp \
-    src/client/clientskill.cpp \
-    src/core/card.cpp \
-    src/core/cardarea.cpp \
-    src/core/cardpattern.cpp \
-    src/core/engine.cpp \
-    src/core/gamemode.cpp \
-    src/core/general.cpp \
-    src/core/package.cpp \
-    src/core/player.cpp \
-    src/core/protocol.cpp \
-    src/core/skill.cpp \
-    src/core/structs.cpp \
-    src/core/util.cpp \
-    src/gamelogic/event.cpp \
-    src/gamelogic/eventhandler.cpp \
-    src/gamelogic/gamelogic.cpp \
-    src/gamelogic/gamerule.cpp \
-    src/gamelogic/serverplayer.cpp \
+    src/client/replayer.cpp \
+    src/client/spectator.cpp \
     src/gui/dialog/pcconsolestartdialog.cpp \
     src/gui/dialog/startserverdialog.cpp \
     src/gui/dialog/startgamedialog.cpp \
     src/gui/gamelogger.cpp \
     src/gui/lobby.cpp \
-    src/gui/roomscene.cpp \
-    src/mode/hegemonymode.cpp \
-    src/mode/standardmode.cpp \
-    src/package/hegstandardpackage.cpp \
-    src/package/hegstandard-qun.cpp \
-    src/package/hegstandard-shu.cpp \
-    src/package/hegstandard-wei.cpp \
-    src/package/hegstandard-wu.cpp \
-    src/package/standardpackage.cpp \
-    src/package/standard-basiccard.cpp \
-    src/package/standard-equipcard.cpp \
-    src/package/standard-qun.cpp \
-    src/package/standard-shu.cpp \
-    src/package/standard-trickcard.cpp \
-    src/package/standard-wei.cpp \
-    src/package/standard-wu.cpp \
-    src/package/systempackage.cpp \
-    src/package/maneuveringpackage.cpp \
-    src/server/roomsettings.cpp \
-    src/server/server.cpp
+    src/gui/roomscene.cpp
 
 HEADERS += \
-    src/client/client.h \
-    src/client/clientplayer.h \
-    src/client/clientskill.h \
-    src/core/card.h \
-    src/core/cardarea.h \
-    src/core/cardpattern.h \
-    src/core/engine.h \
-    src/core/gamemode.h \
-    src/core/general.h \
-    src/core/package.h \
-    src/core/player.h \
-    src/core/protocol.h \
-    src/core/skill.h \
-    src/core/structs.h \
-    src/core/util.h \
-    src/mode/hegemonymode.h \
-    src/mode/standardmode.h \
-    src/gamelogic/event.h \
-    src/gamelogic/eventhandler.h \
-    src/gamelogic/eventtype.h \
-    src/gamelogic/gamelogic.h \
-    src/gamelogic/gamerule.h \
-    src/gamelogic/serverplayer.h \
+    src/client/replayer.h \
+    src/client/spectator.h \
     src/gui/dialog/pcconsolestartdialog.h \
     src/gui/dialog/startserverdialog.h \
     src/gui/dialog/startgamedialog.h \
     src/gui/gamelogger.h \
     src/gui/lobby.h \
-    src/gui/roomscene.h \
-    src/package/hegstandardpackage.h \
-    src/package/standardpackage.h \
-    src/package/standard-basiccard.h \
-    src/package/standard-equipcard.h \
-    src/package/standard-trickcard.h \
-    src/package/systempackage.h \
-    src/package/maneuveringpackage.h \
-    src/server/roomsettings.h \
-    src/server/server.h
-
-INCLUDEPATH += src \
-    src/client \
-    src/core \
-    src/gamelogic \
-    src/gui \
-    src/package \
-    src/server
+    src/gui/roomscene.h
+
+INCLUDEPATH += src/gui
 
 defineTest(copy) {
     file = $$1
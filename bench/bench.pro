@@ -0,0 +1,16 @@
+TEMPLATE = app
+TARGET = QSanguoshaBench
+QT += qml network testlib
+QT -= gui
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+QSAN_MODULES = client
+include(../src/src.pri)
+
+SOURCES += benchmark.cpp
+
+# Cardirector
+DEFINES += MCD_STATIC
+INCLUDEPATH += ../Cardirector/include
+LIBS += -L$$PWD/../Cardirector/lib -lCardirector -loggvorbis
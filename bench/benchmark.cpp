@@ -0,0 +1,619 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+
+#include "ai.h"
+#include "belieftracker.h"
+#include "card.h"
+#include "cardarea.h"
+#include "cardpattern.h"
+#include "client.h"
+#include "engine.h"
+#include "eventhandler.h"
+#include "gamelogic.h"
+#include "heapaccount.h"
+#include "payloadcompressor.h"
+#include "player.h"
+#include "protocol.h"
+#include "serverplayer.h"
+#include "structs.h"
+#include "timerwheel.h"
+
+#include <QtTest>
+
+#include <cstdlib>
+
+namespace {
+
+class BenchmarkHandler : public EventHandler
+{
+public:
+    BenchmarkHandler(int index)
+    {
+        m_name = QString("benchmark_%1").arg(index);
+        m_events << PhaseStart << CardsMove << DamageStart;
+        m_defaultPriority = index % 3;
+    }
+
+    //Most skills look for themselves on the owner and give up
+    bool triggerable(ServerPlayer *owner) const override
+    {
+        return owner && owner->isAlive() && owner->tag.contains(m_name);
+    }
+};
+
+QList<Card *> CloneAllCards()
+{
+    QList<Card *> cards;
+    QList<const Card *> prototypes = Engine::instance()->getCards();
+    foreach (const Card *card, prototypes)
+        cards << card->clone();
+    return cards;
+}
+
+QList<CardsMoveStruct> CreateMoves(const QList<Card *> &cards, int cardNum)
+{
+    QList<CardsMoveStruct> moves;
+    CardsMoveStruct move;
+    move.from.type = CardArea::DrawPile;
+    move.from.direction = CardArea::Top;
+    move.to.type = CardArea::DiscardPile;
+    move.isOpen = true;
+    move.cards = cards.mid(0, cardNum);
+    moves << move;
+    return moves;
+}
+
+//A late-game table of 8 players, each with 6 handcards, 3 equips and a delayed trick
+QList<ServerPlayer *> CreateLateGame(GameLogic *logic, const QList<Card *> &cards)
+{
+    QList<ServerPlayer *> players;
+    int cardIndex = 0;
+    for (int i = 0; i < 8; i++) {
+        ServerPlayer *player = new ServerPlayer(logic, nullptr);
+        player->setSeat(i + 1);
+        player->setScreenName(QString("player%1").arg(i + 1));
+        player->setMaxHp(4);
+        player->setHp(2);
+        player->setRole("rebel");
+        player->handcardArea()->add(cards.mid(cardIndex, 6));
+        cardIndex += 6;
+        player->equipArea()->add(cards.mid(cardIndex, 3));
+        cardIndex += 3;
+        player->delayedTrickArea()->add(cards.mid(cardIndex, 1));
+        cardIndex += 1;
+        player->addCardHistory("Slash");
+        player->tag["benchmark"] = i;
+        players << player;
+    }
+    for (int i = 0; i < players.length(); i++)
+        players.at(i)->setNext(players.at((i + 1) % players.length()));
+    return players;
+}
+
+QVariant CreateResyncState(const QList<Card *> &cards, const QList<ServerPlayer *> &players, const ServerPlayer *viewer)
+{
+    QVariantMap state;
+    QVariantList cardIds;
+    foreach (const Card *card, cards)
+        cardIds << card->id();
+    state["cards"] = cardIds;
+    state["selfId"] = viewer->id();
+
+    QVariantList playerList;
+    foreach (const ServerPlayer *player, players)
+        playerList << player->resyncState(viewer);
+    state["players"] = playerList;
+    return state;
+}
+
+}
+
+/* Micro-benchmarks of the hot paths in the rules engine.
+ * Run with "-csv" or "-o result.xml,xml" to get machine-readable results.
+ */
+class Benchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void trigger_data();
+    void trigger();
+
+    void moveCards_data();
+    void moveCards();
+
+    void matchPattern_data();
+    void matchPattern();
+
+    void distanceTo_data();
+    void distanceTo();
+
+    void reshuffleDrawPile();
+
+    void moveToVariant_data();
+    void moveToVariant();
+
+    void parseMoveCardsCommand_data();
+    void parseMoveCardsCommand();
+
+    void resyncState();
+    void restoreResyncState();
+    void snapshotPlayers();
+
+    void aiReply_data();
+    void aiReply();
+
+    void updateBelief();
+
+    void scheduleTimer();
+
+    void compressPayload();
+
+    void heapAccount_data();
+    void heapAccount();
+
+private:
+    QList<Card *> m_cards;
+};
+
+void Benchmark::initTestCase()
+{
+    m_cards = CloneAllCards();
+    QVERIFY(m_cards.length() > 10);
+}
+
+void Benchmark::cleanupTestCase()
+{
+    foreach (Card *card, m_cards)
+        delete card;
+    m_cards.clear();
+}
+
+void Benchmark::trigger_data()
+{
+    QTest::addColumn<int>("handlerNum");
+    QTest::newRow("1") << 1;
+    QTest::newRow("8") << 8;
+    QTest::newRow("32") << 32;
+    QTest::newRow("64") << 64;
+}
+
+void Benchmark::trigger()
+{
+    QFETCH(int, handlerNum);
+
+    GameLogic logic;
+    QList<BenchmarkHandler *> handlers;
+    for (int i = 0; i < handlerNum; i++) {
+        BenchmarkHandler *handler = new BenchmarkHandler(i);
+        logic.addEventHandler(handler);
+        handlers << handler;
+    }
+
+    ServerPlayer target(&logic, nullptr);
+    QVariant data;
+    QBENCHMARK {
+        logic.trigger(PhaseStart, &target, data);
+    }
+
+    qDeleteAll(handlers);
+}
+
+void Benchmark::moveCards_data()
+{
+    QTest::addColumn<int>("cardNum");
+    QTest::newRow("1") << 1;
+    QTest::newRow("2") << 2;
+    QTest::newRow("5") << 5;
+    QTest::newRow("10") << 10;
+}
+
+void Benchmark::moveCards()
+{
+    QFETCH(int, cardNum);
+
+    QList<Card *> cards = CloneAllCards();
+    GameLogic logic;
+    logic.discardPile()->add(cards);
+    logic.reshuffleDrawPile();
+
+    QBENCHMARK {
+        CardsMoveStruct move;
+        move.from.type = CardArea::DrawPile;
+        move.from.direction = CardArea::Top;
+        move.to.type = CardArea::DiscardPile;
+        move.isOpen = true;
+        move.cards = logic.getDrawPileCards(cardNum);
+        logic.moveCards(move);
+    }
+
+    qDeleteAll(cards);
+}
+
+void Benchmark::matchPattern_data()
+{
+    QTest::addColumn<QString>("pattern");
+    QTest::newRow("name") << "Jink";
+    QTest::newRow("names") << "Peach,Analeptic";
+    QTest::newRow("suit") << ".|heart";
+    QTest::newRow("number") << ".|.|2~9";
+    QTest::newRow("place") << ".|.|.|hand";
+    QTest::newRow("or") << "Slash#Duel|spade";
+}
+
+void Benchmark::matchPattern()
+{
+    QFETCH(QString, pattern);
+
+    Player player;
+    player.handcardArea()->add(m_cards.mid(0, 5));
+
+    CardPattern p(pattern);
+    QBENCHMARK {
+        foreach (const Card *card, m_cards)
+            p.match(&player, card);
+    }
+
+    player.handcardArea()->clear();
+}
+
+void Benchmark::distanceTo_data()
+{
+    QTest::addColumn<int>("playerNum");
+    for (int i = 2; i <= 10; i++)
+        QTest::newRow(QByteArray::number(i).constData()) << i;
+}
+
+void Benchmark::distanceTo()
+{
+    QFETCH(int, playerNum);
+
+    QList<Player *> players;
+    for (int i = 0; i < playerNum; i++) {
+        Player *player = new Player;
+        player->setSeat(i + 1);
+        players << player;
+    }
+    for (int i = 0; i < playerNum; i++)
+        players.at(i)->setNext(players.at((i + 1) % playerNum));
+
+    QBENCHMARK {
+        foreach (const Player *from, players) {
+            foreach (const Player *to, players)
+                from->distanceTo(to);
+        }
+    }
+
+    qDeleteAll(players);
+}
+
+void Benchmark::reshuffleDrawPile()
+{
+    QList<Card *> cards = CloneAllCards();
+    GameLogic logic;
+    logic.discardPile()->add(cards);
+
+    QBENCHMARK {
+        CardArea *drawPile = logic.drawPile();
+        logic.discardPile()->add(drawPile->cards());
+        drawPile->clear();
+        logic.reshuffleDrawPile();
+    }
+
+    qDeleteAll(cards);
+}
+
+void Benchmark::moveToVariant_data()
+{
+    QTest::addColumn<int>("cardNum");
+    QTest::addColumn<bool>("open");
+    for (int i = 1; i <= 10; i++) {
+        QTest::newRow(qPrintable(QString("%1 open").arg(i))) << i << true;
+        QTest::newRow(qPrintable(QString("%1 hidden").arg(i))) << i << false;
+    }
+}
+
+void Benchmark::moveToVariant()
+{
+    QFETCH(int, cardNum);
+    QFETCH(bool, open);
+
+    QList<CardsMoveStruct> moves = CreateMoves(m_cards, cardNum);
+    const CardsMoveStruct &move = moves.first();
+    QBENCHMARK {
+        move.toVariant(open);
+    }
+}
+
+void Benchmark::parseMoveCardsCommand_data()
+{
+    moveCards_data();
+}
+
+void Benchmark::parseMoveCardsCommand()
+{
+    QFETCH(int, cardNum);
+
+    Client *client = Client::instance();
+    QVariantList cardIds;
+    foreach (const Card *card, m_cards)
+        cardIds << card->id();
+    Client::PrepareCardsCommand(client, cardIds);
+
+    QVariantList data;
+    QList<CardsMoveStruct> moves = CreateMoves(m_cards, cardNum);
+    foreach (const CardsMoveStruct &move, moves)
+        data << move.toVariant(true);
+
+    QBENCHMARK {
+        Client::MoveCardsCommand(client, data);
+    }
+}
+
+void Benchmark::resyncState()
+{
+    GameLogic logic;
+    QList<ServerPlayer *> players = CreateLateGame(&logic, m_cards);
+    ServerPlayer *viewer = players.first();
+
+    QVariant state;
+    QBENCHMARK {
+        state = CreateResyncState(m_cards, players, viewer);
+    }
+
+    QVERIFY(state.isValid());
+
+    foreach (ServerPlayer *player, players) {
+        player->handcardArea()->clear();
+        player->equipArea()->clear();
+        player->delayedTrickArea()->clear();
+    }
+    qDeleteAll(players);
+}
+
+void Benchmark::restoreResyncState()
+{
+    GameLogic logic;
+    QList<ServerPlayer *> players = CreateLateGame(&logic, m_cards);
+    QVariant state = CreateResyncState(m_cards, players, players.first());
+
+    Client *client = Client::instance();
+    QBENCHMARK {
+        client->restoreState(state);
+    }
+
+    foreach (ServerPlayer *player, players) {
+        player->handcardArea()->clear();
+        player->equipArea()->clear();
+        player->delayedTrickArea()->clear();
+    }
+    qDeleteAll(players);
+}
+
+void Benchmark::snapshotPlayers()
+{
+    GameLogic logic;
+    QList<ServerPlayer *> players = CreateLateGame(&logic, m_cards);
+    ServerPlayer *viewer = players.first();
+
+    //The logic has neither a room nor players of its own, so broadcasts are held for nobody
+    int batchWindow = GameLogic::BatchWindow();
+    GameLogic::SetBatchWindow(1);
+    foreach (ServerPlayer *player, players) {
+        if (player != viewer)
+            player->broadcastProperty("role", "unknown");
+        player->broadcastTag("benchmark");
+    }
+    GameLogic::SetBatchWindow(batchWindow);
+    QVariant state = CreateResyncState(m_cards, players, viewer);
+
+    QVariantList snapshots;
+    QBENCHMARK {
+        snapshots.clear();
+        foreach (ServerPlayer *player, players)
+            snapshots << player->snapshot();
+    }
+
+    //Cards are restored by the logic, so the restored players share them with the originals
+    QList<ServerPlayer *> restoredPlayers;
+    for (int i = 0; i < players.length(); i++) {
+        ServerPlayer *player = players.at(i);
+        ServerPlayer *restored = new ServerPlayer(&logic, nullptr);
+        restored->restore(snapshots.at(i));
+        restored->handcardArea()->add(player->handcardArea()->cards());
+        restored->equipArea()->add(player->equipArea()->cards());
+        restored->delayedTrickArea()->add(player->delayedTrickArea()->cards());
+        restoredPlayers << restored;
+    }
+    for (int i = 0; i < restoredPlayers.length(); i++)
+        restoredPlayers.at(i)->setNext(restoredPlayers.at((i + 1) % restoredPlayers.length()));
+
+    QCOMPARE(CreateResyncState(m_cards, restoredPlayers, restoredPlayers.first()), state);
+
+    QList<ServerPlayer *> allPlayers = players + restoredPlayers;
+    foreach (ServerPlayer *player, allPlayers) {
+        player->handcardArea()->clear();
+        player->equipArea()->clear();
+        player->delayedTrickArea()->clear();
+    }
+    qDeleteAll(allPlayers);
+}
+
+void Benchmark::aiReply_data()
+{
+    QTest::addColumn<int>("command");
+    QTest::addColumn<QVariant>("data");
+
+    QVariantMap jink;
+    jink["pattern"] = "jink";
+    jink["optional"] = true;
+
+    QVariantMap discard;
+    discard["pattern"] = ".|.|.|hand";
+    discard["minNum"] = 2;
+    discard["maxNum"] = 2;
+    discard["optional"] = false;
+
+    QTest::newRow("act") << int(S_COMMAND_ACT) << QVariant();
+    QTest::newRow("jink") << int(S_COMMAND_ASK_FOR_CARD) << QVariant(jink);
+    QTest::newRow("discard") << int(S_COMMAND_ASK_FOR_CARD) << QVariant(discard);
+}
+
+void Benchmark::aiReply()
+{
+    QFETCH(int, command);
+    QFETCH(QVariant, data);
+
+    GameLogic logic;
+    QList<ServerPlayer *> players = CreateLateGame(&logic, m_cards);
+
+    Ai ai(players.first());
+    QBENCHMARK {
+        ai.reply(command, data);
+    }
+
+    foreach (ServerPlayer *player, players) {
+        player->handcardArea()->clear();
+        player->equipArea()->clear();
+        player->delayedTrickArea()->clear();
+    }
+    qDeleteAll(players);
+}
+
+void Benchmark::updateBelief()
+{
+    GameLogic logic;
+    QList<ServerPlayer *> players = CreateLateGame(&logic, m_cards);
+    logic.drawPile()->add(m_cards.mid(80));
+
+    //Another player draws two cards and then plays one of them
+    CardsMoveStruct draw;
+    draw.from.type = CardArea::DrawPile;
+    draw.to.type = CardArea::Hand;
+    draw.to.owner = players.at(1);
+    draw.cards = logic.drawPile()->first(2);
+
+    CardsMoveStruct use;
+    use.from.type = CardArea::Hand;
+    use.from.owner = players.at(1);
+    use.to.type = CardArea::DiscardPile;
+    use.isOpen = true;
+    use.cards << draw.cards.first();
+
+    BeliefTracker belief(players.first());
+    double probability = 0.0;
+    QBENCHMARK {
+        belief.update(draw);
+        belief.update(use);
+        probability = belief.probability(players.at(1), "jink");
+    }
+    QVERIFY(probability >= 0.0 && probability <= 1.0);
+
+    logic.drawPile()->clear();
+    foreach (ServerPlayer *player, players) {
+        player->handcardArea()->clear();
+        player->equipArea()->clear();
+        player->delayedTrickArea()->clear();
+    }
+    qDeleteAll(players);
+}
+
+void Benchmark::scheduleTimer()
+{
+    //Thousands of rooms waiting on requests, each cancelled by a reply
+    TimerWheel wheel;
+    QList<TimerWheel::Handle> pending;
+    for (int i = 0; i < 5000; i++)
+        pending << wheel.schedule(15000 + i, [](){});
+
+    int i = 0;
+    QBENCHMARK {
+        TimerWheel::Handle handle = wheel.schedule(15000, [](){});
+        wheel.cancel(pending.at(i));
+        pending[i] = handle;
+        i = (i + 1) % pending.length();
+    }
+    QCOMPARE(wheel.pendingNum(), pending.length());
+}
+
+void Benchmark::compressPayload()
+{
+    //S_COMMAND_PREPARE_CARDS
+    QVariantList cardData;
+    foreach (const Card *card, m_cards)
+        cardData << card->id();
+
+    PayloadCompressor::SetLevel(6);
+    PayloadCompressor::SetThreshold(0);
+    QVariant packed;
+    QBENCHMARK {
+        packed = PayloadCompressor::Compress(S_COMMAND_PREPARE_CARDS, cardData);
+    }
+    PayloadCompressor::SetLevel(0);
+
+    int command;
+    QVariant data;
+    QVERIFY(PayloadCompressor::Decompress(packed, &command, &data));
+    QCOMPARE(command, int(S_COMMAND_PREPARE_CARDS));
+    QCOMPARE(data.toList().length(), cardData.length());
+}
+
+void Benchmark::heapAccount_data()
+{
+    QTest::addColumn<bool>("accounting");
+    QTest::newRow("malloc") << false;
+    QTest::newRow("account") << true;
+}
+
+void Benchmark::heapAccount()
+{
+    QFETCH(bool, accounting);
+
+    //A burst of small blocks like the structs and events of a card use
+    const int blockNum = 64;
+    const std::size_t blockSize = 48;
+    void *blocks[blockNum];
+
+    HeapAccount *account = HeapAccount::Acquire();
+    HeapAccount::SetCurrent(account);
+    QBENCHMARK {
+        if (accounting) {
+            for (int i = 0; i < blockNum; i++)
+                blocks[i] = HeapAccount::Allocate(blockSize);
+            for (int i = 0; i < blockNum; i++)
+                HeapAccount::Deallocate(blocks[i]);
+        } else {
+            for (int i = 0; i < blockNum; i++)
+                blocks[i] = std::malloc(blockSize);
+            for (int i = 0; i < blockNum; i++)
+                std::free(blocks[i]);
+        }
+    }
+    HeapAccount::SetCurrent(nullptr);
+    QCOMPARE(account->bytes(), qint64(0));
+    HeapAccount::Release(account);
+}
+
+QTEST_GUILESS_MAIN(Benchmark)
+
+#include "benchmark.moc"
@@ -0,0 +1,20 @@
+TEMPLATE = app
+TARGET = QSanguoshaServer
+QT += qml network
+QT -= gui
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+QSAN_MODULES = server
+include(../src/src.pri)
+
+SOURCES += main.cpp
+
+# Cardirector
+DEFINES += MCD_STATIC
+INCLUDEPATH += ../Cardirector/include
+LIBS += -L$$PWD/../Cardirector/lib -lCardirector -loggvorbis
+CONFIG(release, debug|release): LIBS += -lbreakpad
+
+# Counts the heap bytes of each room by replacing the global operator new and delete
+heap_accounting: DEFINES += QSAN_HEAP_ACCOUNTING
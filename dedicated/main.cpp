@@ -0,0 +1,305 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+#include "ai.h"
+#include "gamelogic.h"
+#include "gametracer.h"
+#include "mctsai.h"
+#include "payloadcompressor.h"
+#include "replayrecorder.h"
+#include "replystatistics.h"
+#include "roommigration.h"
+#include "server.h"
+#include "triggerprofiler.h"
+#include "util.h"
+
+#include <CExceptionHandler>
+#include <CRoom>
+#include <CServerRobot>
+#include <CServerUser>
+#include <CTranslator>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocale>
+#include <QSettings>
+#include <QTextStream>
+#include <QTranslator>
+
+namespace {
+
+//Options given on the command line override those in the configuration file
+class Configuration
+{
+public:
+    Configuration(const QCommandLineParser &parser, const QString &fileName)
+        : m_parser(parser)
+        , m_settings(fileName.isEmpty() ? nullptr : new QSettings(fileName, QSettings::IniFormat))
+    {
+    }
+
+    ~Configuration()
+    {
+        delete m_settings;
+    }
+
+    QString value(const QCommandLineOption &option, const QString &defaultValue = QString()) const
+    {
+        if (m_parser.isSet(option))
+            return m_parser.value(option);
+        if (m_settings)
+            return m_settings->value(option.names().first(), defaultValue).toString();
+        return defaultValue;
+    }
+
+    bool isSet(const QCommandLineOption &option, bool defaultValue = false) const
+    {
+        if (m_parser.isSet(option))
+            return true;
+        if (m_settings)
+            return m_settings->value(option.names().first(), defaultValue).toBool();
+        return defaultValue;
+    }
+
+private:
+    const QCommandLineParser &m_parser;
+    QSettings *m_settings;
+};
+
+void WriteFile(const QString &fileName, const QByteArray &data)
+{
+    QFile file(fileName);
+    if (file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        file.write(data);
+    else
+        qWarning("Failed to write %s", qPrintable(fileName));
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QElapsedTimer startTimer;
+    startTimer.start();
+
+    CExceptionHandler eh("./dmp");
+
+    QCoreApplication app(argc, argv);
+
+    app.setOrganizationName("Mogara");
+    app.setOrganizationDomain("mogara.org");
+    app.setApplicationName("QSanguoshaServer");
+
+    QString localeName = QLocale::system().name();
+    QTranslator translator;
+    if (!translator.load(localeName, QStringLiteral("translations"))) {
+        localeName = "zh_CN";
+        translator.load(localeName, QStringLiteral("translations"));
+    }
+    CTranslator ctranslator;
+    if (ctranslator.load(localeName, QStringLiteral("translations")))
+        app.installTranslator(&ctranslator);
+    app.installTranslator(&translator);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Dedicated QSanguosha server without a graphical interface");
+    parser.addHelpOption();
+
+    QCommandLineOption configOption("config", "Read options from an INI file, with the same names as below.", "file");
+    QCommandLineOption addressOption("address", "Listen on the address. The default is any address.", "address");
+    QCommandLineOption portOption("port", "Listen on the port. The default is 5927.", "port");
+    QCommandLineOption noNativeAiOption("no-native-ai", "Leave robots to the AI script instead of the native AI.");
+    QCommandLineOption robotScriptOption("robot-script", "Load the AI script into every robot, with --no-native-ai.", "file");
+    QCommandLineOption mctsBudgetOption("mcts-budget", "Search the play phase of robots for the milliseconds.", "msecs");
+    QCommandLineOption mctsHalfSeatsOption("mcts-half-seats", "Only search for robots in every other seat, to compare win rates with the heuristics.");
+    QCommandLineOption batchWindowOption("batch-window", "Hold notifications to each player for up to the milliseconds. The default 0 sends them at once.", "msecs");
+    QCommandLineOption compressionLevelOption("compression-level", "Compress large notifications at the zlib level from 1 to 9. The default 0 disables it.", "level");
+    QCommandLineOption compressionThresholdOption("compression-threshold", "Only compress notifications of at least the bytes. The default is 1024.", "bytes");
+    QCommandLineOption hibernateAfterOption("hibernate-after", "Hibernate games whose users have all been disconnected for the milliseconds. The default 0 never does.", "msecs");
+    QCommandLineOption migrationSocketOption("migration-socket", "Take games handed over by other processes, drain and admin commands on the local socket.", "name");
+    QCommandLineOption adminOption("admin", "Send an admin command to the process on the local socket, print the reply and exit. "
+                                            "The command is \"usage\", \"kill ROOM\" or \"throttle ROOM USECS\".", "name");
+    QCommandLineOption drainOption("drain", "Ask the process on the local socket to hand its games over, and exit.", "name");
+    QCommandLineOption drainToOption("drain-to", "The local socket of the process taking the games, with --drain.", "name");
+    QCommandLineOption redirectOption("redirect", "The address users connect to after a drain, with --drain.", "host:port");
+    QCommandLineOption metricsPortOption("metrics-port", "Serve metrics for Prometheus at /metrics on the port.", "port");
+    QCommandLineOption metricsAddressOption("metrics-address", "Serve metrics on the address. The default is 127.0.0.1.", "address");
+    QCommandLineOption spectatorPortOption("spectator-port", "Let spectators watch rooms on the port, on the same address as the server.", "port");
+    QCommandLineOption traceDirOption("trace-dir", "Write a trace of every game into the directory.", "directory");
+    QCommandLineOption replayDirOption("replay-dir", "Write a replay of every game into the directory.", "directory");
+    QCommandLineOption profileOption("profile", "Profile triggers of every room.");
+    QCommandLineOption statsDirOption("stats-dir", "Write process-wide statistics into the directory whenever a room closes.", "directory");
+    parser.addOptions({configOption, addressOption, portOption, noNativeAiOption, robotScriptOption,
+                       mctsBudgetOption, mctsHalfSeatsOption, batchWindowOption, compressionLevelOption, compressionThresholdOption,
+                       hibernateAfterOption, migrationSocketOption, adminOption, drainOption, drainToOption, redirectOption,
+                       metricsPortOption, metricsAddressOption, spectatorPortOption, traceDirOption, replayDirOption, profileOption, statsDirOption});
+    parser.addPositionalArgument("command", "The admin command, with --admin.", "[command [room [usecs]]]");
+    parser.process(app);
+
+    Configuration config(parser, parser.value(configOption));
+
+    QString adminSocket = config.value(adminOption);
+    if (!adminSocket.isEmpty()) {
+        QStringList arguments = parser.positionalArguments();
+        QVariantMap frame;
+        frame["command"] = arguments.value(0, "usage");
+        frame["roomId"] = arguments.value(1).toUInt();
+        frame["usecs"] = arguments.value(2).toInt();
+        QVariantMap reply = RoomMigration::Query(adminSocket, frame, 5000);
+        if (reply.isEmpty()) {
+            qCritical("No server replied on %s.", qPrintable(adminSocket));
+            return 1;
+        }
+        QTextStream(stdout) << QJsonDocument(QJsonObject::fromVariantMap(reply)).toJson();
+        return 0;
+    }
+
+    QString drainSocket = config.value(drainOption);
+    if (!drainSocket.isEmpty()) {
+        QString target = config.value(drainToOption);
+        QString redirect = config.value(redirectOption);
+        int colon = redirect.lastIndexOf(':');
+        ushort redirectPort = colon > 0 ? redirect.mid(colon + 1).toUShort() : 0;
+        if (target.isEmpty() || redirectPort == 0) {
+            qCritical("--drain needs --drain-to and --redirect in the form of host:port.");
+            return 1;
+        }
+        if (!RoomMigration::SendDrain(drainSocket, target, redirect.left(colon), redirectPort, 5000)) {
+            qCritical("No server accepted the drain command on %s.", qPrintable(drainSocket));
+            return 1;
+        }
+        qInfo("The server on %s is handing its games over to %s.", qPrintable(drainSocket), qPrintable(target));
+        return 0;
+    }
+
+    Ai::SetEnabled(!config.isSet(noNativeAiOption));
+    MctsAi::SetTimeBudget(config.value(mctsBudgetOption, "0").toInt());
+    MctsAi::SetHalfSeatsOnly(config.isSet(mctsHalfSeatsOption));
+    GameLogic::SetBatchWindow(config.value(batchWindowOption, QString::number(GameLogic::BatchWindow())).toInt());
+    GameLogic::SetHibernationThreshold(config.value(hibernateAfterOption, "0").toInt());
+    PayloadCompressor::SetLevel(config.value(compressionLevelOption, "0").toInt());
+    PayloadCompressor::SetThreshold(config.value(compressionThresholdOption, "1024").toInt());
+    TriggerProfiler::SetEnabled(config.isSet(profileOption));
+    GameTracer::SetOutputDirectory(config.value(traceDirOption));
+    ReplayRecorder::SetOutputDirectory(config.value(replayDirOption));
+
+    QHostAddress address(QHostAddress::Any);
+    QString addressName = config.value(addressOption);
+    if (!addressName.isEmpty() && !address.setAddress(addressName)) {
+        qCritical("Invalid address: %s", qPrintable(addressName));
+        return 1;
+    }
+
+    ushort port = config.value(portOption, "5927").toUShort();
+    Server server;
+    if (!server.listen(address, port)) {
+        qCritical("The server failed to start, probably due to port %u occupied by another application.", port);
+        return 1;
+    }
+
+    ushort metricsPort = config.value(metricsPortOption, "0").toUShort();
+    if (metricsPort > 0) {
+        QHostAddress metricsAddress(QHostAddress::LocalHost);
+        QString metricsAddressName = config.value(metricsAddressOption);
+        if (!metricsAddressName.isEmpty() && !metricsAddress.setAddress(metricsAddressName)) {
+            qCritical("Invalid metrics address: %s", qPrintable(metricsAddressName));
+            return 1;
+        }
+        if (!server.listenMetrics(metricsAddress, metricsPort)) {
+            qCritical("Failed to serve metrics on port %u.", metricsPort);
+            return 1;
+        }
+    }
+
+    ushort spectatorPort = config.value(spectatorPortOption, "0").toUShort();
+    if (spectatorPort > 0 && !server.listenSpectators(address, spectatorPort)) {
+        qCritical("Failed to let spectators in on port %u.", spectatorPort);
+        return 1;
+    }
+
+    RoomMigration migration;
+    QString migrationSocket = config.value(migrationSocketOption);
+    if (!migrationSocket.isEmpty()) {
+        if (!migration.listen(migrationSocket)) {
+            qCritical("Failed to listen on the local socket %s.", qPrintable(migrationSocket));
+            return 1;
+        }
+        QObject::connect(&migration, &RoomMigration::drainRequested, [&server](const QString &target, const QString &host, ushort port){
+            qInfo("Handing games over to %s, whose users connect to %s:%u.", qPrintable(target), qPrintable(host), port);
+            server.drain(target, host, port);
+        });
+        migration.setCommandHandler([&server](const QVariantMap &frame){
+            QString command = frame["command"].toString();
+            uint roomId = frame["roomId"].toUInt();
+            QVariantMap reply;
+            if (command == "usage") {
+                reply["rooms"] = server.roomUsage();
+            } else if (command == "kill") {
+                reply["accepted"] = server.killRoom(roomId);
+            } else if (command == "throttle") {
+                reply["accepted"] = server.throttleRoom(roomId, frame["usecs"].toInt());
+            } else {
+                reply["error"] = QString("Unknown command %1").arg(command);
+            }
+            return reply;
+        });
+    }
+
+    //Native robots get no notification, so a script would be idle
+    QString robotScript = config.value(robotScriptOption);
+    if (!robotScript.isEmpty() && !Ai::IsEnabled()) {
+        QObject::connect(&server, &Server::robotAdded, [robotScript](CServerRobot *robot){
+            robot->initAi(robotScript);
+        });
+    }
+
+    QObject::connect(&server, &CServer::userAdded, [](CServerUser *user){
+        qInfo("User %s(%u) logged in.", qPrintable(user->screenName()), user->id());
+        QObject::connect(user, &CServerUser::disconnected, [user](){
+            qInfo("User %s(%u) logged out.", qPrintable(user->screenName()), user->id());
+        });
+    });
+
+    QString statsDir = config.value(statsDirOption);
+    QObject::connect(&server, &CServer::roomCreated, [statsDir](CRoom *room){
+        CServerUser *owner = room->owner();
+        qInfo("%s(%u) created a new room(%u)", qPrintable(owner->screenName()), owner->id(), room->id());
+        QObject::connect(room, &CRoom::abandoned, [room, statsDir](){
+            qInfo("Room(%u) became empty and thus closed.", room->id());
+            if (statsDir.isEmpty())
+                return;
+            QDir dir(statsDir);
+            WriteFile(dir.filePath("reply-statistics.json"), ReplyStatistics::Dump());
+            if (PayloadCompressor::Level() > 0)
+                WriteFile(dir.filePath("compression.json"), PayloadCompressor::Dump());
+            if (TriggerProfiler::IsEnabled())
+                WriteFile(dir.filePath("trigger-profile.json"), TriggerProfiler::Dump());
+        });
+    });
+
+    qInfo("The server is listening on port %u. It started in %lld ms with %lld KiB of resident memory.",
+          port, startTimer.elapsed(), qResidentMemory() / 1024);
+
+    return app.exec();
+}
@@ -0,0 +1,254 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+#include "card.h"
+#include "cardarea.h"
+#include "cardpattern.h"
+#include "client.h"
+#include "clientplayer.h"
+#include "general.h"
+#include "loadbot.h"
+#include "protocol.h"
+
+#include <CClientUser>
+
+#include <QTimer>
+
+LoadStatistics::LoadStatistics()
+    : connectedNum(0)
+    , roomNum(0)
+    , gameNum(0)
+    , requestNum(0)
+    , notificationNum(0)
+{
+}
+
+LoadBot::LoadBot(LoadStatistics *statistics, int thinkTime, QObject *parent)
+    : QObject(parent)
+    , m_client(new Client(this))
+    , m_statistics(statistics)
+    , m_thinkTime(thinkTime)
+    , m_isOwner(false)
+    , m_roomId(0)
+    , m_userNum(1)
+    , m_robotNum(0)
+    , m_gameStarted(false)
+    , m_migrating(false)
+{
+    connect(m_client, &CClient::connected, this, &LoadBot::onConnected);
+    connect(m_client, &CClient::roomEntered, this, &LoadBot::onRoomEntered);
+    connect(m_client, &CClient::userAdded, this, &LoadBot::onUserAdded);
+    connect(m_client, &CClient::gameStarted, this, &LoadBot::onGameStarted);
+    connect(m_client, &Client::gameOver, this, &LoadBot::onGameOver);
+    connect(m_client, &Client::roomMigrated, [this](){
+        m_migrating = true;
+    });
+
+    connect(m_client, &Client::promptReceived, this, &LoadBot::onNotified);
+    connect(m_client, &Client::seatArranged, this, &LoadBot::onNotified);
+    connect(m_client, &Client::cardsMoved, this, &LoadBot::onNotified);
+    connect(m_client, &Client::damageDone, this, &LoadBot::onNotified);
+    connect(m_client, &Client::loseHpDone, this, &LoadBot::onNotified);
+    connect(m_client, &Client::recoverDone, this, &LoadBot::onNotified);
+    connect(m_client, &Client::cardUsed, this, &LoadBot::onNotified);
+    connect(m_client, &Client::cardShown, this, &LoadBot::onNotified);
+    connect(m_client, &Client::skillInvoked, this, &LoadBot::onNotified);
+    connect(m_client, &Client::amazingGraceStarted, this, &LoadBot::onNotified);
+    connect(m_client, &Client::amazingGraceFinished, this, &LoadBot::onNotified);
+
+    //The interactions registered in Client::Init()
+    connect(m_client, &Client::chooseGeneralRequested, [this](const QList<const General *> &candidates, int num){
+        QVariantList choices;
+        for (int i = 0; i < num && i < candidates.length(); i++)
+            choices << candidates.at(i)->id();
+        reply(S_COMMAND_CHOOSE_GENERAL, choices);
+    });
+
+    //Ending the play phase and declining to use cards
+    connect(m_client, &Client::usingCard, [this](){
+        reply(S_COMMAND_ACT);
+    });
+
+    connect(m_client, &Client::cardAsked, [this](){
+        reply(S_COMMAND_ASK_FOR_CARD);
+    });
+
+    connect(m_client, &Client::cardsAsked, [this](const QString &pattern, int minNum, int, bool optional){
+        QVariantMap data;
+        const ClientPlayer *self = m_client->selfPlayer();
+        if (!optional && self) {
+            QVariantList cards;
+            CardPattern p(pattern);
+            QList<Card *> ownedCards = self->handcardArea()->cards() + self->equipArea()->cards();
+            foreach (const Card *card, ownedCards) {
+                if (cards.length() >= minNum)
+                    break;
+                if (card && p.match(self, card))
+                    cards << card->id();
+            }
+            data["cards"] = cards;
+            data["skillId"] = 0;
+        }
+        reply(S_COMMAND_ASK_FOR_CARD, data);
+    });
+
+    connect(m_client, &Client::amazingGraceRequested, [this](){
+        QList<Card *> cards = m_client->wugu()->cards();
+        reply(S_COMMAND_TAKE_AMAZING_GRACE, cards.isEmpty() ? QVariant() : cards.first()->id());
+    });
+
+    connect(m_client, &Client::choosePlayerCardRequested, [this](const QList<Card *> &handcards, const QList<Card *> &equips, const QList<Card *> &delayedTricks){
+        //A hidden handcard is chosen at random by the server
+        QList<Card *> cards = equips + delayedTricks + handcards;
+        foreach (const Card *card, cards) {
+            if (card) {
+                reply(S_COMMAND_CHOOSE_PLAYER_CARD, card->id());
+                return;
+            }
+        }
+        reply(S_COMMAND_CHOOSE_PLAYER_CARD);
+    });
+
+    //The same command as RoomScene::onOptionSelected()
+    connect(m_client, &Client::optionRequested, [this](){
+        reply(S_COMMAND_TRIGGER_ORDER, 0);
+    });
+
+    connect(m_client, &Client::arrangeCardRequested, [this](const QList<Card *> &cards){
+        QVariantList row;
+        foreach (const Card *card, cards)
+            row << card->id();
+        reply(S_COMMAND_ARRANGE_CARD, QVariantList() << QVariant(row));
+    });
+}
+
+void LoadBot::createRoom(const QHostAddress &host, ushort port, int userNum, int robotNum)
+{
+    m_isOwner = true;
+    m_userNum = userNum;
+    m_robotNum = robotNum;
+    m_client->connectToHost(host, port);
+}
+
+void LoadBot::enterRoom(const QHostAddress &host, ushort port, uint roomId)
+{
+    m_roomId = roomId;
+    m_client->connectToHost(host, port);
+}
+
+void LoadBot::onConnected()
+{
+    if (m_migrating)
+        return;
+
+    m_statistics->connectedNum++;
+    m_client->signup("", "", QString("LoadBot%1").arg(m_statistics->connectedNum), QString());
+
+    m_lobbyTimer.start();
+    if (m_isOwner)
+        m_client->createRoom();
+    else
+        m_client->enterRoom(m_roomId);
+}
+
+void LoadBot::onRoomEntered(const QVariant &config)
+{
+    uint roomId = config.toMap().value("id").toUInt();
+    if (roomId == 0)
+        return;
+
+    if (m_lobbyTimer.isValid()) {
+        m_statistics->lobbyLatency.record(m_lobbyTimer.nsecsElapsed() / 1000);
+        m_lobbyTimer.invalidate();
+    }
+
+    m_roomId = roomId;
+    if (m_migrating) {
+        m_migrating = false;
+        return;
+    }
+
+    if (m_isOwner) {
+        m_statistics->roomNum++;
+        emit roomCreated(roomId);
+        onUserAdded();
+    }
+}
+
+void LoadBot::onUserAdded()
+{
+    if (!m_isOwner || m_gameStarted || m_roomId == 0 || m_client->users().length() < m_userNum)
+        return;
+
+    m_gameStarted = true;
+    for (int i = 0; i < m_robotNum; i++)
+        m_client->addRobot();
+    startGame();
+}
+
+void LoadBot::onGameStarted()
+{
+    if (m_lobbyTimer.isValid()) {
+        m_statistics->lobbyLatency.record(m_lobbyTimer.nsecsElapsed() / 1000);
+        m_lobbyTimer.invalidate();
+    }
+}
+
+void LoadBot::onGameOver()
+{
+    onNotified();
+    if (!m_isOwner)
+        return;
+
+    m_statistics->gameNum++;
+    QTimer::singleShot(0, this, &LoadBot::startGame);
+}
+
+void LoadBot::onNotified()
+{
+    m_statistics->notificationNum++;
+    recordReplyLatency();
+}
+
+void LoadBot::recordReplyLatency()
+{
+    if (m_replyTimer.isValid()) {
+        m_statistics->replyLatency.record(m_replyTimer.nsecsElapsed() / 1000);
+        m_replyTimer.invalidate();
+    }
+}
+
+void LoadBot::startGame()
+{
+    m_lobbyTimer.start();
+    m_client->startGame();
+}
+
+void LoadBot::reply(int command, const QVariant &data)
+{
+    m_statistics->requestNum++;
+    recordReplyLatency();
+
+    //The think time varies between half and one and a half of the setting
+    int delay = m_thinkTime > 0 ? m_thinkTime / 2 + qrand() % (m_thinkTime + 1) : 0;
+    QTimer::singleShot(delay, this, [this, command, data](){
+        m_client->replyToServer(command, data);
+        m_replyTimer.start();
+    });
+}
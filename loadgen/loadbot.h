@@ -0,0 +1,91 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+#ifndef LOADBOT_H
+#define LOADBOT_H
+
+#include "replystatistics.h"
+
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QObject>
+
+class Client;
+
+//Shared by all the bots in the thread of the load generator
+struct LoadStatistics
+{
+    LoadStatistics();
+
+    int connectedNum;
+    int roomNum;
+    qint64 gameNum;
+    qint64 requestNum;
+    qint64 notificationNum;
+
+    //From a reply to the next message the bot receives, in microseconds
+    LatencyHistogram replyLatency;
+    //From createRoom(), enterRoom() or startGame() to the room or the game being entered
+    LatencyHistogram lobbyLatency;
+};
+
+/* A headless client that answers every request with a simple legal reply after some think
+ * time. The owner of a room adds robots once the other bots have entered, starts the game
+ * and starts it again whenever it's over.
+ */
+class LoadBot : public QObject
+{
+    Q_OBJECT
+
+public:
+    LoadBot(LoadStatistics *statistics, int thinkTime, QObject *parent = nullptr);
+
+    void createRoom(const QHostAddress &host, ushort port, int userNum, int robotNum);
+    void enterRoom(const QHostAddress &host, ushort port, uint roomId);
+
+signals:
+    void roomCreated(uint roomId);
+
+private:
+    void onConnected();
+    void onRoomEntered(const QVariant &config);
+    void onUserAdded();
+    void onGameStarted();
+    void onGameOver();
+    void onNotified();
+    void recordReplyLatency();
+
+    void startGame();
+    void reply(int command, const QVariant &data = QVariant());
+
+    Client *m_client;
+    LoadStatistics *m_statistics;
+    int m_thinkTime;
+    bool m_isOwner;
+    uint m_roomId;
+    int m_userNum;
+    int m_robotNum;
+    bool m_gameStarted;
+    //Client rejoins a migrated game by itself
+    bool m_migrating;
+    QElapsedTimer m_replyTimer;
+    QElapsedTimer m_lobbyTimer;
+};
+
+#endif // LOADBOT_H
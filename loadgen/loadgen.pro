@@ -0,0 +1,20 @@
+TEMPLATE = app
+TARGET = QSanguoshaLoad
+QT += qml network
+QT -= gui
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+QSAN_MODULES = client
+include(../src/src.pri)
+
+SOURCES += main.cpp \
+    loadbot.cpp
+
+HEADERS += \
+    loadbot.h
+
+# Cardirector
+DEFINES += MCD_STATIC
+INCLUDEPATH += ../Cardirector/include
+LIBS += -L$$PWD/../Cardirector/lib -lCardirector -loggvorbis
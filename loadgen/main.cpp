@@ -0,0 +1,122 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+#include "loadbot.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QTimer>
+
+#include <functional>
+
+namespace {
+
+QString Percentiles(const LatencyHistogram &histogram)
+{
+    //Microseconds to milliseconds
+    return QString("%1/%2/%3")
+            .arg(histogram.valueAtPercentile(50) / 1000.0, 0, 'f', 1)
+            .arg(histogram.valueAtPercentile(90) / 1000.0, 0, 'f', 1)
+            .arg(histogram.valueAtPercentile(99) / 1000.0, 0, 'f', 1);
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("QSanguoshaLoad");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless bot clients that load a QSanguosha server");
+    parser.addHelpOption();
+
+    QCommandLineOption hostOption("host", "Connect to the host. The default is 127.0.0.1.", "address", "127.0.0.1");
+    QCommandLineOption portOption("port", "Connect to the port. The default is 5927.", "port", "5927");
+    QCommandLineOption clientOption("clients", "Open this many connections. The default is 64.", "number", "64");
+    QCommandLineOption userOption("users-per-room", "Bots in each room. The default is 1.", "number", "1");
+    QCommandLineOption robotOption("robots-per-room", "Robots added to each room. The default is 7.", "number", "7");
+    QCommandLineOption rampOption("ramp", "Seconds over which rooms are opened. The default is 60.", "seconds", "60");
+    QCommandLineOption thinkOption("think-time", "Milliseconds a bot waits before replying. The default is 200.", "msecs", "200");
+    QCommandLineOption intervalOption("interval", "Seconds between two reports. The default is 10.", "seconds", "10");
+    QCommandLineOption durationOption("duration", "Quit after the seconds. The default is to run until killed.", "seconds", "0");
+    parser.addOptions({hostOption, portOption, clientOption, userOption, robotOption, rampOption,
+                       thinkOption, intervalOption, durationOption});
+    parser.process(app);
+
+    QHostAddress host(parser.value(hostOption));
+    ushort port = parser.value(portOption).toUShort();
+    int clientNum = qMax(parser.value(clientOption).toInt(), 1);
+    int userNum = qMax(parser.value(userOption).toInt(), 1);
+    int robotNum = qMax(parser.value(robotOption).toInt(), 0);
+    int ramp = qMax(parser.value(rampOption).toInt(), 0) * 1000;
+    int thinkTime = qMax(parser.value(thinkOption).toInt(), 0);
+    int interval = qMax(parser.value(intervalOption).toInt(), 1) * 1000;
+    int duration = qMax(parser.value(durationOption).toInt(), 0) * 1000;
+
+    LoadStatistics statistics;
+
+    //Each room is opened by its owner, and the others enter once it's created
+    int roomNum = (clientNum + userNum - 1) / userNum;
+    for (int i = 0; i < roomNum; i++) {
+        int members = qMin(userNum, clientNum - i * userNum);
+        QTimer::singleShot(ramp * i / roomNum, [&app, &statistics, host, port, members, robotNum, thinkTime](){
+            LoadBot *owner = new LoadBot(&statistics, thinkTime, &app);
+            QObject::connect(owner, &LoadBot::roomCreated, [&app, &statistics, host, port, members, thinkTime](uint roomId){
+                for (int j = 1; j < members; j++) {
+                    LoadBot *member = new LoadBot(&statistics, thinkTime, &app);
+                    member->enterRoom(host, port, roomId);
+                }
+            });
+            owner->createRoom(host, port, members, robotNum);
+        });
+    }
+
+    QTextStream out(stdout);
+    out << "seconds\tclients\trooms\tgames/min\trequests/s\tnotifications/s\treply ms p50/p90/p99\tlobby ms p50/p90/p99" << endl;
+
+    QElapsedTimer clock;
+    clock.start();
+    LoadStatistics last;
+    QTimer reportTimer;
+    QObject::connect(&reportTimer, &QTimer::timeout, [&](){
+        double seconds = interval / 1000.0;
+        out << clock.elapsed() / 1000 << '\t'
+            << statistics.connectedNum << '\t'
+            << statistics.roomNum << '\t'
+            << QString::number((statistics.gameNum - last.gameNum) * 60.0 / seconds, 'f', 1) << '\t'
+            << QString::number((statistics.requestNum - last.requestNum) / seconds, 'f', 1) << '\t'
+            << QString::number((statistics.notificationNum - last.notificationNum) / seconds, 'f', 1) << '\t'
+            << Percentiles(statistics.replyLatency) << '\t'
+            << Percentiles(statistics.lobbyLatency) << endl;
+
+        //Latency is reported per interval, so that it follows the load as it ramps up
+        last = statistics;
+        statistics.replyLatency = LatencyHistogram();
+        statistics.lobbyLatency = LatencyHistogram();
+    });
+    reportTimer.start(interval);
+
+    if (duration > 0)
+        QTimer::singleShot(duration, &app, &QCoreApplication::quit);
+
+    return app.exec();
+}
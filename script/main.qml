@@ -53,6 +53,12 @@ Item {
     }
 
     Component.onCompleted: {
+        //The replay or the spectated room is played by the C++ side once the room scene is loaded
+        if (Qt.application.arguments.indexOf("--replay") >= 0 || Qt.application.arguments.indexOf("--spectate") >= 0) {
+            dialogLoader.setSource("Gui/RoomScene.qml");
+            return;
+        }
+
         var skip_splash = false;
         for (var i = 0; i < Qt.application.arguments.length; i++) {
             var schema = "qsanguosha://";
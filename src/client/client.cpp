@@ -21,22 +21,61 @@
 #include "client.h"
 #include "clientplayer.h"
 #include "engine.h"
+#include "payloadcompressor.h"
 #include "protocol.h"
 #include "skill.h"
 
 #include <CClientUser>
 
+#include <QHostAddress>
+#include <QMetaProperty>
 #include <QVariant>
 #include <QtQml>
 
+#include <algorithm>
+
 static Client *ClientInstance = nullptr;
+static QHash<int, Client::Callback> Callbacks;
+
+namespace {
+
+//Properties that only forward to other properties aren't saved
+const QSet<QByteArray> AliasProperties = {"dead", "generalId"};
+
+QVariant SaveArea(const CardArea *area)
+{
+    QVariantList cards;
+    foreach (const Card *card, area->cards())
+        cards << (card ? card->id() : 0);
+
+    QVariantMap data;
+    data["cards"] = cards;
+    QStringList virtualCards = area->virtualCards();
+    if (!virtualCards.isEmpty())
+        data["virtualCards"] = virtualCards;
+    return data;
+}
+
+QVariantList SaveSkills(const QList<const Skill *> &skills)
+{
+    QVariantList data;
+    foreach (const Skill *skill, skills)
+        data << skill->id();
+    return data;
+}
+
+}
 
 Client::Client(QObject *parent)
     : CClient(parent)
     , m_wugu(new CardArea(CardArea::Wugu))
+    , m_replayViewer(0)
 {
     ClientInstance = this;
     connect(this, &CClient::gameStarted, this, &Client::restart);
+    connect(this, &CClient::connected, this, &Client::rejoin);
+    connect(this, &CClient::roomEntered, this, &Client::onMigratedRoomEntered);
+    connect(this, &CClient::userAdded, this, &Client::startMigratedGame);
 }
 
 Client *Client::instance()
@@ -114,9 +153,234 @@ void Client::AddInteraction(int command, Client::Callback callback)
 
 void Client::AddCallback(int command, Client::Callback callback)
 {
+    Callbacks[command] = callback;
     CClient::AddCallback(command, reinterpret_cast<CClient::Callback>(callback));
 }
 
+void Client::startReplay(uint viewer)
+{
+    restart();
+    m_user2player.clear();
+    m_wugu->clear();
+    m_replayViewer = viewer;
+}
+
+void Client::replayNotification(int command, const QVariant &data)
+{
+    Callback callback = Callbacks.value(command);
+    if (callback)
+        (*callback)(this, data);
+}
+
+QVariant Client::saveState() const
+{
+    QVariantMap state;
+
+    QVariantList cards;
+    foreach (uint id, m_cards.keys())
+        cards << id;
+    state["cards"] = cards;
+
+    const ClientPlayer *self = selfPlayer();
+    state["selfId"] = self ? self->id() : 0;
+
+    QList<const ClientPlayer *> players = this->players();
+    std::sort(players.begin(), players.end(), [](const ClientPlayer *a, const ClientPlayer *b){
+        return a->seat() < b->seat();
+    });
+
+    const QMetaObject *metaObject = &Player::staticMetaObject;
+    QVariantList playerList;
+    foreach (const ClientPlayer *player, players) {
+        QVariantMap data;
+        data["id"] = player->id();
+        data["agentId"] = player->user() ? player->user()->id() : 0;
+
+        QVariantMap properties;
+        for (int i = metaObject->propertyOffset(); i < metaObject->propertyCount(); i++) {
+            QMetaProperty property = metaObject->property(i);
+            if (!property.isWritable() || AliasProperties.contains(property.name()))
+                continue;
+            properties[property.name()] = property.read(player);
+        }
+        data["properties"] = properties;
+
+        data["handcards"] = SaveArea(player->handcardArea());
+        data["equips"] = SaveArea(player->equipArea());
+        data["delayedTricks"] = SaveArea(player->delayedTrickArea());
+        data["judgeCards"] = SaveArea(player->judgeCards());
+
+        data["headSkills"] = SaveSkills(player->headSkills());
+        data["deputySkills"] = SaveSkills(player->deputySkills());
+        data["acquiredSkills"] = SaveSkills(player->acquiredSkills());
+
+        QVariantMap skillHistory;
+        QMapIterator<const Skill *, int> skillIter(player->skillHistory());
+        while (skillIter.hasNext()) {
+            skillIter.next();
+            skillHistory[QString::number(skillIter.key()->id())] = skillIter.value();
+        }
+        data["skillHistory"] = skillHistory;
+
+        QVariantMap cardHistory;
+        QHashIterator<QString, int> cardIter(player->cardHistory());
+        while (cardIter.hasNext()) {
+            cardIter.next();
+            cardHistory[cardIter.key()] = cardIter.value();
+        }
+        data["cardHistory"] = cardHistory;
+
+        data["tags"] = player->tag;
+        playerList << data;
+    }
+    state["players"] = playerList;
+
+    state["wugu"] = SaveArea(m_wugu);
+    return state;
+}
+
+void Client::restoreState(const QVariant &state)
+{
+    const QVariantMap data = state.toMap();
+
+    restart();
+    m_user2player.clear();
+    m_wugu->clear();
+
+    Engine *engine = Engine::instance();
+    const QVariantList cards = data["cards"].toList();
+    foreach (const QVariant &cardId, cards) {
+        const Card *card = engine->getCard(cardId.toUInt());
+        if (card)
+            m_cards[card->id()] = card->clone();
+    }
+
+    uint selfId = data["selfId"].toUInt();
+    QList<ClientPlayer *> players;
+    const QVariantList playerList = data["players"].toList();
+    foreach (const QVariant &rawPlayer, playerList) {
+        const QVariantMap playerData = rawPlayer.toMap();
+
+        uint agentId = playerData["agentId"].toUInt();
+        CClientUser *user = agentId ? findUser(agentId) : nullptr;
+        ClientPlayer *player = new ClientPlayer(user, this);
+        player->setId(playerData["id"].toUInt());
+        m_players[player->id()] = player;
+        if (user)
+            m_user2player[user] = player;
+        if (player->id() == selfId)
+            m_user2player[self()] = player;
+
+        const QVariantMap properties = playerData["properties"].toMap();
+        for (QVariantMap::const_iterator i = properties.constBegin(); i != properties.constEnd(); i++)
+            player->setProperty(i.key().toLatin1().constData(), i.value());
+
+        restoreArea(player->handcardArea(), playerData["handcards"]);
+        restoreArea(player->equipArea(), playerData["equips"]);
+        restoreArea(player->delayedTrickArea(), playerData["delayedTricks"]);
+        restoreArea(player->judgeCards(), playerData["judgeCards"]);
+
+        const Player::SkillArea skillAreas[] = {Player::HeadSkillArea, Player::DeputySkillArea, Player::AcquiredSkillArea};
+        const char *skillKeys[] = {"headSkills", "deputySkills", "acquiredSkills"};
+        for (int i = 0; i < 3; i++) {
+            const QVariantList skills = playerData[skillKeys[i]].toList();
+            foreach (const QVariant &skillId, skills) {
+                const Skill *skill = engine->getSkill(skillId.toUInt());
+                if (skill)
+                    player->addSkill(skill, skillAreas[i]);
+            }
+        }
+
+        const QVariantMap skillHistory = playerData["skillHistory"].toMap();
+        for (QVariantMap::const_iterator i = skillHistory.constBegin(); i != skillHistory.constEnd(); i++) {
+            const Skill *skill = engine->getSkill(i.key().toUInt());
+            if (skill == nullptr)
+                continue;
+            for (int times = i.value().toInt(); times > 0; times--)
+                player->addSkillHistory(skill);
+        }
+
+        const QVariantMap cardHistory = playerData["cardHistory"].toMap();
+        for (QVariantMap::const_iterator i = cardHistory.constBegin(); i != cardHistory.constEnd(); i++)
+            player->addCardHistory(i.key(), i.value().toInt());
+
+        player->tag = playerData["tags"].toMap();
+        players << player;
+    }
+
+    //Players are saved in seat order
+    if (!players.isEmpty()) {
+        for (int i = 1; i < players.length(); i++)
+            players.at(i - 1)->setNext(players.at(i));
+        players.last()->setNext(players.first());
+    }
+
+    restoreArea(m_wugu, data["wugu"]);
+
+    emit seatArranged();
+    emit stateRestored();
+}
+
+void Client::rejoin()
+{
+    if (m_migration.isEmpty())
+        return;
+
+    //The new server leads the other users to the room once the owner has created it
+    QString screenName = m_migration["screenName"].toString();
+    signup("", "", screenName, m_migration["avatar"].toString());
+    if (screenName == m_migration["owner"].toString())
+        createRoom();
+}
+
+void Client::onMigratedRoomEntered(const QVariant &config)
+{
+    if (m_migration.isEmpty() || config.toMap().value("id").toUInt() == 0)
+        return;
+
+    if (self() == nullptr || self()->screenName() != m_migration["owner"].toString()) {
+        m_migration.clear();
+        return;
+    }
+
+    for (int i = m_migration["robotNum"].toInt(); i > 0; i--)
+        addRobot();
+    startMigratedGame();
+}
+
+void Client::startMigratedGame()
+{
+    if (m_migration.isEmpty() || self() == nullptr || self()->screenName() != m_migration["owner"].toString())
+        return;
+
+    //The new server resumes the game once the room has the same users
+    if (users().length() < m_migration["userNum"].toInt())
+        return;
+
+    m_migration.clear();
+    startGame();
+}
+
+void Client::restoreArea(CardArea *area, const QVariant &data)
+{
+    const QVariantMap areaData = data.toMap();
+
+    QList<Card *> cards;
+    const QVariantList cardIds = areaData["cards"].toList();
+    foreach (const QVariant &cardId, cardIds) {
+        uint id = cardId.toUInt();
+        //Unknown cards are kept as null placeholders, as MoveCardsCommand does
+        cards << (id ? m_cards.value(id) : nullptr);
+    }
+    for (int i = areaData["hidden"].toInt(); i > 0; i--)
+        cards << nullptr;
+    area->add(cards);
+
+    const QStringList virtualCards = areaData["virtualCards"].toStringList();
+    foreach (const QString &name, virtualCards)
+        area->addVirtualCard(name);
+}
+
 void Client::restart()
 {
     foreach (ClientPlayer *player, m_players)
@@ -243,20 +507,24 @@ void Client::ArrangeSeatCommand(Client *client, const QVariant &data)
         const QVariantMap info = rawInfo.toMap();
 
         CClientUser *agent = nullptr;
-        if (info.contains("agentId")) {
-            uint agentId = info["agentId"].toUInt();
+        uint agentId = info["agentId"].toUInt();
+        if (agentId)
             agent = client->findUser(agentId);
-        }
 
+        //Users are unknown in replay mode
+        ClientPlayer *player = new ClientPlayer(agent, client);
+        player->setId(info["playerId"].toUInt());
+        client->m_players[player->id()] = player;
         if (agent) {
-            ClientPlayer *player = new ClientPlayer(agent, client);
-            player->setId(info["playerId"].toUInt());
-            client->m_players[player->id()] = player;
             client->m_user2player[agent] = player;
             player->setScreenName(agent->screenName());
-
-            players << player;
+        } else {
+            player->setScreenName(info["screenName"].toString());
+            if (agentId == client->m_replayViewer)
+                client->m_user2player[client->self()] = player;
         }
+
+        players << player;
     }
 
     if (!players.isEmpty()) {
@@ -406,6 +674,8 @@ void Client::UseCardCommand(Client *client, const QVariant &data)
 void Client::AddCardHistoryCommand(Client *client, const QVariant &data)
 {
     ClientPlayer *self = client->m_user2player.value(client->self());
+    if (self == nullptr)
+        return;
 
     if (data.isNull()) {
         self->clearCardHistory();
@@ -726,6 +996,53 @@ void Client::GameOverCommand(Client *client, const QVariant &data)
     emit client->gameOver(winners);
 }
 
+void Client::ResyncCommand(Client *client, const QVariant &data)
+{
+    client->restoreState(data);
+}
+
+void Client::BatchCommand(Client *client, const QVariant &data)
+{
+    //Each notification is a list of a command and its data, in the order they were sent
+    QVariantList notifications = data.toList();
+    foreach (const QVariant &notification, notifications) {
+        QVariantList args = notification.toList();
+        if (args.length() == 2)
+            client->replayNotification(args.at(0).toInt(), args.at(1));
+    }
+}
+
+void Client::CompressedCommand(Client *client, const QVariant &data)
+{
+    int command;
+    QVariant payload;
+    if (PayloadCompressor::Decompress(data, &command, &payload))
+        client->replayNotification(command, payload);
+}
+
+void Client::MigrateCommand(Client *client, const QVariant &data)
+{
+    QVariantMap redirect = data.toMap();
+
+    //The new server tells the users other than the owner which room to enter
+    if (redirect.contains("roomId")) {
+        client->enterRoom(redirect["roomId"].toUInt());
+        return;
+    }
+
+    CClientUser *self = client->self();
+    if (self == nullptr)
+        return;
+    redirect["screenName"] = self->screenName();
+    redirect["avatar"] = self->avatar();
+    client->m_migration = redirect;
+
+    QString host = redirect["host"].toString();
+    ushort port = ushort(redirect["port"].toUInt());
+    emit client->roomMigrated(host, port);
+    client->connectToHost(QHostAddress(host), port);
+}
+
 static QObject *ClientInstanceCallback(QQmlEngine *, QJSEngine *)
 {
     return Client::instance();
@@ -758,6 +1075,10 @@ void Client::Init()
     AddCallback(S_COMMAND_SET_VIRTUAL_CARD, SetVirtualCardCommand);
     AddCallback(S_COMMAND_SET_PLAYER_TAG, SetPlayerTagCommand);
     AddCallback(S_COMMAND_GAME_OVER, GameOverCommand);
+    AddCallback(S_COMMAND_RESYNC, ResyncCommand);
+    AddCallback(S_COMMAND_BATCH, BatchCommand);
+    AddCallback(S_COMMAND_COMPRESSED, CompressedCommand);
+    AddCallback(S_COMMAND_MIGRATE, MigrateCommand);
 
     AddInteraction(S_COMMAND_CHOOSE_GENERAL, ChooseGeneralRequestCommand);
     AddInteraction(S_COMMAND_ACT, ActRequestCommand);
@@ -33,6 +33,9 @@ class Client : public CClient
 {
     Q_OBJECT
 
+    friend class Benchmark;
+    friend class LoadBot;
+
 public:
     static Client *instance();
     ~Client();
@@ -52,6 +55,21 @@ public:
     static void AddInteraction(int command, Callback callback);
     static void AddCallback(int command, Callback callback);
 
+    //Replay mode. Recorded notifications are fed into the same callbacks as the server's.
+    //The viewer is the agent whose player is regarded as selfPlayer().
+    void startReplay(uint viewer = 0);
+    void setReplayViewer(uint agentId) { m_replayViewer = agentId; }
+    void replayNotification(int command, const QVariant &data);
+
+    //The room as this client sees it. restoreState() replaces all the players and cards
+    //in one pass and emits seatArranged() and stateRestored().
+    QVariant saveState() const;
+    void restoreState(const QVariant &state);
+
+    //From S_COMMAND_MIGRATE until the room of the migrated game is entered on the new server.
+    //The client reconnects with the same screen name, and the owner recreates the room.
+    bool isMigrating() const { return !m_migration.isEmpty(); }
+
 signals:
     void promptReceived(const QString &prompt);
     void seatArranged();
@@ -73,6 +91,9 @@ signals:
     void arrangeCardRequested(const QList<Card *> &cards, const QList<int> &capacities, const QStringList &areaNames);
     void skillInvoked(const ClientPlayer *invoker, const Skill *skill, const QList<const Card *> &cards, const QList<const ClientPlayer *> &targets);
     void gameOver(const QList<const ClientPlayer *> &winners);
+    void stateRestored();
+    //The game goes on in the server at the host and port, and the client is reconnecting to it
+    void roomMigrated(const QString &host, ushort port);
 
 private:
     Client(QObject *parent = 0);
@@ -82,6 +103,11 @@ private:
     CardArea *findArea(const CardsMoveStruct::Area &area);
     QList<Card *> findCards(const QVariant &data);
     QList<const ClientPlayer *> findPlayers(const QVariant &data);
+    void restoreArea(CardArea *area, const QVariant &data);
+
+    void rejoin();
+    void onMigratedRoomEntered(const QVariant &config);
+    void startMigratedGame();
 
     static inline QString tr(const QString &text) { return tr(text.toLatin1().constData()); }
 
@@ -118,12 +144,18 @@ private:
     static void SetVirtualCardCommand(Client *client, const QVariant &data);
     static void SetPlayerTagCommand(Client *client, const QVariant &data);
     static void GameOverCommand(Client *client, const QVariant &data);
+    static void ResyncCommand(Client *client, const QVariant &data);
+    static void BatchCommand(Client *client, const QVariant &data);
+    static void CompressedCommand(Client *client, const QVariant &data);
+    static void MigrateCommand(Client *client, const QVariant &data);
 
     QMap<uint, ClientPlayer *> m_players;
     QMap<CClientUser *, ClientPlayer *> m_user2player;
     QMap<uint, Card *> m_cards;//Record card state
 
     CardArea *m_wugu;
+    uint m_replayViewer;
+    QVariantMap m_migration;
 };
 
 #endif // CLIENT_H
@@ -0,0 +1,421 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+
+#include "client.h"
+#include "protocol.h"
+#include "replayer.h"
+
+#include <QSignalBlocker>
+
+namespace {
+
+//Long thinking time is not worth watching
+const uint MaxFrameInterval = 2000;
+
+QVariantList ToVariant(const QList<int> &values)
+{
+    QVariantList data;
+    foreach (int value, values)
+        data << value;
+    return data;
+}
+
+}
+
+Replayer::Replayer(Client *client, QObject *parent)
+    : QObject(parent)
+    , m_client(client)
+    , m_firstFrameOffset(0)
+    , m_endOffset(0)
+    , m_offset(0)
+    , m_hasNextFrame(false)
+    , m_viewer(0)
+    , m_position(0)
+    , m_speed(1.0)
+{
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout, this, &Replayer::replayNextFrame);
+}
+
+Replayer::~Replayer()
+{
+    close();
+}
+
+bool Replayer::open(const QString &fileName)
+{
+    close();
+
+    m_file.setFileName(fileName);
+    if (!map()) {
+        qWarning("Failed to open the replay file %s", qPrintable(fileName));
+        return false;
+    }
+
+    int offset = 0;
+    if (!ReplayFile::Read(m_data, offset, m_header)) {
+        qWarning("%s is not a valid replay file", qPrintable(fileName));
+        close();
+        return false;
+    }
+    m_firstFrameOffset = offset;
+
+    loadIndex();
+    rewind();
+    return m_hasNextFrame;
+}
+
+void Replayer::close()
+{
+    m_timer.stop();
+    m_hasNextFrame = false;
+    m_data.clear();
+    m_file.close();
+    m_turns.clear();
+    m_keyframes.clear();
+}
+
+void Replayer::setViewer(uint agentId)
+{
+    m_viewer = agentId;
+    m_client->setReplayViewer(agentId);
+}
+
+void Replayer::setSpeed(qreal speed)
+{
+    if (speed > 0)
+        m_speed = speed;
+}
+
+bool Replayer::seekToRound(int round)
+{
+    int target = -1;
+    foreach (const Turn &turn, m_turns) {
+        if (turn.round >= round) {
+            target = turn.offset;
+            break;
+        }
+    }
+    if (target < 0)
+        return false;
+
+    bool playing = isPlaying();
+    pause();
+    buildKeyframes();
+
+    const Keyframe *keyframe = nullptr;
+    const QList<Keyframe> &keyframes = m_keyframes[m_viewer];
+    for (int i = 0; i < keyframes.length() && keyframes.at(i).resumeOffset <= target; i++)
+        keyframe = &keyframes.at(i);
+
+    {
+        //The room scene is refreshed once the state is restored
+        QSignalBlocker blocker(m_client);
+
+        m_offset = m_firstFrameOffset;
+        m_client->startReplay(m_viewer);
+        if (keyframe) {
+            QVariant state = keyframe->state;
+            if (!state.isValid()) {
+                int offset = keyframe->offset;
+                ReplayFrame frame;
+                if (ReplayFile::Read(m_data, offset, frame) && frame.type == ReplayFrame::Keyframe)
+                    state = frame.data;
+            }
+            if (state.isValid()) {
+                m_client->restoreState(state);
+                m_offset = keyframe->resumeOffset;
+            }
+        }
+
+        ReplayFrame frame;
+        while (m_offset < target && ReplayFile::Read(m_data, m_offset, frame)) {
+            replayFrame(frame);
+            m_position = frame.timestamp;
+        }
+    }
+
+    if (readNextFrame())
+        m_position = m_nextFrame.timestamp;
+    emit m_client->seatArranged();
+    emit m_client->stateRestored();
+
+    if (playing)
+        play();
+    return true;
+}
+
+void Replayer::play()
+{
+    if (m_hasNextFrame && !m_timer.isActive())
+        scheduleNextFrame();
+}
+
+void Replayer::pause()
+{
+    m_timer.stop();
+}
+
+void Replayer::replayNextFrame()
+{
+    //Frames recorded in the same millisecond are replayed together
+    uint position = m_nextFrame.timestamp;
+    while (m_hasNextFrame && m_nextFrame.timestamp == position) {
+        replayFrame(m_nextFrame);
+        readNextFrame();
+    }
+    m_position = position;
+
+    if (m_hasNextFrame)
+        scheduleNextFrame();
+    else
+        emit finished();
+}
+
+bool Replayer::map()
+{
+    if (!m_file.open(QFile::ReadOnly))
+        return false;
+
+    uchar *memory = m_file.map(0, m_file.size());
+    if (memory == nullptr) {
+        m_file.close();
+        return false;
+    }
+
+    m_data = QByteArray::fromRawData(reinterpret_cast<const char *>(memory), m_file.size());
+    return true;
+}
+
+void Replayer::loadIndex()
+{
+    m_endOffset = m_data.size();
+
+    int pointerOffset = m_data.size() - ReplayFile::IndexOffsetSize();
+    ReplayFrame pointer;
+    if (pointerOffset > m_firstFrameOffset && ReplayFile::Read(m_data, pointerOffset, pointer) && pointer.type == ReplayFrame::IndexOffset) {
+        int indexOffset = pointer.data.toInt();
+        ReplayFrame index;
+        if (ReplayFile::Read(m_data, indexOffset, index) && index.type == ReplayFrame::Index) {
+            const QVariantMap data = index.data.toMap();
+            m_endOffset = data["end"].toInt();
+
+            const QVariantList turns = data["turns"].toList();
+            for (int i = 0; i + 2 < turns.length(); i += 3) {
+                Turn turn;
+                turn.round = turns.at(i).toInt();
+                turn.playerId = turns.at(i + 1).toUInt();
+                turn.offset = turns.at(i + 2).toInt();
+                m_turns << turn;
+            }
+
+            const QVariantMap viewers = data["keyframes"].toMap();
+            for (QVariantMap::const_iterator iter = viewers.constBegin(); iter != viewers.constEnd(); iter++) {
+                QList<Keyframe> &keyframes = m_keyframes[iter.key().toUInt()];
+                const QVariantList values = iter.value().toList();
+                for (int i = 0; i + 2 < values.length(); i += 3) {
+                    Keyframe keyframe;
+                    keyframe.round = values.at(i).toInt();
+                    keyframe.offset = values.at(i + 1).toInt();
+                    keyframe.resumeOffset = values.at(i + 2).toInt();
+                    keyframes << keyframe;
+                }
+            }
+            return;
+        }
+    }
+
+    //Without an index, turns are found by skipping through the frames, which only reads their types
+    int offset = m_firstFrameOffset;
+    ReplayFrame::Type type;
+    forever {
+        int frameOffset = offset;
+        if (!ReplayFile::Skip(m_data, offset, type) || type > ReplayFrame::Turn)
+            break;
+
+        if (type == ReplayFrame::Turn) {
+            ReplayFrame frame;
+            int turnOffset = frameOffset;
+            ReplayFile::Read(m_data, turnOffset, frame);
+
+            Turn turn;
+            turn.round = frame.command;
+            turn.playerId = frame.data.toUInt();
+            turn.offset = frameOffset;
+            m_turns << turn;
+        }
+        m_endOffset = offset;
+    }
+}
+
+void Replayer::buildKeyframes()
+{
+    if (m_keyframes.contains(m_viewer))
+        return;
+
+    QList<Keyframe> keyframes;
+    {
+        QSignalBlocker blocker(m_client);
+        m_client->startReplay(m_viewer);
+
+        int lastRound = 0;
+        int offset = m_firstFrameOffset;
+        ReplayFrame frame;
+        while (offset < m_endOffset) {
+            int frameOffset = offset;
+            if (!ReplayFile::Read(m_data, offset, frame))
+                break;
+
+            if (frame.type == ReplayFrame::Turn && frame.command != lastRound) {
+                lastRound = frame.command;
+
+                Keyframe keyframe;
+                keyframe.round = lastRound;
+                keyframe.offset = -1;
+                keyframe.resumeOffset = frameOffset;
+                keyframe.state = m_client->saveState();
+                keyframes << keyframe;
+            }
+
+            replayFrame(frame);
+        }
+    }
+
+    //The viewer may be decided while replaying the seat arrangement
+    m_keyframes[m_viewer] = keyframes;
+    saveKeyframes();
+}
+
+void Replayer::saveKeyframes()
+{
+    QFile file(m_file.fileName());
+    if (!file.open(QFile::WriteOnly | QFile::Append))
+        return;
+
+    int fileSize = m_data.size();
+    QByteArray buffer;
+
+    QList<Keyframe> &keyframes = m_keyframes[m_viewer];
+    for (int i = 0; i < keyframes.length(); i++) {
+        Keyframe &keyframe = keyframes[i];
+        if (keyframe.offset >= 0)
+            continue;
+
+        ReplayFrame frame;
+        frame.type = ReplayFrame::Keyframe;
+        frame.agentId = m_viewer;
+        frame.command = keyframe.round;
+        frame.data = keyframe.state;
+        keyframe.offset = fileSize + buffer.size();
+        buffer.append(ReplayFile::Serialize(frame));
+    }
+
+    QVariantMap index;
+    index["end"] = m_endOffset;
+
+    QList<int> turns;
+    foreach (const Turn &turn, m_turns)
+        turns << turn.round << turn.playerId << turn.offset;
+    index["turns"] = ToVariant(turns);
+
+    QVariantMap viewers;
+    for (QMap<uint, QList<Keyframe>>::const_iterator iter = m_keyframes.constBegin(); iter != m_keyframes.constEnd(); iter++) {
+        QList<int> values;
+        foreach (const Keyframe &keyframe, iter.value())
+            values << keyframe.round << keyframe.offset << keyframe.resumeOffset;
+        viewers[QString::number(iter.key())] = ToVariant(values);
+    }
+    index["keyframes"] = viewers;
+
+    ReplayFrame indexFrame;
+    indexFrame.type = ReplayFrame::Index;
+    indexFrame.data = index;
+    qint64 indexOffset = fileSize + buffer.size();
+    buffer.append(ReplayFile::Serialize(indexFrame));
+
+    ReplayFrame pointer;
+    pointer.type = ReplayFrame::IndexOffset;
+    pointer.data = indexOffset;
+    buffer.append(ReplayFile::Serialize(pointer));
+
+    if (file.write(buffer) != buffer.size()) {
+        qWarning("Failed to save the keyframes into %s", qPrintable(file.fileName()));
+        return;
+    }
+    file.close();
+
+    //The file grows, so it must be mapped again
+    m_data.clear();
+    m_file.close();
+    if (!map()) {
+        qWarning("Failed to open the replay file %s", qPrintable(file.fileName()));
+        m_hasNextFrame = false;
+        return;
+    }
+
+    //Keyframes are loaded from the file from now on
+    for (int i = 0; i < keyframes.length(); i++)
+        keyframes[i].state = QVariant();
+}
+
+void Replayer::rewind()
+{
+    m_position = 0;
+    m_offset = m_firstFrameOffset;
+    m_client->startReplay(m_viewer);
+    readNextFrame();
+}
+
+bool Replayer::readNextFrame()
+{
+    m_hasNextFrame = m_offset < m_endOffset && ReplayFile::Read(m_data, m_offset, m_nextFrame);
+    return m_hasNextFrame;
+}
+
+void Replayer::replayFrame(const ReplayFrame &frame)
+{
+    if (m_viewer == 0 && frame.type == ReplayFrame::Broadcast && frame.command == S_COMMAND_ARRANGE_SEAT) {
+        QVariantList infos = frame.data.toList();
+        if (!infos.isEmpty())
+            setViewer(infos.first().toMap().value("agentId").toUInt());
+    }
+
+    if (isVisible(frame))
+        m_client->replayNotification(frame.command, frame.data);
+}
+
+bool Replayer::isVisible(const ReplayFrame &frame) const
+{
+    switch (frame.type) {
+    case ReplayFrame::Notification:
+        return frame.agentId == m_viewer;
+    case ReplayFrame::Broadcast:
+        return frame.agentId != m_viewer;
+    default:
+        return false;
+    }
+}
+
+void Replayer::scheduleNextFrame()
+{
+    uint interval = m_nextFrame.timestamp > m_position ? m_nextFrame.timestamp - m_position : 0;
+    interval = qMin(interval, MaxFrameInterval);
+    m_timer.start(qRound(interval / m_speed));
+}
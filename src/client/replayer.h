@@ -0,0 +1,128 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+
+#ifndef REPLAYER_H
+#define REPLAYER_H
+
+#include "replayfile.h"
+
+#include <QFile>
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QTimer>
+
+class Client;
+
+/* Plays a replay file recorded by ReplayRecorder. The notifications that the viewer
+ * received are fed into the callbacks of Client at the recorded pace, so that the
+ * room scene shows the game as that player saw it. Requests and replies are skipped.
+ *
+ * The file is memory-mapped. Seeking restores the latest keyframe of the viewer's
+ * client state before the target round and replays the rest without pacing. Keyframes
+ * are taken once per round by replaying the whole game the first time a viewer seeks,
+ * and appended to the file with an index so that it's never done again for that viewer.
+ */
+class Replayer : public QObject
+{
+    Q_OBJECT
+
+public:
+    Replayer(Client *client, QObject *parent = 0);
+    ~Replayer();
+
+    bool open(const QString &fileName);
+    void close();
+    const ReplayHeader &header() const { return m_header; }
+
+    //The agent whose notifications are replayed. It's the first seat's by default.
+    //Changing it takes effect after open() or seekToRound().
+    void setViewer(uint agentId);
+    uint viewer() const { return m_viewer; }
+
+    void setSpeed(qreal speed);
+    qreal speed() const { return m_speed; }
+
+    bool isPlaying() const { return m_timer.isActive(); }
+
+    //Milliseconds since the game started
+    uint position() const { return m_position; }
+
+    //It's 0 if the replay doesn't record turns and can't be sought.
+    int roundNum() const { return m_turns.isEmpty() ? 0 : m_turns.last().round; }
+    bool seekToRound(int round);
+
+public slots:
+    void play();
+    void pause();
+
+signals:
+    void finished();
+
+private slots:
+    void replayNextFrame();
+
+private:
+    struct Turn
+    {
+        int round;
+        uint playerId;
+        int offset;
+    };
+
+    struct Keyframe
+    {
+        int round;
+        int offset;         //offset of the keyframe in the file, -1 if it's only kept in memory
+        int resumeOffset;   //offset of the first frame after the keyframe
+        QVariant state;
+    };
+
+    bool map();
+    void loadIndex();
+    void buildKeyframes();
+    void saveKeyframes();
+    void rewind();
+
+    bool readNextFrame();
+    void replayFrame(const ReplayFrame &frame);
+    bool isVisible(const ReplayFrame &frame) const;
+    void scheduleNextFrame();
+
+    Client *m_client;
+    QFile m_file;
+    QByteArray m_data;
+    int m_firstFrameOffset;
+    int m_endOffset;
+    int m_offset;
+
+    ReplayHeader m_header;
+    ReplayFrame m_nextFrame;
+    bool m_hasNextFrame;
+    uint m_viewer;
+    uint m_position;
+    qreal m_speed;
+    QTimer m_timer;
+
+    QList<Turn> m_turns;
+    QMap<uint, QList<Keyframe>> m_keyframes;
+};
+
+#endif // REPLAYER_H
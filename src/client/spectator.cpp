@@ -0,0 +1,73 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+#include "client.h"
+#include "spectator.h"
+
+#include <QTcpSocket>
+
+Spectator::Spectator(Client *client, QObject *parent)
+    : QObject(parent)
+    , m_client(client)
+    , m_socket(new QTcpSocket(this))
+    , m_hasHeader(false)
+{
+    connect(m_socket, &QTcpSocket::connected, [this](){
+        m_socket->write(QByteArray::number(m_header.roomId) + '\n');
+    });
+    connect(m_socket, &QTcpSocket::readyRead, this, &Spectator::onReadyRead);
+    connect(m_socket, &QTcpSocket::disconnected, this, &Spectator::finished);
+}
+
+void Spectator::watch(const QHostAddress &host, ushort port, uint roomId)
+{
+    m_socket->abort();
+    m_buffer.clear();
+    m_hasHeader = false;
+    m_header = ReplayHeader();
+    m_header.roomId = roomId;
+    m_socket->connectToHost(host, port);
+}
+
+void Spectator::onReadyRead()
+{
+    m_buffer.append(m_socket->readAll());
+
+    //Frames may arrive in pieces. A frame that can't be read yet is left in the buffer.
+    int offset = 0;
+    if (!m_hasHeader) {
+        if (!ReplayFile::Read(m_buffer, offset, m_header))
+            return;
+        m_hasHeader = true;
+    }
+
+    forever {
+        ReplayFrame frame;
+        if (!ReplayFile::Read(m_buffer, offset, frame))
+            break;
+
+        if (frame.type == ReplayFrame::Keyframe) {
+            m_client->startReplay();
+            m_client->restoreState(frame.data);
+        } else if (frame.type == ReplayFrame::Broadcast) {
+            m_client->replayNotification(frame.command, frame.data);
+        }
+    }
+    m_buffer.remove(0, offset);
+}
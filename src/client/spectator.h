@@ -0,0 +1,59 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+#ifndef SPECTATOR_H
+#define SPECTATOR_H
+
+#include "replayfile.h"
+
+#include <QHostAddress>
+#include <QObject>
+
+class Client;
+class QTcpSocket;
+
+/* Watches a room through the spectator port of a server. The stream is in the format of a
+ * replay file: its keyframe is restored into Client, and the public notifications after it
+ * are fed into the callbacks of Client as they arrive.
+ */
+class Spectator : public QObject
+{
+    Q_OBJECT
+
+public:
+    Spectator(Client *client, QObject *parent = nullptr);
+
+    void watch(const QHostAddress &host, ushort port, uint roomId);
+    const ReplayHeader &header() const { return m_header; }
+
+signals:
+    //The server has closed the stream, because the room is gone or the spectator fell behind
+    void finished();
+
+private:
+    void onReadyRead();
+
+    Client *m_client;
+    QTcpSocket *m_socket;
+    QByteArray m_buffer;
+    bool m_hasHeader;
+    ReplayHeader m_header;
+};
+
+#endif // SPECTATOR_H
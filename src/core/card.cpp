@@ -151,6 +151,7 @@ QString Card::typeString() const
 
 void Card::addSubcard(Card *card)
 {
+    UndoJournal::Save(m_subcards);
     m_subcards << card;
 }
 
@@ -317,6 +318,8 @@ void Card::use(GameLogic *logic, CardUseStruct &use)
         CardEffectStruct effect(use);
         effect.to = target;
         logic->takeCardEffect(effect);
+        if (logic->isInterrupted())
+            return;
     }
 
     if (use.target) {
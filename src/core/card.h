@@ -28,6 +28,7 @@ class GameLogic;
 class Player;
 
 #include "structs.h"
+#include "undojournal.h"
 
 class Card : public QObject
 {
@@ -86,26 +87,26 @@ public:
     bool isVirtual() const { return id() == 0; }
     uint effectiveId() const;
 
-    void setSuit(Suit suit) { m_suit = suit; }
+    void setSuit(Suit suit) { UndoJournal::Save(m_suit); m_suit = suit; }
     Suit suit() const;
     void setSuitString(const QString &suit);
     QString suitString() const;
 
-    void setNumber(int number) { m_number = number; }
+    void setNumber(int number) { UndoJournal::Save(m_number); m_number = number; }
     int number() const;
 
-    void setColor(Color color) { m_color = color; }
+    void setColor(Color color) { UndoJournal::Save(m_color); m_color = color; }
     Color color() const;
     void setColorString(const QString &color);
     QString colorString() const;
 
-    void setType(Type type) { m_type = type; }
+    void setType(Type type) { UndoJournal::Save(m_type); m_type = type; }
     Type type() const { return m_type; }
     int subtype() const { return m_subtype; }
     QString typeString() const;
 
     void addSubcard(Card *card);
-    void setSubcards(const QList<Card *> &cards) { m_subcards = cards; }
+    void setSubcards(const QList<Card *> &cards) { UndoJournal::Save(m_subcards); m_subcards = cards; }
     QList<Card *> subcards() const { return m_subcards; }
 
     Card *realCard();
@@ -113,15 +114,16 @@ public:
     QList<Card *> realCards();
     QList<const Card *> realCards() const;
 
-    void setSkill(const Skill *skill) { m_skill = skill; }
+    void setSkill(const Skill *skill) { UndoJournal::Save(m_skill); m_skill = skill; }
     const Skill *skill() const { return m_skill; }
 
-    void addFlag(const QString &flag) { m_flags.insert(flag); }
-    void removeFlag(const QString &flag) { m_flags.remove(flag); }
+    //Cards are changed by rollouts too, so the state of a game is journaled here as well
+    void addFlag(const QString &flag) { UndoJournal::Save(m_flags); m_flags.insert(flag); }
+    void removeFlag(const QString &flag) { UndoJournal::Save(m_flags); m_flags.remove(flag); }
     bool hasFlag(const QString &flag) const { return m_flags.contains(flag); }
-    void clearFlags() { m_flags.clear(); }
+    void clearFlags() { UndoJournal::Save(m_flags); m_flags.clear(); }
 
-    void setTransferable(bool transferable) { m_transferable = transferable; }
+    void setTransferable(bool transferable) { UndoJournal::Save(m_transferable); m_transferable = transferable; }
     bool isTransferable() const { return m_transferable; }
 
     bool canRecast() const { return m_canRecast; }
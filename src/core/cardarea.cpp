@@ -19,12 +19,14 @@
 
 #include "card.h"
 #include "cardarea.h"
+#include "undojournal.h"
 
 CardArea::CardArea(CardArea::Type type, Player *owner, const QString &name)
     : m_type(type)
     , m_owner(owner)
     , m_name(name)
     , m_keepVirtualCard(false)
+    , m_journalGeneration(0)
 {
 }
 
@@ -37,6 +39,7 @@ bool CardArea::add(Card *card, Direction direction) {
             return false;
         }
     }
+    journal();
     if (direction == Top)
         m_cards.prepend(card);
     else
@@ -48,6 +51,7 @@ bool CardArea::add(Card *card, Direction direction) {
 
 bool CardArea::add(const QList<Card *> &cards, Direction direction)
 {
+    journal();
     int num = length();
     if (direction == Top) {
         for (int i = 0; i < cards.length(); i++) {
@@ -84,6 +88,7 @@ bool CardArea::add(const QList<Card *> &cards, Direction direction)
 
 bool CardArea::remove(Card *card)
 {
+    journal();
     if (m_cards.removeOne(card)) {
         if (m_changeSignal)
             m_changeSignal();
@@ -95,6 +100,7 @@ bool CardArea::remove(Card *card)
 
 bool CardArea::remove(const QList<Card *> &cards)
 {
+    journal();
     int num = length();
     foreach (Card *card, cards)
         m_cards.removeOne(card);
@@ -125,6 +131,7 @@ Card *CardArea::rand() const
 
 QList<Card *> CardArea::takeFirst(int n)
 {
+    journal();
     QList<Card *> cards = m_cards.mid(0, n);
     m_cards = m_cards.mid(n + 1);
     return cards;
@@ -132,6 +139,7 @@ QList<Card *> CardArea::takeFirst(int n)
 
 QList<Card *> CardArea::takeLast(int n)
 {
+    journal();
     QList<Card *> cards = m_cards.mid(length() - n);
     m_cards = m_cards.mid(0, length() - n);
     return cards;
@@ -161,6 +169,24 @@ bool CardArea::contains(const char *className) const
     return m_virtualCards.contains(className);
 }
 
+void CardArea::journal()
+{
+    UndoJournal *journal = UndoJournal::Current();
+    if (journal == nullptr || journal->depth() <= 0 || journal->generation() == m_journalGeneration)
+        return;
+    m_journalGeneration = journal->generation();
+
+    //Both lists are implicitly shared, so it only costs a copy when they're changed
+    QList<Card *> cards = m_cards;
+    QStringList virtualCards = m_virtualCards;
+    journal->record([this, cards, virtualCards](){
+        m_cards = cards;
+        m_virtualCards = virtualCards;
+        if (m_changeSignal)
+            m_changeSignal();
+    });
+}
+
 QVariant CardArea::toVariant() const
 {
     QVariantMap data;
@@ -62,16 +62,16 @@ public:
     bool add(const QList<Card *> &cards, Direction direction = UndefinedDirection);
     bool remove(Card *card);
     bool remove(const QList<Card *> &cards);
-    void clear() { m_cards.clear(); }
+    void clear() { journal(); m_cards.clear(); }
 
     Card *findCard(uint id) const;
     Card *rand() const;
 
     Card *first() const { return m_cards.first(); }
-    Card *takeFirst() { return m_cards.takeFirst(); }
+    Card *takeFirst() { journal(); return m_cards.takeFirst(); }
 
     Card *last() const { return m_cards.last(); }
-    Card *takeLast() { return m_cards.takeLast(); }
+    Card *takeLast() { journal(); return m_cards.takeLast(); }
 
     QList<Card *> first(int n) const { return m_cards.mid(0, n); }
     QList<Card *> takeFirst(int n);
@@ -82,12 +82,13 @@ public:
     bool contains(const Card *card) const;
     bool contains(uint id) const;
 
-    void addVirtualCard(const QString &name) { m_virtualCards << name; }
-    void removeVirtualCard(const QString &name) { m_virtualCards.removeOne(name); }
+    void addVirtualCard(const QString &name) { journal(); m_virtualCards << name; }
+    void removeVirtualCard(const QString &name) { journal(); m_virtualCards.removeOne(name); }
     bool contains(const char *className) const;
+    QStringList virtualCards() const { return m_virtualCards; }
 
-    QList<Card *> &cards() { return m_cards; }
-    QList<Card *> cards() const { return m_cards; }
+    //Cards must be changed through the functions above so that the changes are journaled
+    const QList<Card *> &cards() const { return m_cards; }
 
     int length() const { return m_cards.length(); }
     int size() const { return m_cards.size(); }
@@ -95,6 +96,9 @@ public:
     QVariant toVariant() const;
 
 private:
+    //Saves the cards into the current UndoJournal before they're changed
+    void journal();
+
     Type m_type;
     Player *m_owner;
     QString m_name;
@@ -102,6 +106,7 @@ private:
     ChangeSignal m_changeSignal;
     bool m_keepVirtualCard;
     QStringList m_virtualCards;
+    uint m_journalGeneration;
 };
 
 #endif // CARDAREA_H
@@ -0,0 +1,149 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+
+#include "heapaccount.h"
+
+#include <QMutex>
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+thread_local HeapAccount *CurrentAccount = nullptr;
+
+QMutex FreeAccountMutex;
+HeapAccount *FreeAccounts = nullptr;
+
+}
+
+HeapAccount::HeapAccount()
+    : m_bytes(0)
+    , m_nextFree(nullptr)
+{
+}
+
+bool HeapAccount::IsEnabled()
+{
+#ifdef QSAN_HEAP_ACCOUNTING
+    return true;
+#else
+    return false;
+#endif
+}
+
+HeapAccount *HeapAccount::Acquire()
+{
+    QMutexLocker locker(&FreeAccountMutex);
+    if (FreeAccounts == nullptr)
+        return new HeapAccount;
+
+    HeapAccount *account = FreeAccounts;
+    FreeAccounts = account->m_nextFree;
+    account->m_nextFree = nullptr;
+    account->m_bytes.store(0);
+    return account;
+}
+
+void HeapAccount::Release(HeapAccount *account)
+{
+    if (account == nullptr)
+        return;
+
+    QMutexLocker locker(&FreeAccountMutex);
+    account->m_nextFree = FreeAccounts;
+    FreeAccounts = account;
+}
+
+HeapAccount *HeapAccount::Current()
+{
+    return CurrentAccount;
+}
+
+void HeapAccount::SetCurrent(HeapAccount *account)
+{
+    CurrentAccount = account;
+}
+
+namespace {
+
+struct BlockHeader
+{
+    HeapAccount *account;
+    std::size_t size;
+};
+
+//It keeps the alignment malloc() gives
+const std::size_t HeaderSize = (sizeof(BlockHeader) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+
+}
+
+void *HeapAccount::Allocate(std::size_t size)
+{
+    void *block = std::malloc(size + HeaderSize);
+    if (block == nullptr)
+        return nullptr;
+
+    BlockHeader *header = static_cast<BlockHeader *>(block);
+    header->account = CurrentAccount;
+    header->size = size;
+    if (header->account)
+        header->account->allocate(size);
+    return static_cast<char *>(block) + HeaderSize;
+}
+
+void HeapAccount::Deallocate(void *pointer)
+{
+    if (pointer == nullptr)
+        return;
+
+    BlockHeader *header = reinterpret_cast<BlockHeader *>(static_cast<char *>(pointer) - HeaderSize);
+    if (header->account)
+        header->account->deallocate(header->size);
+    std::free(header);
+}
+
+#ifdef QSAN_HEAP_ACCOUNTING
+
+void *operator new(std::size_t size)
+{
+    void *pointer = HeapAccount::Allocate(size);
+    if (pointer == nullptr)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    return HeapAccount::Allocate(size);
+}
+
+void operator delete(void *pointer) noexcept
+{
+    HeapAccount::Deallocate(pointer);
+}
+
+void operator delete(void *pointer, const std::nothrow_t &) noexcept
+{
+    HeapAccount::Deallocate(pointer);
+}
+
+#endif
@@ -0,0 +1,69 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+
+#ifndef HEAPACCOUNT_H
+#define HEAPACCOUNT_H
+
+#include <QAtomicInteger>
+
+#include <cstddef>
+
+/* Bytes allocated with operator new by the threads charged to an account. A game thread charges
+ * its room, so the cards, players, structs and handlers it creates are counted until they're
+ * deleted, even by another thread. Rooms share one process, and this is the only way to tell
+ * which of them holds the memory. Qt containers, strings and variants allocate with malloc()
+ * and aren't counted, so it's a lower bound of what a room holds.
+ *
+ * Counting needs QSAN_HEAP_ACCOUNTING to be defined, which the dedicated server does with
+ * CONFIG+=heap_accounting. It replaces the global operator new and delete with Allocate() and
+ * Deallocate(), which keep the account and size in a header in front of each block. That costs
+ * a header and two relaxed atomic adds per block, which the heapAccount benchmark measures.
+ * Accounts are pooled instead of deleted, as blocks may outlive them.
+ */
+class HeapAccount
+{
+public:
+    static bool IsEnabled();
+
+    static HeapAccount *Acquire();
+    static void Release(HeapAccount *account);
+
+    //The account charged by the calling thread, which is null by default
+    static HeapAccount *Current();
+    static void SetCurrent(HeapAccount *account);
+
+    //Blocks of a previous user of the account may make it slightly off
+    qint64 bytes() const { return qMax<qint64>(0, m_bytes.load()); }
+
+    void allocate(qint64 bytes) { m_bytes.fetchAndAddRelaxed(bytes); }
+    void deallocate(qint64 bytes) { m_bytes.fetchAndSubRelaxed(bytes); }
+
+    //A block charged to the current account. It must be freed with Deallocate().
+    static void *Allocate(std::size_t size);
+    static void Deallocate(void *pointer);
+
+private:
+    HeapAccount();
+
+    QAtomicInteger<qint64> m_bytes;
+    HeapAccount *m_nextFree;
+};
+
+#endif // HEAPACCOUNT_H
@@ -0,0 +1,137 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+
+#include "payloadcompressor.h"
+#include "protocol.h"
+
+#include <QAtomicInteger>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+namespace {
+
+QAtomicInt CompressionLevel(0);
+QAtomicInt CompressionThreshold(1024);
+
+//Lock-free counters, indexed by command
+struct Counters
+{
+    QAtomicInteger<qint64> num[SANGUOSHA_COMMAND_COUNT];
+    QAtomicInteger<qint64> rawBytes[SANGUOSHA_COMMAND_COUNT];
+    QAtomicInteger<qint64> sentBytes[SANGUOSHA_COMMAND_COUNT];
+};
+
+Counters *Global()
+{
+    static Counters counters;
+    return &counters;
+}
+
+}
+
+int PayloadCompressor::Level()
+{
+    return CompressionLevel.load();
+}
+
+void PayloadCompressor::SetLevel(int level)
+{
+    CompressionLevel.store(qBound(0, level, 9));
+}
+
+int PayloadCompressor::Threshold()
+{
+    return CompressionThreshold.load();
+}
+
+void PayloadCompressor::SetThreshold(int bytes)
+{
+    CompressionThreshold.store(qMax(0, bytes));
+}
+
+QVariant PayloadCompressor::Compress(int command, const QVariant &data)
+{
+    int level = Level();
+    if (level <= 0 || command < 0 || command >= SANGUOSHA_COMMAND_COUNT)
+        return QVariant();
+
+    //It's wrapped in an array as the data may not be an object
+    QByteArray json = QJsonDocument(QJsonArray() << QJsonValue::fromVariant(data)).toJson(QJsonDocument::Compact);
+    if (json.size() < Threshold())
+        return QVariant();
+
+    QByteArray packed = qCompress(json, level).toBase64();
+    if (packed.size() >= json.size())
+        return QVariant();
+
+    Counters *counters = Global();
+    counters->num[command].fetchAndAddRelaxed(1);
+    counters->rawBytes[command].fetchAndAddRelaxed(json.size());
+    counters->sentBytes[command].fetchAndAddRelaxed(packed.size());
+
+    QVariantList result;
+    result << command;
+    result << QString::fromLatin1(packed);
+    return result;
+}
+
+bool PayloadCompressor::Decompress(const QVariant &packed, int *command, QVariant *data)
+{
+    QVariantList args = packed.toList();
+    if (args.length() != 2)
+        return false;
+
+    QByteArray json = qUncompress(QByteArray::fromBase64(args.at(1).toString().toLatin1()));
+    QJsonDocument document = QJsonDocument::fromJson(json);
+    if (!document.isArray() || document.array().isEmpty())
+        return false;
+
+    *command = args.at(0).toInt();
+    *data = document.array().first().toVariant();
+    return true;
+}
+
+QVariantMap PayloadCompressor::GlobalVariant()
+{
+    Counters *counters = Global();
+    QVariantMap result;
+    for (int command = 0; command < SANGUOSHA_COMMAND_COUNT; command++) {
+        qint64 num = counters->num[command].load();
+        if (num <= 0)
+            continue;
+
+        qint64 rawBytes = counters->rawBytes[command].load();
+        qint64 sentBytes = counters->sentBytes[command].load();
+        QVariantMap data;
+        data["count"] = num;
+        data["rawBytes"] = rawBytes;
+        data["sentBytes"] = sentBytes;
+        data["savedBytes"] = rawBytes - sentBytes;
+        data["ratio"] = rawBytes > 0 ? double(sentBytes) / rawBytes : 1.0;
+        result[QString::number(command)] = data;
+    }
+    return result;
+}
+
+QByteArray PayloadCompressor::Dump()
+{
+    return QJsonDocument(QJsonObject::fromVariantMap(GlobalVariant())).toJson();
+}
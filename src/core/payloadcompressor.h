@@ -0,0 +1,51 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+
+#ifndef PAYLOADCOMPRESSOR_H
+#define PAYLOADCOMPRESSOR_H
+
+#include <QVariant>
+
+/* Deflates large notifications into S_COMMAND_COMPRESSED, whose data is the original command
+ * and the base64 of the zlib-compressed JSON. Small payloads don't pay for it, so only those
+ * at least Threshold() bytes long are compressed, and only if that makes them shorter.
+ *
+ * The level and threshold are process-wide. Bytes before and after compression are counted
+ * by command, so that the bandwidth saved can be dumped.
+ */
+class PayloadCompressor
+{
+public:
+    //0 disables compression, and 1 to 9 are zlib levels
+    static int Level();
+    static void SetLevel(int level);
+
+    static int Threshold();
+    static void SetThreshold(int bytes);
+
+    //It returns the data of S_COMMAND_COMPRESSED, or a null variant if it's not worth it
+    static QVariant Compress(int command, const QVariant &data);
+    static bool Decompress(const QVariant &packed, int *command, QVariant *data);
+
+    static QVariantMap GlobalVariant();
+    static QByteArray Dump();
+};
+
+#endif // PAYLOADCOMPRESSOR_H
@@ -76,36 +76,42 @@ Player::~Player()
 
 void Player::setScreenName(const QString &name)
 {
+    UndoJournal::Save(m_screenName);
     m_screenName = name;
     emit screenNameChanged();
 }
 
 void Player::setHp(int hp)
 {
+    UndoJournal::Save(m_hp);
     m_hp = hp;
     emit hpChanged();
 }
 
 void Player::setMaxHp(int maxHp)
 {
+    UndoJournal::Save(m_maxHp);
     m_maxHp = maxHp;
     emit maxHpChanged();
 }
 
 void Player::setAlive(bool alive)
 {
+    UndoJournal::Save(m_alive);
     m_alive = alive;
     emit aliveChanged();
 }
 
 void Player::setRemoved(bool removed)
 {
+    UndoJournal::Save(m_removed);
     m_removed = removed;
     emit removedChanged();
 }
 
 void Player::setSeat(int seat)
 {
+    UndoJournal::Save(m_seat);
     m_seat = seat;
     emit seatChanged();
 }
@@ -139,12 +145,14 @@ Player *Player::nextAlive(int step, bool ignoreRemoved) const
 
 void Player::setPhase(Phase phase)
 {
+    UndoJournal::Save(m_phase);
     m_phase = phase;
     emit phaseChanged();
 }
 
 void Player::setPhaseString(const QString &phase)
 {
+    UndoJournal::Save(m_phase);
     if (phase == "round_start")
         m_phase = RoundStart;
     else if (phase == "start")
@@ -206,6 +214,7 @@ void Player::setHeadGeneralId(uint id)
 
 void Player::setHeadGeneral(const General *general)
 {
+    UndoJournal::Save(m_headGeneral);
     m_headGeneral = general;
     emit headGeneralChanged();
 }
@@ -230,12 +239,14 @@ void Player::setDeputyGeneralId(uint id)
 
 void Player::setDeputyGeneral(const General *general)
 {
+    UndoJournal::Save(m_deputyGeneral);
     m_deputyGeneral = general;
     emit deputyGeneralChanged();
 }
 
 void Player::setFaceUp(bool faceUp)
 {
+    UndoJournal::Save(m_faceUp);
     m_faceUp = faceUp;
     emit faceUpChanged();
 }
@@ -286,6 +297,7 @@ int Player::distanceTo(const Player *other) const
 
 void Player::addCardHistory(const QString &name, int times)
 {
+    UndoJournal::Save(m_cardHistory);
     if (m_cardHistory.contains(name))
         m_cardHistory[name] += times;
     else
@@ -294,24 +306,28 @@ void Player::addCardHistory(const QString &name, int times)
 
 void Player::setDrunk(bool drunk)
 {
+    UndoJournal::Save(m_drunk);
     m_drunk = drunk;
     emit drunkChanged();
 }
 
 void Player::setKingdom(const QString &kingdom)
 {
+    UndoJournal::Save(m_kingdom);
     m_kingdom = kingdom;
     emit kingdomChanged();
 }
 
 void Player::setRole(const QString &role)
 {
+    UndoJournal::Save(m_role);
     m_role = role;
     emit roleChanged();
 }
 
 void Player::setAttackRange(int range)
 {
+    UndoJournal::Save(m_attackRange);
     m_attackRange = range;
     emit attackRangeChanged();
 }
@@ -323,12 +339,14 @@ bool Player::inAttackRangeOf(const Player *attacker) const
 
 void Player::setChained(bool chained)
 {
+    UndoJournal::Save(m_chained);
     m_chained = chained;
     emit chainedChanged();
 }
 
 void Player::setDying(bool dying)
 {
+    UndoJournal::Save(m_dying);
     m_dying = dying;
     emit dyingChanged();
 }
@@ -421,18 +439,19 @@ void Player::addSkill(const Skill *skill, SkillArea type)
 void Player::removeSkill(const Skill *skill, SkillArea type)
 {
     if (type == UnknownSkillArea) {
-        if (m_acquiredSkills.removeOne(skill))
-            return;
-        if (m_headSkills.removeOne(skill))
-            return;
-        m_deputySkills.removeOne(skill);
+        if (m_acquiredSkills.contains(skill))
+            removeAcquiredSkill(skill);
+        else if (m_headSkills.contains(skill))
+            removeHeadSkill(skill);
+        else
+            removeDeputySkill(skill);
         return;
     }
 
     if (type == HeadSkillArea)
-        m_headSkills.removeOne(skill);
+        removeHeadSkill(skill);
     else if (type == DeputySkillArea)
-        m_deputySkills.removeOne(skill);
+        removeDeputySkill(skill);
     else
-        m_acquiredSkills.removeOne(skill);
+        removeAcquiredSkill(skill);
 }
@@ -20,6 +20,8 @@
 #ifndef PLAYER_H
 #define PLAYER_H
 
+#include "undojournal.h"
+
 class Card;
 class CardArea;
 class EventHandler;
@@ -110,7 +112,7 @@ public:
     void setSeat(int seat);
     int seat() const { return m_seat; }
 
-    void setNext(Player *next) { m_next = next; }
+    void setNext(Player *next) { UndoJournal::Save(m_next); m_next = next; }
     Player *next() const { return m_next; }
     Player *next(bool ignoreRemoved) const;
     Player *nextAlive(int step = 1, bool ignoreRemoved = true) const;
@@ -121,7 +123,7 @@ public:
     QString phaseString() const;
 
     int turnCount() const { return m_turnCount; }
-    void setTurnCount(int count) { m_turnCount = count; }
+    void setTurnCount(int count) { UndoJournal::Save(m_turnCount); m_turnCount = count; }
 
     bool faceUp() const { return m_faceUp; }
     void setFaceUp(bool faceUp);
@@ -165,29 +167,30 @@ public:
     void setDeputyGeneralId(uint id);
 
     bool hasShownHeadGeneral() const { return m_headGeneralShown; }
-    void setHeadGeneralShown(bool shown) { m_headGeneralShown = shown; }
+    void setHeadGeneralShown(bool shown) { UndoJournal::Save(m_headGeneralShown); m_headGeneralShown = shown; }
 
     bool hasShownDeputyGeneral() const { return m_deputyGeneralShown; }
-    void setDeputyGeneralShown(bool shown) { m_deputyGeneralShown = shown; }
+    void setDeputyGeneralShown(bool shown) { UndoJournal::Save(m_deputyGeneralShown); m_deputyGeneralShown = shown; }
 
     bool hasShownGeneral() const { return hasShownHeadGeneral() || hasShownDeputyGeneral(); }
     bool hasShownBothGenerals() const { return hasShownHeadGeneral() && hasShownDeputyGeneral(); }
 
     int cardHistory(const QString &name) const { return m_cardHistory.value(name); }
+    QHash<QString, int> cardHistory() const { return m_cardHistory; }
     void addCardHistory(const QString &name, int times = 1);
-    void clearCardHistory() { m_cardHistory.clear(); }
+    void clearCardHistory() { UndoJournal::Save(m_cardHistory); m_cardHistory.clear(); }
 
     int distanceTo(const Player *other) const;
-    void setFixedDistance(const Player *other, int distance) { m_fixedDistance[other] = distance; }
-    void unsetFixedDistance(const Player *other) { m_fixedDistance.remove(other); }
+    void setFixedDistance(const Player *other, int distance) { UndoJournal::Save(m_fixedDistance); m_fixedDistance[other] = distance; }
+    void unsetFixedDistance(const Player *other) { UndoJournal::Save(m_fixedDistance); m_fixedDistance.remove(other); }
 
     //Extra distance from you to other players
     int extraOutDistance() const { return m_extraOutDistance; }
-    void setExtraOutDistance(int extra) { m_extraOutDistance = extra; }
+    void setExtraOutDistance(int extra) { UndoJournal::Save(m_extraOutDistance); m_extraOutDistance = extra; }
 
     //Extra distance from other players to you
     int extraInDistance() const { return m_extraInDistance; }
-    void setExtraInDistance(int extra) { m_extraInDistance = extra; }
+    void setExtraInDistance(int extra) { UndoJournal::Save(m_extraInDistance); m_extraInDistance = extra; }
 
     CardArea *handcardArea() { return m_handcardArea; }
     const CardArea *handcardArea() const { return m_handcardArea; }
@@ -224,21 +227,21 @@ public:
     QList<const Skill *> acquiredSkills() const { return m_acquiredSkills; }
 
     QMap<const Skill *, int> skillHistory() const { return m_skillHistory; }
-    void clearSkillHistory() { m_skillHistory.clear(); }
-    void addSkillHistory(const Skill *skill) { m_skillHistory[skill]++; }
+    void clearSkillHistory() { UndoJournal::Save(m_skillHistory); m_skillHistory.clear(); }
+    void addSkillHistory(const Skill *skill) { UndoJournal::Save(m_skillHistory); m_skillHistory[skill]++; }
     int skillHistory(const Skill *skill) const { return m_skillHistory.value(skill); }
 
     QMap<QString, QVariant> tag;
 
 protected:
-    void addHeadSkill(const Skill *skill) { m_headSkills << skill; }
-    void removeHeadSkill(const Skill *skill) { m_headSkills.removeOne(skill); }
+    void addHeadSkill(const Skill *skill) { UndoJournal::Save(m_headSkills); m_headSkills << skill; }
+    void removeHeadSkill(const Skill *skill) { UndoJournal::Save(m_headSkills); m_headSkills.removeOne(skill); }
 
-    void addDeputySkill(const Skill *skill) { m_deputySkills << skill; }
-    void removeDeputySkill(const Skill *skill) { m_deputySkills.removeOne(skill); }
+    void addDeputySkill(const Skill *skill) { UndoJournal::Save(m_deputySkills); m_deputySkills << skill; }
+    void removeDeputySkill(const Skill *skill) { UndoJournal::Save(m_deputySkills); m_deputySkills.removeOne(skill); }
 
-    void addAcquiredSkill(const Skill *skill) { m_acquiredSkills << skill; }
-    void removeAcquiredSkill(const Skill *skill) { m_acquiredSkills.removeOne(skill); }
+    void addAcquiredSkill(const Skill *skill) { UndoJournal::Save(m_acquiredSkills); m_acquiredSkills << skill; }
+    void removeAcquiredSkill(const Skill *skill) { UndoJournal::Save(m_acquiredSkills); m_acquiredSkills.removeOne(skill); }
 
 signals:
     void screenNameChanged();
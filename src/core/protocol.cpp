@@ -50,5 +50,9 @@ static void registerSanguoshaCommand()
     C_REGISTER_COMMAND(ASK_FOR_OPTION);
     C_REGISTER_COMMAND(SET_VIRTUAL_CARD);
     C_REGISTER_COMMAND(SET_PLAYER_TAG);
+    C_REGISTER_COMMAND(RESYNC);
+    C_REGISTER_COMMAND(BATCH);
+    C_REGISTER_COMMAND(COMPRESSED);
+    C_REGISTER_COMMAND(MIGRATE);
 }
 Q_COREAPP_STARTUP_FUNCTION(registerSanguoshaCommand)
@@ -57,6 +57,10 @@ enum SanguoshaCommand
     S_COMMAND_SET_PLAYER_TAG,
     S_COMMAND_GAME_OVER,
     S_COMMAND_ACT,
+    S_COMMAND_RESYNC,
+    S_COMMAND_BATCH,
+    S_COMMAND_COMPRESSED,
+    S_COMMAND_MIGRATE,
 
     SANGUOSHA_COMMAND_COUNT
 };
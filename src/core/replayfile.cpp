@@ -0,0 +1,177 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+
+#include "replayfile.h"
+
+#include <QDataStream>
+#include <QIODevice>
+#include <QtEndian>
+
+#include <cstring>
+
+namespace {
+
+const int StreamVersion = QDataStream::Qt_5_4;
+
+QByteArray LengthPrefixed(const QByteArray &block)
+{
+    QByteArray result;
+    result.reserve(block.size() + 4);
+    QDataStream stream(&result, QIODevice::WriteOnly);
+    stream << (quint32) block.size();
+    result.append(block);
+    return result;
+}
+
+bool ReadBlock(const QByteArray &data, int &offset, QByteArray &block)
+{
+    if (offset < 0 || offset + 4 > data.size())
+        return false;
+
+    quint32 length = qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(data.constData() + offset));
+    if (length > quint32(data.size() - offset - 4))
+        return false;
+
+    //The block shares the memory of data, no bytes are copied
+    block = QByteArray::fromRawData(data.constData() + offset + 4, length);
+    offset += 4 + length;
+    return true;
+}
+
+}
+
+const char ReplayFile::Magic[9] = "QSGSRPL\n";
+const quint32 ReplayFile::Version = 1;
+
+ReplayHeader::ReplayHeader()
+    : roomId(0)
+    , seed(0)
+    , startTime(0)
+{
+}
+
+ReplayFrame::ReplayFrame()
+    : type(Notification)
+    , timestamp(0)
+    , agentId(0)
+    , command(0)
+{
+}
+
+QByteArray ReplayFile::Serialize(const ReplayHeader &header)
+{
+    QByteArray block;
+    QDataStream stream(&block, QIODevice::WriteOnly);
+    stream.setVersion(StreamVersion);
+    stream << (quint32) header.roomId << (quint32) header.seed << header.startTime << header.mode << header.packages;
+
+    QByteArray result;
+    QDataStream prefix(&result, QIODevice::WriteOnly);
+    prefix.writeRawData(Magic, 8);
+    prefix << Version;
+    result.append(LengthPrefixed(block));
+    return result;
+}
+
+QByteArray ReplayFile::Serialize(const ReplayFrame &frame)
+{
+    QByteArray block;
+    QDataStream stream(&block, QIODevice::WriteOnly);
+    stream.setVersion(StreamVersion);
+    stream << (quint8) frame.type << (quint32) frame.timestamp << (quint32) frame.agentId << (qint32) frame.command << frame.data;
+    return LengthPrefixed(block);
+}
+
+bool ReplayFile::Read(const QByteArray &data, int &offset, ReplayHeader &header)
+{
+    if (offset + 12 > data.size() || memcmp(data.constData() + offset, Magic, 8) != 0)
+        return false;
+
+    QDataStream versionStream(QByteArray::fromRawData(data.constData() + offset + 8, 4));
+    quint32 version;
+    versionStream >> version;
+    if (version != Version)
+        return false;
+
+    int blockOffset = offset + 12;
+    QByteArray block;
+    if (!ReadBlock(data, blockOffset, block))
+        return false;
+
+    QDataStream stream(block);
+    stream.setVersion(StreamVersion);
+    quint32 roomId, seed;
+    stream >> roomId >> seed >> header.startTime >> header.mode >> header.packages;
+    if (stream.status() != QDataStream::Ok)
+        return false;
+
+    header.roomId = roomId;
+    header.seed = seed;
+    offset = blockOffset;
+    return true;
+}
+
+bool ReplayFile::Read(const QByteArray &data, int &offset, ReplayFrame &frame)
+{
+    int frameOffset = offset;
+    QByteArray block;
+    if (!ReadBlock(data, frameOffset, block))
+        return false;
+
+    QDataStream stream(block);
+    stream.setVersion(StreamVersion);
+    quint8 type;
+    quint32 timestamp, agentId;
+    qint32 command;
+    stream >> type >> timestamp >> agentId >> command >> frame.data;
+    if (stream.status() != QDataStream::Ok)
+        return false;
+
+    frame.type = static_cast<ReplayFrame::Type>(type);
+    frame.timestamp = timestamp;
+    frame.agentId = agentId;
+    frame.command = command;
+    offset = frameOffset;
+    return true;
+}
+
+bool ReplayFile::Skip(const QByteArray &data, int &offset, ReplayFrame::Type &type)
+{
+    int frameOffset = offset;
+    QByteArray block;
+    if (!ReadBlock(data, frameOffset, block) || block.isEmpty())
+        return false;
+
+    type = static_cast<ReplayFrame::Type>(quint8(block.at(0)));
+    offset = frameOffset;
+    return true;
+}
+
+int ReplayFile::IndexOffsetSize()
+{
+    static int size = 0;
+    if (size == 0) {
+        ReplayFrame frame;
+        frame.type = ReplayFrame::IndexOffset;
+        frame.data = qint64(0);
+        size = Serialize(frame).size();
+    }
+    return size;
+}
@@ -0,0 +1,87 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+
+#ifndef REPLAYFILE_H
+#define REPLAYFILE_H
+
+#include <QStringList>
+#include <QVariant>
+
+struct ReplayHeader
+{
+    ReplayHeader();
+
+    uint roomId;
+    uint seed;
+    qint64 startTime;
+    QString mode;
+    QStringList packages;
+};
+
+struct ReplayFrame
+{
+    enum Type
+    {
+        Notification,   //sent to agentId
+        Broadcast,      //sent to everyone except agentId (0 if nobody is excluded)
+        Request,        //sent to agentId
+        Reply,          //received from agentId, null if it timed out
+        Turn,           //a turn starts, command is the round and data is the player id
+        Keyframe,       //data is the client state of agentId, appended by Replayer
+        Index,          //turn and keyframe offsets, appended by Replayer
+        IndexOffset     //the last frame, data is the offset of the latest index frame
+    };
+
+    ReplayFrame();
+
+    Type type;
+    uint timestamp; //milliseconds since the game started
+    uint agentId;
+    int command;
+    QVariant data;
+};
+
+/* A replay is an append-only binary file:
+ * 8-byte magic, quint32 version, then the header and the frames,
+ * each one prefixed with its length as a quint32.
+ * A truncated frame at the end (a crashed server) is treated as the end of file.
+ *
+ * Replays are read from memory-mapped files, so frames are parsed from a byte array
+ * at a given offset, which is moved to the next frame.
+ */
+class ReplayFile
+{
+public:
+    static const char Magic[9];
+    static const quint32 Version;
+
+    static QByteArray Serialize(const ReplayHeader &header);
+    static QByteArray Serialize(const ReplayFrame &frame);
+
+    static bool Read(const QByteArray &data, int &offset, ReplayHeader &header);
+    static bool Read(const QByteArray &data, int &offset, ReplayFrame &frame);
+    //Moves to the next frame without parsing its payload
+    static bool Skip(const QByteArray &data, int &offset, ReplayFrame::Type &type);
+
+    //The size of a serialized IndexOffset frame, which is always the same
+    static int IndexOffsetSize();
+};
+
+#endif // REPLAYFILE_H
@@ -0,0 +1,200 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+
+#include "timerwheel.h"
+
+#include <QThread>
+
+namespace {
+
+class Ticker : public QThread
+{
+public:
+    Ticker(TimerWheel *wheel)
+        : m_wheel(wheel)
+    {
+        setObjectName("TimerWheel");
+        start();
+    }
+
+    ~Ticker()
+    {
+        requestInterruption();
+        wait();
+    }
+
+protected:
+    void run() override
+    {
+        while (!isInterruptionRequested()) {
+            msleep(m_wheel->resolution());
+            m_wheel->advance();
+        }
+    }
+
+private:
+    TimerWheel *m_wheel;
+};
+
+}
+
+TimerWheel::TimerWheel(int resolution)
+    : m_resolution(qMax(1, resolution))
+    , m_currentTick(0)
+    , m_pendingNum(0)
+{
+    for (int &head : m_slots)
+        head = -1;
+    m_clock.start();
+}
+
+TimerWheel *TimerWheel::Global()
+{
+    static TimerWheel wheel;
+    //Destroyed before the wheel, which stops the thread
+    static Ticker ticker(&wheel);
+    return &wheel;
+}
+
+TimerWheel::Handle TimerWheel::schedule(int msecs, const Callback &callback)
+{
+    QMutexLocker locker(&m_mutex);
+
+    int index;
+    if (m_freeTimers.isEmpty()) {
+        index = m_timers.length();
+        m_timers.append(Timer());
+        m_timers[index].generation = 0;
+    } else {
+        index = m_freeTimers.takeLast();
+    }
+
+    Timer &timer = m_timers[index];
+    qint64 ticks = qMax<qint64>(1, (msecs + m_resolution - 1) / m_resolution);
+    //A deadline beyond the outermost wheel is clamped to its range
+    const qint64 maxTicks = (Q_INT64_C(1) << (SlotBits * Levels)) - 1;
+    timer.expiry = m_currentTick + qMin(ticks, maxTicks);
+    timer.callback = callback;
+    link(index);
+    m_pendingNum++;
+
+    return (Handle(timer.generation) << 32) | uint(index);
+}
+
+bool TimerWheel::cancel(Handle handle)
+{
+    QMutexLocker locker(&m_mutex);
+
+    int index = int(handle & 0xFFFFFFFFu);
+    uint generation = uint(handle >> 32);
+    if (index >= m_timers.length())
+        return false;
+
+    Timer &timer = m_timers[index];
+    if (timer.generation != generation || timer.slot < 0)
+        return false;
+
+    unlink(index);
+    timer.callback = nullptr;
+    timer.generation++;
+    m_freeTimers.append(index);
+    m_pendingNum--;
+    return true;
+}
+
+int TimerWheel::advance()
+{
+    QMutexLocker locker(&m_mutex);
+
+    qint64 now = m_clock.elapsed() / m_resolution;
+    int firedNum = 0;
+    while (m_currentTick < now) {
+        m_currentTick++;
+
+        //Move timers down from the coarser wheels that have just turned one slot
+        int level = 1;
+        while (level < Levels && (m_currentTick & ((Q_INT64_C(1) << (SlotBits * level)) - 1)) == 0)
+            level++;
+        for (level--; level >= 1; level--)
+            cascade(level);
+
+        int &head = m_slots[m_currentTick & (SlotNum - 1)];
+        while (head >= 0) {
+            int index = head;
+            unlink(index);
+            Timer &timer = m_timers[index];
+            Callback callback = timer.callback;
+            timer.callback = nullptr;
+            timer.generation++;
+            m_freeTimers.append(index);
+            m_pendingNum--;
+            firedNum++;
+            callback();
+        }
+    }
+    return firedNum;
+}
+
+int TimerWheel::pendingNum() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_pendingNum;
+}
+
+void TimerWheel::link(int index)
+{
+    Timer &timer = m_timers[index];
+    qint64 delta = timer.expiry - m_currentTick;
+    int level = 0;
+    while (level < Levels - 1 && delta >= (Q_INT64_C(1) << (SlotBits * (level + 1))))
+        level++;
+
+    timer.slot = level * SlotNum + int((timer.expiry >> (SlotBits * level)) & (SlotNum - 1));
+    int &head = m_slots[timer.slot];
+    timer.prev = -1;
+    timer.next = head;
+    if (head >= 0)
+        m_timers[head].prev = index;
+    head = index;
+}
+
+void TimerWheel::unlink(int index)
+{
+    Timer &timer = m_timers[index];
+    if (timer.prev >= 0)
+        m_timers[timer.prev].next = timer.next;
+    else
+        m_slots[timer.slot] = timer.next;
+    if (timer.next >= 0)
+        m_timers[timer.next].prev = timer.prev;
+    timer.slot = -1;
+}
+
+void TimerWheel::cascade(int level)
+{
+    int &head = m_slots[level * SlotNum + int((m_currentTick >> (SlotBits * level)) & (SlotNum - 1))];
+    int index = head;
+    head = -1;
+    while (index >= 0) {
+        int next = m_timers[index].next;
+        link(index);
+        index = next;
+    }
+}
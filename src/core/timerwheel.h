@@ -0,0 +1,96 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QVector>
+
+#include <functional>
+
+/* A hierarchical timing wheel holding many deadlines at once.
+ *
+ * There are Levels wheels of SlotNum slots. A timer is linked into the coarsest level that
+ * can hold it and moves down one level each time the finer wheel wraps, so scheduling and
+ * cancelling are O(1) and expired timers are fired in one batch per tick.
+ *
+ * Global() is shared by all the rooms of the process and is advanced by one thread, which
+ * replaces a timer per pending request with a single wakeup per tick. Callbacks run in that
+ * thread with the wheel locked: they must be short and must not schedule or cancel timers.
+ * Once cancel() returns, the callback has either finished or will never run.
+ */
+class TimerWheel
+{
+public:
+    typedef std::function<void()> Callback;
+    typedef quint64 Handle;
+
+    enum
+    {
+        Levels = 4,
+        SlotBits = 6,
+        SlotNum = 1 << SlotBits
+    };
+
+    //Deadlines are rounded up to a multiple of the resolution in milliseconds
+    TimerWheel(int resolution = 10);
+
+    static TimerWheel *Global();
+
+    int resolution() const { return m_resolution; }
+
+    Handle schedule(int msecs, const Callback &callback);
+
+    //It returns false if the timer has already fired or been cancelled
+    bool cancel(Handle handle);
+
+    //Fires every timer that has expired by now, and returns how many were fired
+    int advance();
+
+    int pendingNum() const;
+
+private:
+    struct Timer
+    {
+        qint64 expiry;
+        Callback callback;
+        int prev;
+        int next;
+        int slot;
+        uint generation;
+    };
+
+    void link(int index);
+    void unlink(int index);
+    void cascade(int level);
+
+    int m_resolution;
+    QElapsedTimer m_clock;
+    qint64 m_currentTick;
+    int m_pendingNum;
+    QVector<Timer> m_timers;
+    QVector<int> m_freeTimers;
+    int m_slots[Levels * SlotNum];
+    mutable QMutex m_mutex;
+};
+
+#endif // TIMERWHEEL_H
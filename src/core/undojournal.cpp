@@ -0,0 +1,88 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+
+#include "undojournal.h"
+
+#include <QAtomicInt>
+
+namespace {
+
+thread_local UndoJournal *CurrentJournal = nullptr;
+
+//Generations are unique among all the journals
+QAtomicInt LastGeneration;
+
+uint NextGeneration()
+{
+    return LastGeneration.fetchAndAddRelaxed(1) + 1;
+}
+
+}
+
+UndoJournal::UndoJournal()
+    : m_generation(NextGeneration())
+{
+    m_entries.reserve(256);
+}
+
+UndoJournal *UndoJournal::Current()
+{
+    return CurrentJournal;
+}
+
+void UndoJournal::SetCurrent(UndoJournal *journal)
+{
+    CurrentJournal = journal;
+}
+
+void UndoJournal::record(const Undo &undo)
+{
+    if (!m_checkpoints.isEmpty())
+        m_entries.append(undo);
+}
+
+void UndoJournal::checkpoint()
+{
+    m_checkpoints.append(m_entries.length());
+    m_generation = NextGeneration();
+}
+
+void UndoJournal::rollback()
+{
+    if (m_checkpoints.isEmpty())
+        return;
+
+    int mark = m_checkpoints.takeLast();
+    for (int i = m_entries.length() - 1; i >= mark; i--)
+        m_entries.at(i)();
+    m_entries.resize(mark);
+    m_generation = NextGeneration();
+}
+
+void UndoJournal::commit()
+{
+    if (m_checkpoints.isEmpty())
+        return;
+
+    m_checkpoints.removeLast();
+    if (m_checkpoints.isEmpty())
+        m_entries.clear();
+    m_generation = NextGeneration();
+}
@@ -0,0 +1,77 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+
+#ifndef UNDOJOURNAL_H
+#define UNDOJOURNAL_H
+
+#include <QVector>
+
+#include <functional>
+
+/* Records how to undo mutations of game objects, so that an action can be tried and
+ * rolled back much faster than taking a snapshot.
+ *
+ * A journal is made current for a thread by SetCurrent(). CardArea, Player and GameLogic
+ * then record the old values before they are changed, as long as there is a checkpoint.
+ * Checkpoints can be nested. rollback() undoes everything since the last checkpoint and
+ * commit() keeps the changes in the enclosing checkpoint.
+ */
+class UndoJournal
+{
+public:
+    typedef std::function<void()> Undo;
+
+    UndoJournal();
+
+    //The journal of the current thread, or null if nothing is being journaled
+    static UndoJournal *Current();
+    static void SetCurrent(UndoJournal *journal);
+
+    //Saves the current value of a field, which must live longer than the journal
+    template<typename T>
+    static void Save(T &field)
+    {
+        UndoJournal *journal = Current();
+        if (journal) {
+            T value = field;
+            journal->record([&field, value](){
+                field = value;
+            });
+        }
+    }
+
+    void record(const Undo &undo);
+
+    //It changes at every checkpoint, rollback and commit. An object only needs to save
+    //itself once per generation.
+    uint generation() const { return m_generation; }
+
+    void checkpoint();
+    void rollback();
+    void commit();
+    int depth() const { return m_checkpoints.length(); }
+
+private:
+    QVector<Undo> m_entries;
+    QVector<int> m_checkpoints;
+    uint m_generation;
+};
+
+#endif // UNDOJOURNAL_H
@@ -18,3 +18,50 @@
 *********************************************************************/
 
 #include "util.h"
+
+#include <QFile>
+
+#if defined(Q_OS_UNIX)
+#include <time.h>
+#elif defined(Q_OS_WIN)
+#include <windows.h>
+#endif
+
+qint64 qResidentMemory()
+{
+#ifdef Q_OS_LINUX
+    QFile file("/proc/self/status");
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return -1;
+
+    forever {
+        QByteArray line = file.readLine();
+        if (line.isEmpty())
+            break;
+        if (line.startsWith("VmRSS:")) {
+            //The value is in KiB
+            QList<QByteArray> fields = line.mid(6).simplified().split(' ');
+            return fields.first().toLongLong() * 1024;
+        }
+    }
+#endif
+    return -1;
+}
+
+qint64 qThreadCpuTime()
+{
+#if defined(Q_OS_UNIX) && defined(CLOCK_THREAD_CPUTIME_ID)
+    timespec time;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) == 0)
+        return qint64(time.tv_sec) * 1000000 + time.tv_nsec / 1000;
+#elif defined(Q_OS_WIN)
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if (GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime)) {
+        //The times are in units of 100 nanoseconds
+        quint64 kernel = (quint64(kernelTime.dwHighDateTime) << 32) | kernelTime.dwLowDateTime;
+        quint64 user = (quint64(userTime.dwHighDateTime) << 32) | userTime.dwLowDateTime;
+        return qint64((kernel + user) / 10);
+    }
+#endif
+    return -1;
+}
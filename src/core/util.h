@@ -60,5 +60,11 @@ QVariant qConvertToModel(const T *object)
     return QVariant::fromValue(objects);
 }
 
+//The resident memory of the process in bytes, or -1 if it's unknown on the platform
+qint64 qResidentMemory();
+
+//The CPU time used by the calling thread in microseconds, or -1 if it's unknown on the platform
+qint64 qThreadCpuTime();
+
 #endif // UTIL_H
 
@@ -0,0 +1,516 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+#include "ai.h"
+#include "belieftracker.h"
+#include "card.h"
+#include "cardarea.h"
+#include "cardpattern.h"
+#include "engine.h"
+#include "gamelogic.h"
+#include "general.h"
+#include "mctsai.h"
+#include "protocol.h"
+#include "serverplayer.h"
+#include "undojournal.h"
+
+#include <QAtomicInt>
+
+#include <algorithm>
+
+namespace {
+
+QAtomicInt Enabled(0);
+
+//The order in which cards are tried in the play phase
+int UsePriority(const Card *card)
+{
+    static const QHash<QString, int> priorities = {
+        {"ex_nihilo", 90},
+        {"amazing_grace", 85},
+        {"snatch", 80},
+        {"dismantlement", 75},
+        {"indulgence", 70},
+        {"supply_shortage", 70},
+        {"savage_assault", 65},
+        {"archery_attack", 65},
+        {"duel", 60},
+        {"fire_attack", 55},
+        {"god_salvation", 50},
+        {"peach", 40},
+        {"slash", 30},
+        {"fire_slash", 30},
+        {"thunder_slash", 30},
+        {"iron_chain", 10}
+    };
+
+    if (card->type() == Card::EquipType)
+        return 100;
+    return priorities.value(card->objectName(), 20);
+}
+
+QVariantMap CardReply(const Card *card, const QList<ServerPlayer *> &targets = QList<ServerPlayer *>())
+{
+    QVariantMap reply;
+    QVariantList cards;
+    if (card)
+        cards << card->id();
+    reply["cards"] = cards;
+
+    QVariantList to;
+    foreach (const ServerPlayer *target, targets)
+        to << target->id();
+    reply["to"] = to;
+
+    reply["skillId"] = 0;
+    return reply;
+}
+
+}
+
+Ai::Ai(ServerPlayer *self)
+    : m_self(self)
+    , m_logic(self->logic())
+    , m_actTurn(-1)
+    , m_belief(nullptr)
+{
+}
+
+Ai::~Ai()
+{
+    delete m_belief;
+}
+
+bool Ai::IsEnabled()
+{
+    return Enabled.load() != 0;
+}
+
+void Ai::SetEnabled(bool enabled)
+{
+    Enabled.store(enabled ? 1 : 0);
+}
+
+QVariant Ai::reply(int command, const QVariant &data)
+{
+    switch (command) {
+    case S_COMMAND_ACT:
+        return act(data.toMap());
+    case S_COMMAND_ASK_FOR_CARD: {
+        const QVariantMap request = data.toMap();
+        return request.contains("maxNum") ? askForCards(request) : askForCard(request);
+    }
+    case S_COMMAND_CHOOSE_GENERAL:
+        return chooseGeneral(data.toMap());
+    case S_COMMAND_CHOOSE_PLAYER_CARD:
+        return choosePlayerCard(data.toMap());
+    case S_COMMAND_TAKE_AMAZING_GRACE:
+        return takeAmazingGrace();
+    case S_COMMAND_ARRANGE_CARD:
+        return arrangeCard(data.toMap());
+    case S_COMMAND_TRIGGER_ORDER:
+    case S_COMMAND_ASK_FOR_OPTION:
+        //Skills are mostly worth invoking, so the first option is taken
+        return 0;
+    default:
+        return QVariant();
+    }
+}
+
+int Ai::relationTo(const ServerPlayer *other) const
+{
+    if (other == m_self)
+        return 1;
+
+    QString role = m_self->role();
+    if (role.isEmpty()) {
+        QString kingdom = other->publicProperty("kingdom").toString();
+        if (kingdom.isEmpty() || kingdom == "unknown")
+            return 0;
+        return kingdom == m_self->kingdom() ? 1 : -1;
+    }
+
+    QString otherRole = other->publicProperty("role").toString();
+    if (otherRole.isEmpty() || otherRole == "unknown")
+        return 0;
+
+    bool otherIsRenegade = otherRole == "renegade" || otherRole == "renagade";
+    if (role == "lord" || role == "loyalist") {
+        return otherRole == "lord" || otherRole == "loyalist" ? 1 : -1;
+    } else if (role == "rebel") {
+        if (otherRole == "rebel")
+            return 1;
+        return otherIsRenegade ? 0 : -1;
+    } else {
+        //A renegade protects the lord until everybody else is dead
+        if (otherRole == "lord")
+            return m_logic->allPlayers().length() > 2 ? 1 : -1;
+        return -1;
+    }
+}
+
+int Ai::keepValue(const Card *card) const
+{
+    static const QHash<QString, int> values = {
+        {"peach", 100},
+        {"jink", 80},
+        {"nullification", 75},
+        {"analeptic", 70},
+        {"ex_nihilo", 65},
+        {"snatch", 60},
+        {"indulgence", 58},
+        {"dismantlement", 55},
+        {"slash", 50},
+        {"fire_slash", 50},
+        {"thunder_slash", 50},
+        {"duel", 45}
+    };
+
+    if (card->type() == Card::EquipType) {
+        //An equip in use is worth much more than one in hand
+        if (m_self->equipArea()->findCard(card->id()))
+            return card->subtype() == EquipCard::ArmorType ? 90 : 85;
+        return 30;
+    }
+    return values.value(card->objectName(), 40);
+}
+
+BeliefTracker *Ai::belief()
+{
+    if (m_belief == nullptr)
+        m_belief = new BeliefTracker(m_self);
+    return m_belief;
+}
+
+QVariant Ai::act(const QVariantMap &data)
+{
+    if (data.isEmpty() && MctsAi::IsSearching(m_self) && !m_logic->isSpeculating()) {
+        MctsAi search(m_self);
+        return search.act();
+    }
+
+    UndoJournal::Save(m_actTurn);
+    UndoJournal::Save(m_actedCards);
+    if (m_actTurn != m_self->turnCount()) {
+        m_actTurn = m_self->turnCount();
+        m_actedCards.clear();
+    }
+
+    QList<Card *> cards = m_self->handcardArea()->cards();
+
+    //A card that is still in hand after being chosen couldn't be used. It isn't tried again.
+    QSet<uint> failedCards;
+    foreach (const Card *card, cards) {
+        if (m_actedCards.contains(card->id()))
+            failedCards << card->id();
+    }
+    m_actedCards = failedCards;
+
+    if (data.contains("pattern")) {
+        CardPattern pattern(data["pattern"].toString());
+        QList<ServerPlayer *> targets;
+        const QVariantList assignedTargets = data["assignedTargets"].toList();
+        foreach (const QVariant &targetId, assignedTargets) {
+            ServerPlayer *target = m_logic->findPlayer(targetId.toUInt());
+            if (target == nullptr || relationTo(target) > 0)
+                return QVariant();
+            targets << target;
+        }
+
+        foreach (Card *card, cards) {
+            if (!pattern.match(m_self, card))
+                continue;
+
+            QList<ServerPlayer *> cardTargets = targets;
+            if (card->isTargetFixed() || chooseTargets(card, cardTargets))
+                return CardReply(card, cardTargets);
+        }
+        return QVariant();
+    }
+
+    std::stable_sort(cards.begin(), cards.end(), [](const Card *a, const Card *b){
+        return UsePriority(a) > UsePriority(b);
+    });
+
+    foreach (Card *card, cards) {
+        if (m_actedCards.contains(card->id()) || !card->isAvailable(m_self))
+            continue;
+
+        QList<ServerPlayer *> targets;
+        bool use = false;
+        if (card->isTargetFixed())
+            use = wantsToUse(card);
+        else if (wantsToUse(card))
+            use = chooseTargets(card, targets);
+
+        //Cards like Iron Chain are recast if there's no good target
+        if (use || card->canRecast()) {
+            m_actedCards << card->id();
+            return CardReply(card, targets);
+        }
+    }
+
+    return QVariant();
+}
+
+QVariant Ai::askForCard(const QVariantMap &data)
+{
+    CardPattern pattern(data["pattern"].toString());
+    bool optional = data["optional"].toBool();
+
+    QList<Card *> candidates;
+    QList<Card *> cards = m_self->handcardArea()->cards() + m_self->equipArea()->cards();
+    foreach (Card *card, cards) {
+        if (pattern.match(m_self, card))
+            candidates << card;
+    }
+    if (candidates.isEmpty())
+        return QVariant();
+
+    std::stable_sort(candidates.begin(), candidates.end(), [this](const Card *a, const Card *b){
+        return keepValue(a) < keepValue(b);
+    });
+    Card *card = candidates.first();
+
+    if (optional) {
+        QString name = card->objectName();
+        if (name == "nullification")
+            return QVariant();
+
+        if (name == "peach" || name == "analeptic") {
+            bool saving = false;
+            QList<ServerPlayer *> players = m_logic->allPlayers();
+            foreach (ServerPlayer *player, players) {
+                if (player->isDying() && relationTo(player) > 0) {
+                    saving = true;
+                    break;
+                }
+            }
+            if (!saving)
+                return QVariant();
+        }
+    }
+
+    return CardReply(card);
+}
+
+QVariant Ai::askForCards(const QVariantMap &data)
+{
+    if (data["optional"].toBool())
+        return QVariant();
+
+    CardPattern pattern(data["pattern"].toString());
+    int minNum = data["minNum"].toInt();
+
+    QList<Card *> candidates;
+    QList<Card *> cards = m_self->handcardArea()->cards() + m_self->equipArea()->cards();
+    foreach (Card *card, cards) {
+        if (pattern.match(m_self, card))
+            candidates << card;
+    }
+
+    std::stable_sort(candidates.begin(), candidates.end(), [this](const Card *a, const Card *b){
+        return keepValue(a) < keepValue(b);
+    });
+
+    QVariantList cardIds;
+    foreach (const Card *card, candidates.mid(0, minNum))
+        cardIds << card->id();
+
+    QVariantMap reply;
+    reply["cards"] = cardIds;
+    return reply;
+}
+
+QVariant Ai::chooseGeneral(const QVariantMap &data)
+{
+    int num = data["num"].toInt();
+    Engine *engine = Engine::instance();
+
+    QList<const General *> candidates;
+    const QVariantList candidateData = data["candidates"].toList();
+    foreach (const QVariant &id, candidateData) {
+        const General *general = engine->getGeneral(id.toUInt());
+        if (general)
+            candidates << general;
+    }
+
+    std::stable_sort(candidates.begin(), candidates.end(), [](const General *a, const General *b){
+        if (a->isLord() != b->isLord())
+            return a->isLord();
+        return a->maxHp() > b->maxHp();
+    });
+
+    //The other generals should be of the same kingdom as the first one if possible
+    QList<const General *> generals;
+    if (!candidates.isEmpty())
+        generals << candidates.takeFirst();
+    for (int pass = 0; pass < 2 && generals.length() < num; pass++) {
+        foreach (const General *general, candidates) {
+            if (generals.length() >= num)
+                break;
+            if (generals.contains(general))
+                continue;
+            if (pass == 0 && general->kingdom() != generals.first()->kingdom())
+                continue;
+            generals << general;
+        }
+    }
+
+    QVariantList reply;
+    foreach (const General *general, generals)
+        reply << general->id();
+    return reply;
+}
+
+QVariant Ai::choosePlayerCard(const QVariantMap &data)
+{
+    QList<Card *> equips = m_logic->findCards(data["equips"]);
+    QList<Card *> delayedTricks = m_logic->findCards(data["delayedTricks"]);
+
+    //Visible cards tell who the owner is
+    ServerPlayer *owner = nullptr;
+    QList<ServerPlayer *> players = m_logic->allPlayers(true);
+    foreach (ServerPlayer *player, players) {
+        if ((!equips.isEmpty() && player->equipArea()->findCard(equips.first()->id()))
+                || (!delayedTricks.isEmpty() && player->delayedTrickArea()->findCard(delayedTricks.first()->id()))) {
+            owner = player;
+            break;
+        }
+    }
+
+    if (owner && relationTo(owner) > 0) {
+        if (!delayedTricks.isEmpty())
+            return delayedTricks.first()->id();
+        return 0;
+    }
+
+    if (!equips.isEmpty()) {
+        const Card *best = equips.first();
+        foreach (const Card *card, equips) {
+            if (card->subtype() == EquipCard::ArmorType || (card->subtype() == EquipCard::WeaponType && best->subtype() != EquipCard::ArmorType))
+                best = card;
+        }
+        return best->id();
+    }
+
+    //A handcard is taken at random if nothing else is wanted
+    QVariantList handcards = data["handcards"].toList();
+    if (!handcards.isEmpty())
+        return handcards.first();
+    return 0;
+}
+
+QVariant Ai::takeAmazingGrace()
+{
+    const Card *best = nullptr;
+    QList<Card *> cards = m_logic->wugu()->cards();
+    foreach (const Card *card, cards) {
+        if (best == nullptr || keepValue(card) > keepValue(best))
+            best = card;
+    }
+    return best ? best->id() : 0;
+}
+
+QVariant Ai::arrangeCard(const QVariantMap &data)
+{
+    QList<Card *> cards = m_logic->findCards(data["cards"]);
+    std::stable_sort(cards.begin(), cards.end(), [this](const Card *a, const Card *b){
+        return keepValue(a) > keepValue(b);
+    });
+
+    //The best cards go to the first area
+    QVariantList reply;
+    const QVariantList capacities = data["capacities"].toList();
+    int index = 0;
+    foreach (const QVariant &capacity, capacities) {
+        QVariantList area;
+        for (int i = capacity.toInt(); i > 0 && index < cards.length(); i--)
+            area << cards.at(index++)->id();
+        reply << QVariant(area);
+    }
+    return reply;
+}
+
+bool Ai::chooseTargets(const Card *card, QList<ServerPlayer *> &targets) const
+{
+    //Slashes go first to those who are less likely to hold a Jink
+    const BeliefTracker *belief = card->objectName().endsWith("slash") ? m_belief : nullptr;
+    QList<ServerPlayer *> candidates = m_logic->otherPlayers(m_self);
+    std::stable_sort(candidates.begin(), candidates.end(), [belief](const ServerPlayer *a, const ServerPlayer *b){
+        if (a->hp() != b->hp() || belief == nullptr)
+            return a->hp() < b->hp();
+        return belief->probability(a, "jink") < belief->probability(b, "jink");
+    });
+
+    QList<const Player *> selected;
+    foreach (ServerPlayer *target, targets)
+        selected << target;
+
+    foreach (ServerPlayer *candidate, candidates) {
+        if (selected.length() >= card->maxTargetNum())
+            break;
+        if (selected.contains(candidate) || relationTo(candidate) >= 0)
+            continue;
+        if (card->targetFilter(selected, candidate, m_self)) {
+            selected << candidate;
+            targets << candidate;
+        }
+    }
+
+    return !selected.isEmpty() && card->targetFeasible(selected, m_self);
+}
+
+bool Ai::wantsToUse(const Card *card) const
+{
+    QString name = card->objectName();
+
+    if (card->type() == Card::EquipType) {
+        QList<Card *> equips = m_self->equipArea()->cards();
+        foreach (const Card *equip, equips) {
+            if (equip->subtype() == card->subtype())
+                return false;
+        }
+        return true;
+    }
+
+    if (name == "peach")
+        return m_self->isWounded();
+    if (name == "ex_nihilo" || name == "amazing_grace")
+        return true;
+    if (name == "god_salvation")
+        return relationScore(m_logic->allPlayers(), true) > 0;
+    if (name == "savage_assault" || name == "archery_attack")
+        return relationScore(m_logic->otherPlayers(m_self), false) < 0;
+    if (name == "analeptic" || name == "lightning" || name == "jink" || name == "nullification")
+        return false;
+
+    //Other cards are used on enemies
+    return !card->isTargetFixed();
+}
+
+int Ai::relationScore(const QList<ServerPlayer *> &players, bool wounded) const
+{
+    int score = 0;
+    foreach (const ServerPlayer *player, players) {
+        if (!wounded || player->isWounded())
+            score += relationTo(player);
+    }
+    return score;
+}
@@ -0,0 +1,80 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+#ifndef AI_H
+#define AI_H
+
+#include <QSet>
+#include <QVariant>
+
+class BeliefTracker;
+class Card;
+class GameLogic;
+class ServerPlayer;
+
+/* A native AI for robot seats. It's given the same request as a client and returns a reply
+ * in the same format, so ServerPlayer can answer robots in the thread of the game logic
+ * instead of waiting for a script.
+ *
+ * The heuristics only use what the player can see: its own cards and roles or kingdoms
+ * that have been made public.
+ */
+class Ai
+{
+public:
+    Ai(ServerPlayer *self);
+    ~Ai();
+
+    //Robots are answered by the native AI if it's enabled when the request is sent
+    static bool IsEnabled();
+    static void SetEnabled(bool enabled);
+
+    QVariant reply(int command, const QVariant &data);
+
+    //Positive for a known friend, negative for a known enemy and 0 if it's unknown
+    int relationTo(const ServerPlayer *other) const;
+
+    //How much the player wants to keep a card. Cards with the lowest value are discarded first.
+    int keepValue(const Card *card) const;
+
+    //What the player believes about hidden cards. It's created by the first call, from the
+    //current state, and then kept up to date by GameLogic::moveCards().
+    BeliefTracker *belief();
+
+private:
+    QVariant act(const QVariantMap &data);
+    QVariant askForCard(const QVariantMap &data);
+    QVariant askForCards(const QVariantMap &data);
+    QVariant chooseGeneral(const QVariantMap &data);
+    QVariant choosePlayerCard(const QVariantMap &data);
+    QVariant takeAmazingGrace();
+    QVariant arrangeCard(const QVariantMap &data);
+
+    bool chooseTargets(const Card *card, QList<ServerPlayer *> &targets) const;
+    bool wantsToUse(const Card *card) const;
+    int relationScore(const QList<ServerPlayer *> &players, bool wounded) const;
+
+    ServerPlayer *m_self;
+    GameLogic *m_logic;
+    int m_actTurn;
+    QSet<uint> m_actedCards;
+    BeliefTracker *m_belief;
+};
+
+#endif // AI_H
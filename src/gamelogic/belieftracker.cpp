@@ -0,0 +1,306 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+#include "belieftracker.h"
+#include "card.h"
+#include "cardarea.h"
+#include "gamelogic.h"
+#include "serverplayer.h"
+
+#include <qmath.h>
+
+#include <cmath>
+
+namespace {
+
+//A card is certainly in an area above this probability
+const double Certain = 1.0 - 1e-9;
+
+}
+
+BeliefTracker::Mass::Mass()
+    : expected(0.0)
+    , logMiss(0.0)
+    , certainNum(0)
+{
+}
+
+BeliefTracker::Pool::Pool()
+    : cardNum(0)
+{
+}
+
+BeliefTracker::BeliefTracker(ServerPlayer *viewer)
+    : m_viewer(viewer)
+{
+    GameLogic *logic = viewer->logic();
+
+    QList<const CardArea *> areas;
+    areas << logic->drawPile();
+    QList<ServerPlayer *> players = logic->players();
+    foreach (ServerPlayer *player, players) {
+        if (player != viewer)
+            areas << player->handcardArea();
+    }
+
+    QList<int> pools;
+    QList<Card *> cards;
+    foreach (const CardArea *area, areas) {
+        int pool = addPool(area->type(), area->owner());
+        m_pools[pool].cardNum = area->length();
+        pools << pool;
+        cards << area->cards();
+    }
+    if (cards.isEmpty())
+        return;
+
+    //Any hidden card can be in any hidden area
+    foreach (const Card *card, cards) {
+        QVector<double> &belief = m_beliefs[card];
+        foreach (int pool, pools)
+            setProbability(card, belief, pool, double(m_pools.at(pool).cardNum) / cards.length());
+    }
+}
+
+void BeliefTracker::update(const QList<CardsMoveStruct> &moves)
+{
+    foreach (const CardsMoveStruct &move, moves)
+        update(move);
+}
+
+void BeliefTracker::update(const CardsMoveStruct &move)
+{
+    int from = findPool(move.from);
+    if (move.isOpen || move.isRelevant(m_viewer) || from < 0) {
+        //The viewer sees the cards, or knew them before they left a public area
+        int to = -1;
+        if (isHidden(move.to)) {
+            to = findPool(move.to);
+            if (to < 0)
+                to = addPool(move.to.type, move.to.owner);
+        }
+
+        foreach (const Card *card, move.cards) {
+            reveal(card, from);
+            if (to >= 0)
+                pin(card, to);
+        }
+    } else {
+        int to = findPool(move.to);
+        if (to < 0)
+            to = addPool(move.to.type, move.to.owner);
+        transfer(from, to, move.cards.length());
+    }
+}
+
+void BeliefTracker::reshuffle(const QList<Card *> &cards)
+{
+    int from = findPool(CardArea::DiscardPile, nullptr);
+    int to = findPool(CardArea::DrawPile, nullptr);
+    if (to < 0)
+        to = addPool(CardArea::DrawPile, nullptr);
+
+    foreach (const Card *card, cards) {
+        reveal(card, from);
+        pin(card, to);
+    }
+}
+
+double BeliefTracker::probability(const Card *card, const Player *owner) const
+{
+    if (!m_beliefs.contains(card))
+        return owner->handcardArea()->contains(card) ? 1.0 : 0.0;
+
+    int pool = findPool(CardArea::Hand, owner);
+    return pool >= 0 ? m_beliefs.value(card).value(pool) : 0.0;
+}
+
+double BeliefTracker::probability(const Player *owner, const QString &cardName) const
+{
+    int pool = findPool(CardArea::Hand, owner);
+    if (pool < 0)
+        return expectedNum(owner, cardName) > 0.0 ? 1.0 : 0.0;
+
+    Mass mass = m_pools.at(pool).masses.value(cardName);
+    if (mass.certainNum > 0)
+        return 1.0;
+    return qBound(0.0, 1.0 - qExp(mass.logMiss), 1.0);
+}
+
+double BeliefTracker::expectedNum(const Player *owner, const QString &cardName) const
+{
+    int pool = findPool(CardArea::Hand, owner);
+    if (pool >= 0)
+        return qMax(0.0, m_pools.at(pool).masses.value(cardName).expected);
+
+    //The viewer can see the cards
+    int num = 0;
+    QList<Card *> cards = owner->handcardArea()->cards();
+    foreach (const Card *card, cards) {
+        if (card->objectName() == cardName)
+            num++;
+    }
+    return num;
+}
+
+bool BeliefTracker::isHidden(const CardsMoveStruct::Area &area) const
+{
+    switch (area.type) {
+    case CardArea::Hand:
+    case CardArea::Special:
+        return area.owner != m_viewer;
+    case CardArea::DrawPile:
+        return true;
+    default:
+        return false;
+    }
+}
+
+int BeliefTracker::findPool(CardArea::Type type, const Player *owner) const
+{
+    return m_poolIndex.value(AreaKey(type, owner), -1);
+}
+
+int BeliefTracker::findPool(const CardsMoveStruct::Area &area) const
+{
+    return findPool(area.type, area.owner);
+}
+
+int BeliefTracker::addPool(CardArea::Type type, const Player *owner)
+{
+    int pool = m_pools.size();
+    m_pools.append(Pool());
+    m_poolIndex.insert(AreaKey(type, owner), pool);
+    return pool;
+}
+
+void BeliefTracker::setProbability(const Card *card, QVector<double> &belief, int pool, double p)
+{
+    if (belief.size() <= pool)
+        belief.resize(pool + 1);
+
+    p = qBound(0.0, p, 1.0);
+    double old = belief.at(pool);
+    if (old == p)
+        return;
+
+    QString name = card->objectName();
+    if (old > 0.0)
+        addMass(pool, name, old, -1);
+    if (p > 0.0)
+        addMass(pool, name, p, 1);
+    belief[pool] = p;
+}
+
+void BeliefTracker::addMass(int pool, const QString &name, double p, int sign)
+{
+    Mass &mass = m_pools[pool].masses[name];
+    mass.expected += sign * p;
+    if (p >= Certain)
+        mass.certainNum += sign;
+    else
+        mass.logMiss += sign * std::log1p(-p);
+}
+
+void BeliefTracker::reveal(const Card *card, int from)
+{
+    QHash<const Card *, QVector<double>>::iterator i = m_beliefs.find(card);
+    if (i == m_beliefs.end())
+        return;
+
+    QVector<double> belief = i.value();
+    m_beliefs.erase(i);
+    for (int pool = 0; pool < belief.size(); pool++) {
+        if (belief.at(pool) > 0.0)
+            addMass(pool, card->objectName(), belief.at(pool), -1);
+    }
+
+    if (from >= 0)
+        m_pools[from].cardNum = qMax(m_pools.at(from).cardNum - 1, 0);
+
+    //Nothing else is learned if the viewer already knew where the card was
+    if (from < 0 || belief.value(from) < Certain)
+        rebalance();
+}
+
+void BeliefTracker::pin(const Card *card, int to)
+{
+    QVector<double> &belief = m_beliefs[card];
+    belief.fill(0.0, m_pools.size());
+    setProbability(card, belief, to, 1.0);
+    m_pools[to].cardNum++;
+}
+
+void BeliefTracker::transfer(int from, int to, int num)
+{
+    int cardNum = m_pools.at(from).cardNum;
+    if (from == to || cardNum <= 0 || num <= 0)
+        return;
+
+    double share = qMin(1.0, double(num) / cardNum);
+    QHash<const Card *, QVector<double>>::iterator i;
+    for (i = m_beliefs.begin(); i != m_beliefs.end(); ++i) {
+        QVector<double> &belief = i.value();
+        double p = belief.value(from);
+        if (p <= 0.0)
+            continue;
+
+        double moved = p * share;
+        setProbability(i.key(), belief, from, p - moved);
+        setProbability(i.key(), belief, to, belief.value(to) + moved);
+    }
+
+    m_pools[from].cardNum = cardNum - qMin(num, cardNum);
+    m_pools[to].cardNum += num;
+}
+
+void BeliefTracker::rebalance()
+{
+    //One step of iterative proportional fitting: each area is scaled to the number of cards
+    //it holds, then each card is normalized again.
+    int poolNum = m_pools.size();
+    QVector<double> sums(poolNum, 0.0);
+    QHash<const Card *, QVector<double>>::iterator i;
+    for (i = m_beliefs.begin(); i != m_beliefs.end(); ++i) {
+        const QVector<double> &belief = i.value();
+        for (int pool = 0; pool < belief.size(); pool++)
+            sums[pool] += belief.at(pool);
+    }
+
+    QVector<double> factors(poolNum, 0.0);
+    for (int pool = 0; pool < poolNum; pool++) {
+        if (sums.at(pool) > 0.0)
+            factors[pool] = m_pools.at(pool).cardNum / sums.at(pool);
+    }
+
+    for (i = m_beliefs.begin(); i != m_beliefs.end(); ++i) {
+        QVector<double> &belief = i.value();
+        QVector<double> scaled(belief.size(), 0.0);
+        double total = 0.0;
+        for (int pool = 0; pool < belief.size(); pool++) {
+            scaled[pool] = belief.at(pool) * factors.at(pool);
+            total += scaled.at(pool);
+        }
+        if (total <= 0.0)
+            continue;
+
+        for (int pool = 0; pool < belief.size(); pool++)
+            setProbability(i.key(), belief, pool, scaled.at(pool) / total);
+    }
+}
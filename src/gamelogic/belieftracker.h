@@ -0,0 +1,111 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+#ifndef BELIEFTRACKER_H
+#define BELIEFTRACKER_H
+
+#include "structs.h"
+
+#include <QHash>
+#include <QPair>
+#include <QVector>
+
+class Card;
+class Player;
+class ServerPlayer;
+
+/* What a player believes about the cards it can't see.
+ *
+ * Every card the viewer hasn't located has a probability over the hidden areas, which are
+ * the handcards of other players, the draw pile and any area cards have been moved to
+ * face down. It's fed by the same CardsMoveStruct stream that GameLogic::moveCards()
+ * notifies, and only uses what the viewer is told: card ids of open or relevant moves and
+ * the number of cards otherwise.
+ *
+ * A hidden move takes the same share of every card's probability out of its source. An open
+ * move pins the card, and the rest of its source is rebalanced so that each area still
+ * holds as many cards as it should. Sums by card name are kept up to date, so queries
+ * take constant time.
+ */
+class BeliefTracker
+{
+public:
+    //It starts from the current state of the game, where nothing hidden is known
+    BeliefTracker(ServerPlayer *viewer);
+
+    void update(const QList<CardsMoveStruct> &moves);
+    void update(const CardsMoveStruct &move);
+
+    //The discard pile is reshuffled into the draw pile
+    void reshuffle(const QList<Card *> &cards);
+
+    //The probability that the card is in the hand of the owner
+    double probability(const Card *card, const Player *owner) const;
+
+    //The probability that the owner holds at least one card with the name, such as "jink".
+    //Cards are assumed to be independent.
+    double probability(const Player *owner, const QString &cardName) const;
+
+    //The expected number of cards with the name in the hand of the owner
+    double expectedNum(const Player *owner, const QString &cardName) const;
+
+    //Cards whose location is uncertain or hidden
+    int trackedNum() const { return m_beliefs.size(); }
+
+private:
+    typedef QPair<int, const Player *> AreaKey;
+
+    struct Mass
+    {
+        Mass();
+
+        double expected;
+        //The sum of log(1 - p) over cards that are not certainly there
+        double logMiss;
+        int certainNum;
+    };
+
+    struct Pool
+    {
+        Pool();
+
+        int cardNum;
+        QHash<QString, Mass> masses;
+    };
+
+    bool isHidden(const CardsMoveStruct::Area &area) const;
+    int findPool(CardArea::Type type, const Player *owner) const;
+    int findPool(const CardsMoveStruct::Area &area) const;
+    int addPool(CardArea::Type type, const Player *owner);
+
+    void setProbability(const Card *card, QVector<double> &belief, int pool, double p);
+    void addMass(int pool, const QString &name, double p, int sign);
+
+    void reveal(const Card *card, int from);
+    void pin(const Card *card, int to);
+    void transfer(int from, int to, int num);
+    void rebalance();
+
+    ServerPlayer *m_viewer;
+    QHash<AreaKey, int> m_poolIndex;
+    QVector<Pool> m_pools;
+    QHash<const Card *, QVector<double>> m_beliefs;
+};
+
+#endif // BELIEFTRACKER_H
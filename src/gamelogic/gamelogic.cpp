@@ -17,6 +17,8 @@
     Mogara
 *********************************************************************/
 
+#include "ai.h"
+#include "belieftracker.h"
 #include "card.h"
 #include "cardarea.h"
 #include "engine.h"
@@ -24,11 +26,23 @@
 #include "gamelogic.h"
 #include "gamemode.h"
 #include "gamerule.h"
+#include "gametracer.h"
 #include "general.h"
+#include "heapaccount.h"
+#include "mctsai.h"
+#include "metrics.h"
 #include "package.h"
+#include "payloadcompressor.h"
 #include "protocol.h"
+#include "replayrecorder.h"
+#include "replystatistics.h"
+#include "roommigration.h"
 #include "roomsettings.h"
 #include "serverplayer.h"
+#include "skill.h"
+#include "spectatorchannel.h"
+#include "triggerprofiler.h"
+#include "undojournal.h"
 #include "util.h"
 
 #include <CRoom>
@@ -36,17 +50,99 @@
 #include <CServerRobot>
 #include <CServerUser>
 
+#include <QDataStream>
 #include <QDateTime>
 #include <QThread>
 
+namespace {
+
+QAtomicInt BatchWindowMsecs(0);
+QAtomicInt HibernationThresholdMsecs(0);
+
+int DigitNum(qulonglong value)
+{
+    int num = 1;
+    while (value >= 10) {
+        value /= 10;
+        num++;
+    }
+    return num;
+}
+
+//Approximates the size of the data in compact JSON without serializing it
+int JsonSizeHint(const QVariant &data)
+{
+    switch (data.type()) {
+    case QVariant::Invalid:
+        return 4;
+    case QVariant::Bool:
+        return data.toBool() ? 4 : 5;
+    case QVariant::Int:
+    case QVariant::LongLong: {
+        qlonglong value = data.toLongLong();
+        return value < 0 ? DigitNum(qulonglong(-(value + 1)) + 1) + 1 : DigitNum(qulonglong(value));
+    }
+    case QVariant::UInt:
+    case QVariant::ULongLong:
+        return DigitNum(data.toULongLong());
+    case QVariant::Double:
+        return 8;
+    case QVariant::List: {
+        const QVariantList list = data.toList();
+        int size = 1 + list.length();
+        foreach (const QVariant &item, list)
+            size += JsonSizeHint(item);
+        return size;
+    }
+    case QVariant::StringList: {
+        const QStringList list = data.toStringList();
+        int size = 1 + list.length();
+        foreach (const QString &item, list)
+            size += item.length() + 2;
+        return size;
+    }
+    case QVariant::Map: {
+        const QVariantMap map = data.toMap();
+        int size = 1 + map.size();
+        for (QVariantMap::const_iterator i = map.constBegin(); i != map.constEnd(); i++)
+            size += i.key().length() + 3 + JsonSizeHint(i.value());
+        return size;
+    }
+    default:
+        return data.toString().length() + 2;
+    }
+}
+
+}
+
 GameLogic::GameLogic(CRoom *parent)
     : CAbstractGameLogic(parent)
     , m_currentPlayer(nullptr)
     , m_gameRule(nullptr)
+    , m_mode(nullptr)
     , m_skipGameRule(false)
+    , m_interruption(InvalidEvent)
+    , m_profiler(TriggerProfiler::IsEnabled() ? new TriggerProfiler : nullptr)
+    , m_tracer(nullptr)
+    , m_replyStatistics(new ReplyStatistics)
+    , m_recorder(nullptr)
+    , m_spectators(new SpectatorChannel(this))
+    , m_seed(0)
+    , m_restored(false)
     , m_round(0)
     , m_reshufflingCount(0)
+    , m_journal(nullptr)
+    , m_hibernating(false)
+    , m_hibernatedSize(0)
+    , m_heap(HeapAccount::Acquire())
+    , m_cpuBase(0)
+    , m_threadCpuStart(-1)
+    , m_redirectPort(0)
 {
+    //An abandoned room is woken up so that its thread can finish
+    if (parent)
+        connect(parent, &CRoom::abandoned, this, &GameLogic::wake, Qt::DirectConnection);
+
     m_drawPile = new CardArea(CardArea::DrawPile);
     m_discardPile = new CardArea(CardArea::DiscardPile);
     m_table = new CardArea(CardArea::Table);
@@ -63,6 +159,14 @@ GameLogic::~GameLogic()
 
     foreach (Card *card, m_cards)
         delete card;
+
+    delete m_profiler;
+    delete m_tracer;
+    delete m_replyStatistics;
+    delete m_recorder;
+    delete m_spectators;
+    delete m_journal;
+    HeapAccount::Release(m_heap);
 }
 
 void GameLogic::setGameRule(const GameRule *rule) {
@@ -96,6 +200,328 @@ void GameLogic::removeEventHandler(const EventHandler *handler)
         m_handlers[event].removeOne(handler);
 }
 
+void GameLogic::interrupt(EventType reason)
+{
+    //A finished game can't be turned back into a broken turn
+    if (m_interruption != GameFinish)
+        m_interruption = reason;
+}
+
+void GameLogic::broadcastNotification(int command, const QVariant &data, CServerAgent *except)
+{
+    if (isSpeculating())
+        return;
+
+    if (m_resyncPending.testAndSetRelaxed(1, 0)) {
+        QList<ServerPlayer *> players = this->players();
+        foreach (ServerPlayer *player, players)
+            player->resyncIfNeeded();
+        //A resync follows a change of agents
+        countPlayers();
+    }
+
+    if (m_recorder)
+        m_recorder->record(ReplayFrame::Broadcast, except ? except->id() : 0, command, data);
+    //The agent excluded gets a private version, so it's still the public view
+    m_spectators->publish(command, data);
+
+    //Native robots read the game state directly, so only the others are notified
+    QList<ServerPlayer *> players = this->players();
+    bool hasNativeRobot = false;
+    foreach (ServerPlayer *player, players) {
+        if (player->isNativeRobot()) {
+            hasNativeRobot = true;
+            break;
+        }
+    }
+
+    //Batches are kept per player so that they stay in order with unicast notifications,
+    //and payloads are compressed per player as robots get them uncompressed
+    if (hasNativeRobot || BatchWindow() > 0 || PayloadCompressor::Level() > 0) {
+        foreach (ServerPlayer *player, players) {
+            CServerAgent *agent = player->agent();
+            if (agent && agent != except && !player->isNativeRobot())
+                player->sendNotification(command, data);
+        }
+    } else {
+        int agentNum = 0;
+        foreach (ServerPlayer *player, players) {
+            CServerAgent *agent = player->agent();
+            if (agent && agent != except)
+                agentNum++;
+        }
+        addMessage(command, data, agentNum);
+        room()->broadcastNotification(command, data, except);
+    }
+}
+
+int GameLogic::BatchWindow()
+{
+    return BatchWindowMsecs.load();
+}
+
+void GameLogic::SetBatchWindow(int msecs)
+{
+    BatchWindowMsecs.store(qMax(0, msecs));
+}
+
+void GameLogic::flushNotifications()
+{
+    //It's called before the thread blocks, so the CPU time is up to date while it waits
+    updateCpuTime();
+
+    QList<ServerPlayer *> players = this->players();
+    foreach (ServerPlayer *player, players)
+        player->flushNotifications();
+}
+
+int GameLogic::HibernationThreshold()
+{
+    return HibernationThresholdMsecs.load();
+}
+
+void GameLogic::SetHibernationThreshold(int msecs)
+{
+    HibernationThresholdMsecs.store(qMax(0, msecs));
+}
+
+bool GameLogic::isHibernating() const
+{
+    QMutexLocker locker(&m_hibernationMutex);
+    return m_hibernating;
+}
+
+int GameLogic::hibernatedSize() const
+{
+    QMutexLocker locker(&m_hibernationMutex);
+    return m_hibernatedSize;
+}
+
+void GameLogic::wake()
+{
+    QMutexLocker locker(&m_hibernationMutex);
+    m_hibernating = false;
+    m_wakeCondition.wakeAll();
+}
+
+void GameLogic::migrate(const QString &target, const QString &host, ushort port)
+{
+    QMutexLocker locker(&m_hibernationMutex);
+    m_migrationTarget = target;
+    m_redirectHost = host;
+    m_redirectPort = port;
+    m_hibernating = false;
+    m_wakeCondition.wakeAll();
+}
+
+QStringList GameLogic::userNames() const
+{
+    QStringList names;
+    QList<ServerPlayer *> players = this->players();
+    foreach (ServerPlayer *player, players) {
+        if (player->isHuman())
+            names << player->agent()->screenName();
+    }
+    return names;
+}
+
+bool GameLogic::handOver()
+{
+    QString target;
+    QVariantMap redirect;
+    {
+        QMutexLocker locker(&m_hibernationMutex);
+        if (m_migrationTarget.isEmpty())
+            return false;
+        target = m_migrationTarget;
+        m_migrationTarget.clear();
+        redirect["host"] = m_redirectHost;
+        redirect["port"] = m_redirectPort;
+    }
+
+    //The owner recreates the room on the target, and the other users are led to it there
+    QStringList users = userNames();
+    CServerUser *owner = room()->owner();
+    QString ownerName = owner ? owner->screenName() : QString();
+    if (!users.contains(ownerName))
+        ownerName = users.value(0);
+    redirect["owner"] = ownerName;
+    redirect["userNum"] = users.length();
+    redirect["robotNum"] = m_players.length() - users.length();
+
+    QVariantMap game;
+    game["roomId"] = room()->id();
+    game["users"] = users;
+    game["owner"] = ownerName;
+    game["snapshot"] = snapshot();
+
+    //Users wait for their next request no longer than a timeout
+    if (!RoomMigration::Send(target, game, settings()->timeout * 1000)) {
+        qWarning("Room(%u) failed to migrate to %s, and the game goes on here.", room()->id(), qPrintable(target));
+        return false;
+    }
+
+    broadcastNotification(S_COMMAND_MIGRATE, redirect);
+    flushNotifications();
+    interrupt(GameFinish);
+    return true;
+}
+
+QVariantMap GameLogic::usage() const
+{
+    QVariantMap data;
+    data["roomId"] = room()->id();
+    data["running"] = isRunning();
+    data["hibernating"] = isHibernating();
+    data["hibernatedBytes"] = hibernatedSize();
+    data["cpuMsecs"] = m_cpuUsecs.load() / 1000.0;
+    data["heapBytes"] = HeapAccount::IsEnabled() ? m_heap->bytes() : -1;
+    data["messages"] = m_messageNum.load();
+    data["messageBytes"] = m_messageBytes.load();
+    data["triggers"] = m_triggerNum.load();
+    data["reshuffles"] = m_reshuffleNum.load();
+    data["throttleUsecs"] = m_throttle.load();
+    return data;
+}
+
+void GameLogic::addMessage(int command, const QVariant &data, int agentNum)
+{
+    if (agentNum <= 0)
+        return;
+
+    //Agents serialize messages out of reach, so the size is estimated instead of serializing
+    //every message twice
+    int bytes = JsonSizeHint(data) + 2;
+    m_messageNum.fetchAndAddRelaxed(agentNum);
+    m_messageBytes.fetchAndAddRelaxed(qint64(bytes) * agentNum);
+    Metrics::AddMessage(command, bytes, agentNum);
+}
+
+void GameLogic::kill()
+{
+    m_killed.store(1);
+    wake();
+}
+
+void GameLogic::setThrottle(int usecs)
+{
+    m_throttle.store(qMax(0, usecs));
+}
+
+void GameLogic::updateCpuTime()
+{
+    qint64 now = qThreadCpuTime();
+    if (now >= 0 && m_threadCpuStart >= 0)
+        m_cpuUsecs.store(m_cpuBase + now - m_threadCpuStart);
+}
+
+bool GameLogic::isIdle()
+{
+    int threshold = HibernationThreshold();
+    if (threshold <= 0)
+        return false;
+
+    bool hasHuman = false;
+    QList<ServerPlayer *> players = this->players();
+    foreach (ServerPlayer *player, players) {
+        if (player->isHuman()) {
+            hasHuman = true;
+            if (player->isOnline()) {
+                m_idleTimer.invalidate();
+                return false;
+            }
+        }
+    }
+
+    //Games of robots alone never wait for anyone
+    if (!hasHuman)
+        return false;
+
+    if (!m_idleTimer.isValid())
+        m_idleTimer.start();
+    return m_idleTimer.elapsed() >= threshold;
+}
+
+void GameLogic::hibernate()
+{
+    flushNotifications();
+
+    QByteArray state;
+    QDataStream stream(&state, QIODevice::WriteOnly);
+    stream << snapshot();
+    state = qCompress(state);
+    releaseCards();
+
+    {
+        QMutexLocker locker(&m_hibernationMutex);
+        m_hibernating = true;
+        m_hibernatedSize = state.size();
+        while (m_hibernating && !room()->isAbandoned() && !m_killed.load())
+            m_wakeCondition.wait(&m_hibernationMutex);
+        m_hibernating = false;
+        m_hibernatedSize = 0;
+    }
+    m_idleTimer.invalidate();
+
+    if (room()->isAbandoned() || m_killed.load()) {
+        interrupt(GameFinish);
+        return;
+    }
+
+    QVariant snapshot;
+    QDataStream input(qUncompress(state));
+    input >> snapshot;
+    if (!restore(snapshot))
+        interrupt(GameFinish);
+}
+
+void GameLogic::releaseCards()
+{
+    QList<CardArea *> areas;
+    areas << m_drawPile << m_discardPile << m_table << m_wugu;
+    QList<ServerPlayer *> players = this->players();
+    foreach (ServerPlayer *player, players)
+        areas << player->handcardArea() << player->equipArea() << player->delayedTrickArea() << player->judgeCards();
+
+    //Virtual cards aren't in m_cards, and the snapshot rebuilds them on restore
+    QList<Card *> virtualCards;
+    foreach (CardArea *area, areas) {
+        foreach (Card *card, area->cards()) {
+            if (card->isVirtual())
+                virtualCards << card;
+        }
+        area->clear();
+    }
+    qDeleteAll(virtualCards);
+
+    m_cardPosition.clear();
+    foreach (Card *card, m_cards)
+        delete card;
+    m_cards.clear();
+}
+
+void GameLogic::countPlayers()
+{
+    int humanNum = 0;
+    int robotNum = 0;
+    QList<ServerPlayer *> players = this->players();
+    foreach (ServerPlayer *player, players) {
+        if (player->isHuman())
+            humanNum++;
+        else
+            robotNum++;
+    }
+    m_humanNum.store(humanNum);
+    m_robotNum.store(robotNum);
+}
+
+EventType GameLogic::takeInterruption()
+{
+    EventType reason = m_interruption;
+    m_interruption = InvalidEvent;
+    return reason;
+}
+
 bool GameLogic::trigger(EventType event, ServerPlayer *target)
 {
     QVariant data;
@@ -104,6 +530,24 @@ bool GameLogic::trigger(EventType event, ServerPlayer *target)
 
 bool GameLogic::trigger(EventType event, ServerPlayer *target, QVariant &data)
 {
+    if (m_killed.load())
+        interrupt(GameFinish);
+    if (isInterrupted())
+        return true;
+
+    m_triggerNum.fetchAndAddRelaxed(1);
+    if (!isSpeculating())
+        Metrics::AddTrigger(event);
+    int throttle = m_throttle.load();
+    if (throttle > 0)
+        QThread::usleep(throttle);
+
+    //Rollouts of robots aren't profiled or traced
+    TriggerProfiler *profiler = isSpeculating() ? nullptr : m_profiler;
+    TriggerProfiler::Timer eventTimer(profiler, event);
+    GameTracer::Span span(tracer(), "trigger");
+    span.addArgument("event", event);
+
     QList<const EventHandler *> &handlers = m_handlers[event];
 
     std::stable_sort(handlers.begin(), handlers.end(), [event](const EventHandler *a, const EventHandler *b){
@@ -120,7 +564,12 @@ bool GameLogic::trigger(EventType event, ServerPlayer *target, QVariant &data)
         do {
             const EventHandler *handler = handlers.at(triggerableIndex);
             if (triggerableEvents.isEmpty() || handler->priority(event) == currentPriority) {
-                EventMap events = handler->triggerable(this, event, target, data);
+                EventMap events;
+                {
+                    TriggerProfiler::Timer timer(profiler, event, handler, TriggerProfiler::TriggerableStage);
+                    events = handler->triggerable(this, event, target, data);
+                    timer.setHit(!events.isEmpty());
+                }
                 if (events.size() > 0) {
                     QList<ServerPlayer *> players = this->players();
                     foreach (ServerPlayer *p, players) {
@@ -173,11 +622,23 @@ bool GameLogic::trigger(EventType event, ServerPlayer *target, QVariant &data)
                     ServerPlayer *eventTarget = choice.to.isEmpty() ? target : choice.to.first();
 
                     //Ask the invoker for cost
-                    bool takeEffect = choice.handler->onCost(this, event, eventTarget, data, invoker);
+                    bool takeEffect;
+                    {
+                        TriggerProfiler::Timer timer(profiler, event, choice.handler, TriggerProfiler::CostStage);
+                        takeEffect = choice.handler->onCost(this, event, eventTarget, data, invoker);
+                    }
+
+                    if (isInterrupted())
+                        return true;
 
                     //Take effect
                     if (takeEffect) {
-                        broken = choice.handler->effect(this, event, eventTarget, data, invoker);
+                        {
+                            TriggerProfiler::Timer timer(profiler, event, choice.handler, TriggerProfiler::EffectStage);
+                            broken = choice.handler->effect(this, event, eventTarget, data, invoker);
+                        }
+                        if (isInterrupted())
+                            return true;
                         if (broken)
                             break;
                     }
@@ -305,17 +766,24 @@ void GameLogic::reshuffleDrawPile()
     }
 
     m_reshufflingCount++;
+    if (!isSpeculating())
+        m_reshuffleNum.fetchAndAddRelaxed(1);
 
     //@to-do: check reshuffling count limit
     /*if (limit > 0 && times == limit)
         gameOver(".");*/
 
+    QList<BeliefTracker *> beliefs = beliefTrackers();
+
     QList<Card *> cards = m_discardPile->cards();
     m_discardPile->clear();
     qShuffle(cards);
     foreach (Card *card, cards)
         m_cardPosition[card] = m_drawPile;
     m_drawPile->add(cards, CardArea::Bottom);
+
+    foreach (BeliefTracker *belief, beliefs)
+        belief->reshuffle(cards);
 }
 
 void GameLogic::moveCards(const CardsMoveStruct &move)
@@ -325,6 +793,12 @@ void GameLogic::moveCards(const CardsMoveStruct &move)
 
 void GameLogic::moveCards(QList<CardsMoveStruct> &moves)
 {
+    if (isInterrupted())
+        return;
+
+    GameTracer::Span span(tracer(), "moveCards");
+    span.addArgument("moveNum", moves.length());
+
     filterCardsMove(moves);
     QVariant moveData = QVariant::fromValue(&moves);
     QList<ServerPlayer *> allPlayers = this->allPlayers();
@@ -336,7 +810,14 @@ void GameLogic::moveCards(QList<CardsMoveStruct> &moves)
     foreach (ServerPlayer *player, allPlayers)
         trigger(CardsMove, player, moveData);
 
+    if (isInterrupted())
+        return;
+
     filterCardsMove(moves);
+
+    //Beliefs are created before the cards move, as they start from the current state
+    QList<BeliefTracker *> beliefs = beliefTrackers();
+
     for (int i = 0 ; i < moves.length(); i++) {
         const CardsMoveStruct &move = moves.at(i);
         CardArea *to = findArea(move.to);
@@ -362,9 +843,16 @@ void GameLogic::moveCards(QList<CardsMoveStruct> &moves)
         QVariantList data;
         foreach (const CardsMoveStruct &move, moves)
             data << move.toVariant(move.isRelevant(viewer));
-        CServerAgent *agent = viewer->agent();
-        agent->notify(S_COMMAND_MOVE_CARDS, data);
+        viewer->notify(S_COMMAND_MOVE_CARDS, data);
+    }
+    if (m_spectators->spectatorNum() > 0 && !isSpeculating()) {
+        QVariantList data;
+        foreach (const CardsMoveStruct &move, moves)
+            data << move.toVariant(false);
+        m_spectators->publish(S_COMMAND_MOVE_CARDS, data);
     }
+    foreach (BeliefTracker *belief, beliefs)
+        belief->update(moves);
 
     allPlayers = this->allPlayers();
     foreach (ServerPlayer *player, allPlayers)
@@ -373,9 +861,13 @@ void GameLogic::moveCards(QList<CardsMoveStruct> &moves)
 
 bool GameLogic::useCard(CardUseStruct &use)
 {
-    if (use.card == nullptr || use.from == nullptr)
+    if (use.card == nullptr || use.from == nullptr || isInterrupted())
         return false;
 
+    GameTracer::Span span(tracer(), "useCard");
+    span.addArgument("from", use.from->id());
+    span.addArgument("card", use.card->id());
+
     //Initialize isHandcard
     use.isHandcard = true;
     QList<Card *> realCards = use.card->realCards();
@@ -390,63 +882,73 @@ bool GameLogic::useCard(CardUseStruct &use)
     if (use.from->phase() == Player::Play && use.addHistory)
         use.from->addCardHistory(use.card->objectName());
 
-    try {
-        use.card->onUse(this, use);
+    use.card->onUse(this, use);
 
-        QVariant data = QVariant::fromValue(&use);
-        trigger(CardUsed, use.from, data);
+    QVariant data = QVariant::fromValue(&use);
+    trigger(CardUsed, use.from, data);
+    if (isInterrupted())
+        return false;
 
-        if (use.from) {
-            trigger(TargetChoosing, use.from, data);
-
-            QVariantMap args;
-            args["from"] = use.from->id();
-            //args["cards"]
-            QVariantList tos;
-            foreach (ServerPlayer *to, use.to)
-                tos << to->id();
-            args["to"] = tos;
-            room()->broadcastNotification(S_COMMAND_USE_CARD, args);
-
-            if (use.from) {
-                if (!use.to.isEmpty()) {
-                    foreach (ServerPlayer *to, use.to) {
-                        if (!use.to.contains(to))
-                            continue;
-                        trigger(TargetConfirming, to, data);
-                    }
+    if (use.from) {
+        trigger(TargetChoosing, use.from, data);
+        if (isInterrupted())
+            return false;
 
-                    if (use.from && !use.to.isEmpty()) {
-                        trigger(TargetChosen, use.from, data);
+        QVariantMap args;
+        args["from"] = use.from->id();
+        //args["cards"]
+        QVariantList tos;
+        foreach (ServerPlayer *to, use.to)
+            tos << to->id();
+        args["to"] = tos;
+        broadcastNotification(S_COMMAND_USE_CARD, args);
 
-                        if (use.from && !use.to.isEmpty()) {
-                            foreach (ServerPlayer *to, use.to) {
-                                if (!use.to.contains(to))
-                                    continue;
-                                trigger(TargetConfirmed, to, data);
-                            }
+        if (use.from) {
+            if (!use.to.isEmpty()) {
+                foreach (ServerPlayer *to, use.to) {
+                    if (!use.to.contains(to))
+                        continue;
+                    trigger(TargetConfirming, to, data);
+                }
+                if (isInterrupted())
+                    return false;
+
+                if (use.from && !use.to.isEmpty()) {
+                    trigger(TargetChosen, use.from, data);
+                    if (isInterrupted())
+                        return false;
 
-                            use.card->use(this, use);
+                    if (use.from && !use.to.isEmpty()) {
+                        foreach (ServerPlayer *to, use.to) {
+                            if (!use.to.contains(to))
+                                continue;
+                            trigger(TargetConfirmed, to, data);
                         }
+                        if (isInterrupted())
+                            return false;
+
+                        use.card->use(this, use);
                     }
-                } else if (use.target) {
-                    use.card->use(this, use);
                 }
+            } else if (use.target) {
+                use.card->use(this, use);
             }
         }
+    }
 
-        trigger(CardFinished, use.from, data);
+    if (isInterrupted())
+        return false;
 
-    } catch (EventType e) {
-        //@to-do: handle TurnBroken and StageChange
-        throw e;
-    }
+    trigger(CardFinished, use.from, data);
 
-    return true;
+    return !isInterrupted();
 }
 
 bool GameLogic::takeCardEffect(CardEffectStruct &effect)
 {
+    if (isInterrupted())
+        return false;
+
     QVariant data = QVariant::fromValue(&effect);
     bool canceled = false;
     if (effect.to) {
@@ -456,18 +958,18 @@ bool GameLogic::takeCardEffect(CardEffectStruct &effect)
                 canceled = trigger(CardEffected, effect.to, data);
                 if (!canceled) {
                     effect.use.card->onEffect(this, effect);
-                    if (effect.to->isAlive() && !effect.isNullified())
+                    if (effect.to->isAlive() && !effect.isNullified() && !isInterrupted())
                         effect.use.card->effect(this, effect);
                 }
             }
         }
     } else if (effect.use.target) {
         effect.use.card->onEffect(this, effect);
-        if (!effect.isNullified())
+        if (!effect.isNullified() && !isInterrupted())
             effect.use.card->effect(this, effect);
     }
     trigger(PostCardEffected, effect.to, data);
-    return !canceled;
+    return !canceled && !isInterrupted();
 }
 
 bool GameLogic::respondCard(CardResponseStruct &response)
@@ -494,6 +996,9 @@ bool GameLogic::respondCard(CardResponseStruct &response)
 
 void GameLogic::judge(JudgeStruct &judge)
 {
+    if (isInterrupted())
+        return;
+
     QVariant data = QVariant::fromValue(&judge);
 
     if (trigger(StartJudge, judge.who, data))
@@ -516,6 +1021,8 @@ void GameLogic::judge(JudgeStruct &judge)
     }
     trigger(FinishRetrial, judge.who, data);
     trigger(FinishJudge, judge.who, data);
+    if (isInterrupted())
+        return;
 
     const CardArea *judgeCards = judge.who->judgeCards();
     if (judgeCards->contains(judge.card)) {
@@ -541,9 +1048,13 @@ QList<Card *> GameLogic::findCards(const QVariant &data)
 
 void GameLogic::damage(DamageStruct &damage)
 {
-    if (damage.to == nullptr || damage.to->isDead())
+    if (damage.to == nullptr || damage.to->isDead() || isInterrupted())
         return;
 
+    GameTracer::Span span(tracer(), "damage");
+    span.addArgument("to", damage.to->id());
+    span.addArgument("damage", damage.damage);
+
     QVariant data = QVariant::fromValue(&damage);
     if (!damage.chain && !damage.transfer) {
         trigger(ConfirmDamage, damage.from, data);
@@ -552,53 +1063,56 @@ void GameLogic::damage(DamageStruct &damage)
     if (trigger(BeforeDamage, damage.from, data))
         return;
 
-    try {
-        do {
-            if (trigger(DamageStart, damage.to, data))
-                break;
+    do {
+        if (trigger(DamageStart, damage.to, data))
+            break;
 
-            if (damage.from && trigger(Damaging, damage.from, data))
-                break;
+        if (damage.from && trigger(Damaging, damage.from, data))
+            break;
 
-            if (damage.to && trigger(Damaged, damage.to, data))
-                break;
-        } while (false);
+        if (damage.to && trigger(Damaged, damage.to, data))
+            break;
+    } while (false);
+
+    if (isInterrupted())
+        return;
 
-        if (damage.to)
-            trigger(BeforeHpReduced, damage.to, data);
+    if (damage.to)
+        trigger(BeforeHpReduced, damage.to, data);
 
-        if (damage.to) {
-            QVariantList arg;
-            arg << damage.to->id();
-            arg << damage.nature;
-            arg << damage.damage;
-            room()->broadcastNotification(S_COMMAND_DAMAGE, arg);
+    if (isInterrupted())
+        return;
 
-            int newHp = damage.to->hp() - damage.damage;
-            damage.to->setHp(newHp);
-            damage.to->broadcastProperty("hp");
+    if (damage.to) {
+        QVariantList arg;
+        arg << damage.to->id();
+        arg << damage.nature;
+        arg << damage.damage;
+        broadcastNotification(S_COMMAND_DAMAGE, arg);
 
-            trigger(AfterHpReduced, damage.to, data);
-        }
+        int newHp = damage.to->hp() - damage.damage;
+        damage.to->setHp(newHp);
+        damage.to->broadcastProperty("hp");
+
+        trigger(AfterHpReduced, damage.to, data);
+    }
 
-        if (damage.from)
-            trigger(AfterDamaging, damage.from, data);
+    if (isInterrupted())
+        return;
 
-        if (damage.to)
-            trigger(AfterDamaged, damage.to, data);
+    if (damage.from)
+        trigger(AfterDamaging, damage.from, data);
 
-        if (damage.to)
-            trigger(DamageComplete, damage.to, data);
+    if (damage.to)
+        trigger(AfterDamaged, damage.to, data);
 
-    } catch (EventType e) {
-        //@to-do: handle TurnBroken and StageChange
-        throw e;
-    }
+    if (damage.to)
+        trigger(DamageComplete, damage.to, data);
 }
 
 void GameLogic::loseHp(ServerPlayer *victim, int lose)
 {
-    if (lose <= 0 || victim->isDead())
+    if (lose <= 0 || victim->isDead() || isInterrupted())
         return;
 
     QVariant data = lose;
@@ -615,7 +1129,7 @@ void GameLogic::loseHp(ServerPlayer *victim, int lose)
     QVariantMap arg;
     arg["victimId"] = victim->id();
     arg["loseHp"] = lose;
-    room()->broadcastNotification(S_COMMAND_LOSE_HP, arg);
+    broadcastNotification(S_COMMAND_LOSE_HP, arg);
 
     trigger(AfterHpReduced, victim, data);
     trigger(AfterHpLost, victim, data);
@@ -623,7 +1137,7 @@ void GameLogic::loseHp(ServerPlayer *victim, int lose)
 
 void GameLogic::recover(RecoverStruct &recover)
 {
-    if (recover.to == nullptr || recover.to->lostHp() == 0 || recover.to->isDead())
+    if (recover.to == nullptr || recover.to->lostHp() == 0 || recover.to->isDead() || isInterrupted())
         return;
 
     QVariant data = QVariant::fromValue(&recover);
@@ -640,13 +1154,16 @@ void GameLogic::recover(RecoverStruct &recover)
     arg["from"] = recover.from ? recover.from->id() : 0;
     arg["to"] = recover.to->id();
     arg["num"] = recover.recover;
-    room()->broadcastNotification(S_COMMAND_RECOVER, arg);
+    broadcastNotification(S_COMMAND_RECOVER, arg);
 
     trigger(AfterRecover, recover.to, data);
 }
 
 void GameLogic::killPlayer(ServerPlayer *victim, DamageStruct *damage)
 {
+    if (isInterrupted())
+        return;
+
     victim->setAlive(false);
     victim->broadcastProperty("alive");
     victim->broadcastProperty("role");
@@ -658,6 +1175,8 @@ void GameLogic::killPlayer(ServerPlayer *victim, DamageStruct *damage)
 
     trigger(BeforeGameOverJudge, victim, data);
     trigger(GameOverJudge, victim, data);
+    if (isInterrupted())
+        return;
 
     trigger(Died, victim, data);
     trigger(BuryVictim, victim, data);
@@ -668,8 +1187,17 @@ void GameLogic::gameOver(const QList<ServerPlayer *> &winners)
     QVariantList data;
     foreach (ServerPlayer *winner, winners)
         data << winner->id();
-    room()->broadcastNotification(S_COMMAND_GAME_OVER, data);
-    throw GameFinish;
+    broadcastNotification(S_COMMAND_GAME_OVER, data);
+    interrupt(GameFinish);
+
+    //Win rates of robots by the way they play, to tell whether the search beats the heuristics
+    if (!isSpeculating()) {
+        QList<ServerPlayer *> players = this->players();
+        foreach (ServerPlayer *player, players) {
+            if (!player->isHuman())
+                Metrics::AddRobotGame(MctsAi::IsSearching(player), winners.contains(player));
+        }
+    }
 }
 
 QMap<uint, QList<const General *>> GameLogic::broadcastRequestForGenerals(const QList<ServerPlayer *> &players, int num, int limit)
@@ -685,6 +1213,7 @@ QMap<uint, QList<const General *>> GameLogic::broadcastRequestForGenerals(const
         generals << generals.mid(0, minCandidateNum - generals.length());
 
     QMap<ServerPlayer *, GeneralList> playerCandidates;
+    QMap<ServerPlayer *, QVariant> aiReplies;
 
     foreach (ServerPlayer *player, players) {
         GeneralList candidates = generals.mid((player->seat() - 1) * limit, limit);
@@ -703,15 +1232,29 @@ QMap<uint, QList<const General *>> GameLogic::broadcastRequestForGenerals(const
         data["banned"] = bannedPairData;
 
         CServerAgent *agent = findAgent(player);
-        agent->prepareRequest(S_COMMAND_CHOOSE_GENERAL, data);
+        if (m_recorder)
+            m_recorder->record(ReplayFrame::Request, agent->id(), S_COMMAND_CHOOSE_GENERAL, data);
+        if (player->isNativeRobot()) {
+            aiReplies[player] = player->ai()->reply(S_COMMAND_CHOOSE_GENERAL, data);
+        } else {
+            agent->prepareRequest(S_COMMAND_CHOOSE_GENERAL, data);
+            addMessage(S_COMMAND_CHOOSE_GENERAL, data);
+        }
     }
 
     //@to-do: timeout should be loaded from config
     CRoom *room = this->room();
     QList<CServerAgent *> agents;
-    foreach (ServerPlayer *player, players)
-        agents << player->agent();
-    room->broadcastRequest(agents, settings()->timeout * 1000);
+    foreach (ServerPlayer *player, players) {
+        if (!aiReplies.contains(player))
+            agents << player->agent();
+    }
+    if (!agents.isEmpty()) {
+        flushNotifications();
+        GameTracer::Span span(m_tracer, "waitForReply", "request");
+        span.addArgument("command", S_COMMAND_CHOOSE_GENERAL);
+        room->broadcastRequest(agents, settings()->timeout * 1000);
+    }
 
     QMap<uint, GeneralList> result;
     foreach (ServerPlayer *player, players) {
@@ -720,7 +1263,10 @@ QMap<uint, QList<const General *>> GameLogic::broadcastRequestForGenerals(const
         GeneralList generals;
         CServerAgent *agent = findAgent(player);
         if (agent) {
-            QVariantList reply = agent->waitForReply(0).toList();
+            QVariant replyData = aiReplies.contains(player) ? aiReplies.value(player) : agent->waitForReply(0);
+            if (m_recorder)
+                m_recorder->record(ReplayFrame::Reply, agent->id(), S_COMMAND_CHOOSE_GENERAL, replyData);
+            QVariantList reply = replyData.toList();
             foreach (const QVariant &choice, reply) {
                 uint id = choice.toUInt();
                 foreach (const General *general, candidates) {
@@ -742,6 +1288,140 @@ QMap<uint, QList<const General *>> GameLogic::broadcastRequestForGenerals(const
     return result;
 }
 
+QVariant GameLogic::snapshot()
+{
+    QVariantMap data;
+
+    //The state of qrand() can't be read, so it's reseeded with a number drawn from itself
+    uint seed = qrand();
+    qsrand(seed);
+    data["seed"] = seed;
+
+    data["mode"] = m_mode ? m_mode->name() : QString();
+    data["round"] = m_round;
+    data["reshufflingCount"] = m_reshufflingCount;
+    data["currentPlayerId"] = m_currentPlayer ? m_currentPlayer->id() : 0;
+
+    QVariantList extraTurns;
+    foreach (ServerPlayer *player, m_extraTurns)
+        extraTurns << player->id();
+    data["extraTurns"] = extraTurns;
+
+    data["drawPile"] = snapshotCards(m_drawPile);
+    data["discardPile"] = snapshotCards(m_discardPile);
+    data["table"] = snapshotCards(m_table);
+    data["wugu"] = snapshotCards(m_wugu);
+
+    QVariantList playerList;
+    QList<ServerPlayer *> players = this->players();
+    foreach (ServerPlayer *player, players) {
+        QVariantMap playerData = player->snapshot().toMap();
+        playerData["handcards"] = snapshotCards(player->handcardArea());
+        playerData["equips"] = snapshotCards(player->equipArea());
+        playerData["delayedTricks"] = snapshotCards(player->delayedTrickArea());
+        playerData["judgeCards"] = snapshotCards(player->judgeCards());
+        playerList << playerData;
+    }
+    data["players"] = playerList;
+
+    return data;
+}
+
+bool GameLogic::restore(const QVariant &snapshot)
+{
+    const QVariantMap data = snapshot.toMap();
+
+    Engine *engine = Engine::instance();
+    const GameMode *mode = engine->mode(data["mode"].toString());
+    if (mode == nullptr)
+        return false;
+
+    QList<ServerPlayer *> players = this->players();
+    const QVariantList playerList = data["players"].toList();
+    if (players.length() != playerList.length())
+        return false;
+
+    loadMode(mode);
+    loadCards();
+
+    //Players are matched by their users first, then by their agents, then by order. Agent ids
+    //only hold within a process, while users keep their screen names in a migrated game.
+    //Player ids in tags are kept as they are.
+    QList<ServerPlayer *> freePlayers = players;
+    QList<ServerPlayer *> matchedPlayers;
+    foreach (const QVariant &playerData, playerList) {
+        const QVariantMap playerMap = playerData.toMap();
+        QString screenName = playerMap["screenName"].toString();
+        ServerPlayer *matched = nullptr;
+        if (!screenName.isEmpty()) {
+            foreach (ServerPlayer *player, freePlayers) {
+                if (player->isHuman() && player->agent()->screenName() == screenName) {
+                    matched = player;
+                    break;
+                }
+            }
+        }
+
+        uint agentId = playerMap["agentId"].toUInt();
+        if (matched == nullptr) {
+            foreach (ServerPlayer *player, freePlayers) {
+                CServerAgent *agent = player->agent();
+                if (agent && agent->id() == agentId) {
+                    matched = player;
+                    break;
+                }
+            }
+        }
+        freePlayers.removeOne(matched);
+        matchedPlayers << matched;
+    }
+
+    QMap<uint, ServerPlayer *> idToPlayer;
+    for (int i = 0; i < playerList.length(); i++) {
+        ServerPlayer *player = matchedPlayers.at(i);
+        if (player == nullptr) {
+            player = freePlayers.takeFirst();
+            matchedPlayers[i] = player;
+        }
+
+        const QVariantMap playerData = playerList.at(i).toMap();
+        idToPlayer[playerData["id"].toUInt()] = player;
+        player->restore(playerData);
+        restoreCards(player->handcardArea(), playerData["handcards"]);
+        restoreCards(player->equipArea(), playerData["equips"]);
+        restoreCards(player->delayedTrickArea(), playerData["delayedTricks"]);
+        restoreCards(player->judgeCards(), playerData["judgeCards"]);
+    }
+
+    std::sort(matchedPlayers.begin(), matchedPlayers.end(), [](const ServerPlayer *a, const ServerPlayer *b){
+        return a->seat() < b->seat();
+    });
+    for (int i = 1; i < matchedPlayers.length(); i++)
+        matchedPlayers.at(i - 1)->setNext(matchedPlayers.at(i));
+    matchedPlayers.last()->setNext(matchedPlayers.first());
+
+    setCurrentPlayer(idToPlayer.value(data["currentPlayerId"].toUInt(), matchedPlayers.first()));
+    m_extraTurns.clear();
+    const QVariantList extraTurns = data["extraTurns"].toList();
+    foreach (const QVariant &playerId, extraTurns) {
+        ServerPlayer *player = idToPlayer.value(playerId.toUInt());
+        if (player)
+            m_extraTurns << player;
+    }
+
+    m_round = data["round"].toInt();
+    m_reshufflingCount = data["reshufflingCount"].toInt();
+
+    restoreCards(m_drawPile, data["drawPile"]);
+    restoreCards(m_discardPile, data["discardPile"]);
+    restoreCards(m_table, data["table"]);
+    restoreCards(m_wugu, data["wugu"]);
+
+    m_seed = data["seed"].toUInt();
+    m_restored = true;
+    return true;
+}
+
 CAbstractPlayer *GameLogic::createPlayer(CServerAgent *agent)
 {
     return new ServerPlayer(this, agent);
@@ -749,6 +1429,7 @@ CAbstractPlayer *GameLogic::createPlayer(CServerAgent *agent)
 
 void GameLogic::loadMode(const GameMode *mode)
 {
+    m_mode = mode;
     setGameRule(mode->rule());
 
     QList<const EventHandler *> rules = mode->extraRules();
@@ -766,13 +1447,13 @@ const RoomSettings *GameLogic::settings() const
 
 void GameLogic::prepareToStart()
 {
-    CRoom *room = this->room();
-
     //Load game mode
     Engine *engine = Engine::instance();
     const GameMode *mode = engine->mode(settings()->mode);
     loadMode(mode);
 
+    startRecording();
+
     //Arrange seats for all the players
     QList<ServerPlayer *> players = this->players();
     qShuffle(players);
@@ -791,35 +1472,265 @@ void GameLogic::prepareToStart()
         QVariantMap info;
         info["agentId"] = agent->id();
         info["playerId"] = player->id();
+        info["screenName"] = agent->screenName();
         playerList << info;
     }
-    room->broadcastNotification(S_COMMAND_ARRANGE_SEAT, playerList);
-
-    //Import packages
-    GeneralList generals;
-    foreach (const Package *package, m_packages) {
-        generals << package->generals();
+    broadcastNotification(S_COMMAND_ARRANGE_SEAT, playerList);
 
-        QList<const Card *> cards = package->cards();
-        foreach (const Card *card, cards)
-            m_cards.insert(card->id(), card->clone());
-    }
+    loadCards();
 
     //Prepare cards
     QVariantList cardData;
     foreach (const Card *card, m_cards)
         cardData << card->id();
-    room->broadcastNotification(S_COMMAND_PREPARE_CARDS, cardData);
+    broadcastNotification(S_COMMAND_PREPARE_CARDS, cardData);
 
-    foreach (Card *card, m_cards) {
+    QList<Card *> cards = m_cards.values();
+    qShuffle(cards);
+    foreach (Card *card, cards) {
         m_drawPile->add(card);
         m_cardPosition[card] = m_drawPile;
     }
-    qShuffle(m_drawPile->cards());
 
     m_gameRule->prepareToStart(this);
 }
 
+void GameLogic::loadCards()
+{
+    foreach (const Package *package, m_packages) {
+        QList<const Card *> cards = package->cards();
+        foreach (const Card *card, cards)
+            m_cards.insert(card->id(), card->clone());
+    }
+}
+
+void GameLogic::startRecording()
+{
+    QString directory = ReplayRecorder::OutputDirectory();
+    if (directory.isEmpty())
+        return;
+
+    ReplayHeader header;
+    header.roomId = room()->id();
+    header.seed = m_seed;
+    header.startTime = QDateTime::currentMSecsSinceEpoch();
+    header.mode = settings()->mode;
+    foreach (const Package *package, m_packages)
+        header.packages << package->name();
+
+    QString fileName = QString("%1/room%2-%3.qsr")
+            .arg(directory)
+            .arg(room()->id())
+            .arg(QDateTime::currentDateTime().toString("yyyyMMddhhmmss"));
+    m_recorder = new ReplayRecorder(fileName, header);
+    m_recorder->start(QThread::LowPriority);
+}
+
+void GameLogic::checkpoint()
+{
+    if (m_journal == nullptr)
+        m_journal = new UndoJournal;
+    if (m_journal->depth() == 0)
+        UndoJournal::SetCurrent(m_journal);
+    m_journal->checkpoint();
+
+    //The state of qrand() can't be read, so it's reseeded as snapshot() does
+    uint seed = qrand();
+    qsrand(seed);
+
+    //These are small or implicitly shared, so they're copied once instead of being journaled
+    //where they're changed
+    EventType interruption = m_interruption;
+    ServerPlayer *currentPlayer = m_currentPlayer;
+    QList<ServerPlayer *> extraTurns = m_extraTurns;
+    int round = m_round;
+    int reshufflingCount = m_reshufflingCount;
+    QMap<Card *, CardArea *> cardPosition = m_cardPosition;
+    QList<QList<const EventHandler *>> handlers;
+    for (int i = 0; i < EventTypeCount; i++)
+        handlers << m_handlers[i];
+    QList<ServerPlayer *> players = this->players();
+    QList<QMap<QString, QVariant>> tags;
+    foreach (ServerPlayer *player, players)
+        tags << player->tag;
+
+    m_journal->record([=](){
+        qsrand(seed);
+        m_interruption = interruption;
+        m_currentPlayer = currentPlayer;
+        m_extraTurns = extraTurns;
+        m_round = round;
+        m_reshufflingCount = reshufflingCount;
+        m_cardPosition = cardPosition;
+        for (int i = 0; i < EventTypeCount; i++)
+            m_handlers[i] = handlers.at(i);
+        for (int i = 0; i < players.length(); i++)
+            players.at(i)->tag = tags.at(i);
+    });
+}
+
+void GameLogic::rollback()
+{
+    if (m_journal == nullptr)
+        return;
+    m_journal->rollback();
+    endSpeculation();
+}
+
+void GameLogic::commit()
+{
+    if (m_journal == nullptr)
+        return;
+    m_journal->commit();
+    endSpeculation();
+}
+
+bool GameLogic::isSpeculating() const
+{
+    return m_journal && m_journal->depth() > 0;
+}
+
+void GameLogic::shuffleHiddenCards(const ServerPlayer *viewer)
+{
+    QList<CardArea *> areas;
+    QList<ServerPlayer *> players = this->players();
+    foreach (ServerPlayer *player, players) {
+        if (player != viewer)
+            areas << player->handcardArea();
+    }
+    areas << m_drawPile;
+
+    QList<Card *> cards;
+    QList<int> cardNums;
+    foreach (CardArea *area, areas) {
+        cardNums << area->length();
+        cards << area->cards();
+        area->clear();
+    }
+    qShuffle(cards);
+
+    int index = 0;
+    for (int i = 0; i < areas.length(); i++) {
+        CardArea *area = areas.at(i);
+        QList<Card *> dealt = cards.mid(index, cardNums.at(i));
+        index += dealt.length();
+        area->add(dealt);
+        foreach (Card *card, dealt)
+            m_cardPosition[card] = area;
+    }
+}
+
+QList<BeliefTracker *> GameLogic::beliefTrackers()
+{
+    QList<BeliefTracker *> beliefs;
+    if (!isSpeculating()) {
+        QList<ServerPlayer *> viewers = players();
+        foreach (ServerPlayer *viewer, viewers) {
+            if (viewer->isNativeRobot())
+                beliefs << viewer->ai()->belief();
+        }
+    }
+    return beliefs;
+}
+
+void GameLogic::endSpeculation()
+{
+    if (m_journal->depth() == 0 && UndoJournal::Current() == m_journal)
+        UndoJournal::SetCurrent(nullptr);
+}
+
+QVariant GameLogic::resyncState(const ServerPlayer *viewer) const
+{
+    QVariantMap state;
+
+    QVariantList cards;
+    foreach (uint id, m_cards.keys())
+        cards << id;
+    state["cards"] = cards;
+    state["selfId"] = viewer ? viewer->id() : 0;
+
+    QList<ServerPlayer *> players = this->players();
+    std::sort(players.begin(), players.end(), [](const ServerPlayer *a, const ServerPlayer *b){
+        return a->seat() < b->seat();
+    });
+
+    QVariantList playerList;
+    foreach (const ServerPlayer *player, players)
+        playerList << player->resyncState(viewer);
+    state["players"] = playerList;
+
+    QVariantList wugu;
+    foreach (const Card *card, m_wugu->cards())
+        wugu << card->id();
+    QVariantMap wuguData;
+    wuguData["cards"] = wugu;
+    state["wugu"] = wuguData;
+
+    return state;
+}
+
+QVariant GameLogic::snapshotCards(const CardArea *area) const
+{
+    QVariantList data;
+    foreach (const Card *card, area->cards()) {
+        if (!card->isVirtual()) {
+            data << card->id();
+            continue;
+        }
+
+        //Virtual cards (converted by skills) are kept in equip and delayed trick areas
+        QVariantMap virtualCard;
+        virtualCard["className"] = card->metaObject()->className();
+        virtualCard["suit"] = card->suit();
+        virtualCard["number"] = card->number();
+        virtualCard["skillId"] = card->skill() ? card->skill()->id() : 0;
+        QVariantList subcards;
+        foreach (const Card *subcard, card->subcards())
+            subcards << subcard->id();
+        virtualCard["subcards"] = subcards;
+        data << virtualCard;
+    }
+    return data;
+}
+
+void GameLogic::restoreCards(CardArea *area, const QVariant &data)
+{
+    Engine *engine = Engine::instance();
+    const QVariantList cards = data.toList();
+    foreach (const QVariant &cardData, cards) {
+        Card *card = nullptr;
+        if (cardData.type() != QVariant::Map) {
+            card = findCard(cardData.toUInt());
+        } else {
+            const QVariantMap virtualCard = cardData.toMap();
+            QByteArray className = virtualCard["className"].toByteArray();
+            const QList<const Card *> prototypes = engine->getCards();
+            foreach (const Card *prototype, prototypes) {
+                if (className != prototype->metaObject()->className())
+                    continue;
+                Card::Suit suit = static_cast<Card::Suit>(virtualCard["suit"].toInt());
+                int number = virtualCard["number"].toInt();
+                //Constructors are registered as (Suit, int), the same as Card::clone()
+                card = qobject_cast<Card *>(prototype->metaObject()->newInstance(QArgument<Card::Suit>("Suit", suit), Q_ARG(int, number)));
+                break;
+            }
+            if (card == nullptr)
+                continue;
+
+            card->setSkill(engine->getSkill(virtualCard["skillId"].toUInt()));
+            const QVariantList subcards = virtualCard["subcards"].toList();
+            foreach (const QVariant &subcardId, subcards) {
+                Card *subcard = findCard(subcardId.toUInt());
+                if (subcard)
+                    card->addSubcard(subcard);
+            }
+        }
+
+        if (card && area->add(card))
+            m_cardPosition[card] = area;
+    }
+}
+
 CardArea *GameLogic::findArea(const CardsMoveStruct::Area &area)
 {
     if (area.owner) {
@@ -876,7 +1787,7 @@ void GameLogic::filterCardsMove(QList<CardsMoveStruct> &moves)
                         data["cardName"] = card->metaObject()->className();
                         data["area"] = source->toVariant();
                         data["exists"] = false;
-                        room()->broadcastNotification(S_COMMAND_SET_VIRTUAL_CARD, data);
+                        broadcastNotification(S_COMMAND_SET_VIRTUAL_CARD, data);
                     }
                     m_cardPosition.remove(card);
                 }
@@ -888,7 +1799,7 @@ void GameLogic::filterCardsMove(QList<CardsMoveStruct> &moves)
                     data["cardName"] = card->metaObject()->className();
                     data["area"] = destination->toVariant();
                     data["exists"] = true;
-                    room()->broadcastNotification(S_COMMAND_SET_VIRTUAL_CARD, data);
+                    broadcastNotification(S_COMMAND_SET_VIRTUAL_CARD, data);
                 }
             }
         }
@@ -926,52 +1837,128 @@ void GameLogic::filterCardsMove(QList<CardsMoveStruct> &moves)
 
 void GameLogic::run()
 {
-    qsrand((uint) QDateTime::currentMSecsSinceEpoch());
+    //What the thread allocates and the CPU time it uses are charged to the room
+    HeapAccount::SetCurrent(m_heap);
+    m_threadCpuStart = qThreadCpuTime();
+
+    //A game handed over by another process resumes here if its users are the same
+    if (!m_restored && RoomMigration::ArrivalNum() > 0) {
+        QVariantMap arrival = RoomMigration::TakeArrival(userNames());
+        if (!arrival.isEmpty()) {
+            if (restore(arrival["snapshot"])) {
+                //Users get the table in one frame instead of the notifications of a new game
+                QList<ServerPlayer *> players = this->players();
+                foreach (ServerPlayer *player, players)
+                    player->requestResync();
+                requestResync();
+            } else {
+                qWarning("Room(%u) failed to resume the game migrated from room(%u).", room()->id(), arrival["roomId"].toUInt());
+            }
+        }
+    }
 
-    prepareToStart();
+    if (!m_restored)
+        m_seed = (uint) QDateTime::currentMSecsSinceEpoch();
+    qsrand(m_seed);
 
-    //@to-do: Turn broken event
-    QList<ServerPlayer *> allPlayers = this->allPlayers();
-    foreach (ServerPlayer *player, allPlayers)
-        trigger(GameStart, player);
+    if (!GameTracer::OutputDirectory().isEmpty())
+        m_tracer = new GameTracer(room()->id());
+
+    //A restored game resumes from a new turn of the current player, in the same round
+    bool resuming = m_restored;
+    if (m_restored) {
+        startRecording();
+    } else {
+        prepareToStart();
+
+        //@to-do: Turn broken event
+        QList<ServerPlayer *> allPlayers = this->allPlayers();
+        foreach (ServerPlayer *player, allPlayers)
+            trigger(GameStart, player);
+    }
+
+    countPlayers();
 
     forever {
-        try {
-            ServerPlayer *current = currentPlayer();
-            forever {
-                if (current->seat() == 1)
-                    m_round++;
-                if (current->isDead()) {
-                    current = current->next();
-                    continue;
-                }
+        ServerPlayer *current = currentPlayer();
+        while (!isInterrupted()) {
+            updateCpuTime();
+            if (m_killed.load()) {
+                interrupt(GameFinish);
+                break;
+            }
 
-                setCurrentPlayer(current);
-                trigger(TurnStart, current);
+            //A new turn is the point where a snapshot holds the whole game
+            setCurrentPlayer(current);
+            if (handOver())
+                break;
+            if (isIdle()) {
+                hibernate();
+                if (isInterrupted())
+                    break;
+                current = currentPlayer();
+                continue;
+            }
+
+            if (current->seat() == 1 && !resuming)
+                m_round++;
+            resuming = false;
+            if (current->isDead()) {
                 current = current->next();
+                continue;
+            }
 
-                while (!m_extraTurns.isEmpty()) {
-                    ServerPlayer *extra = m_extraTurns.takeFirst();
-                    setCurrentPlayer(extra);
+            setCurrentPlayer(current);
+            {
+                GameTracer::Span span(m_tracer, "turn");
+                span.addArgument("player", current->id());
+                if (m_recorder)
+                    m_recorder->record(ReplayFrame::Turn, 0, m_round, current->id());
+                trigger(TurnStart, current);
+            }
+            if (isInterrupted())
+                break;
+            current = current->next();
+
+            while (!m_extraTurns.isEmpty()) {
+                ServerPlayer *extra = m_extraTurns.takeFirst();
+                setCurrentPlayer(extra);
+                {
+                    GameTracer::Span span(m_tracer, "turn");
+                    span.addArgument("player", extra->id());
+                    if (m_recorder)
+                        m_recorder->record(ReplayFrame::Turn, 0, m_round, extra->id());
                     trigger(TurnStart, extra);
                 }
+                if (isInterrupted())
+                    break;
             }
-        } catch (EventType event) {
-            if (event == GameFinish) {
-                return;
-            } else if (event == TurnBroken) {
-                ServerPlayer *current = currentPlayer();
-                trigger(TurnBroken, current);
-                ServerPlayer *next = current->nextAlive(1, false);
-                if (current->phase() != Player::Inactive) {
-                    QVariant data;
-                    m_gameRule->effect(this, PhaseEnd, current, data, current);
-                    //@todo:
-                    current->setPhase(Player::Inactive);
-                    current->broadcastProperty("phase");
-                }
-                setCurrentPlayer(next);
+        }
+
+        EventType event = takeInterruption();
+        if (event == GameFinish) {
+            flushNotifications();
+            Metrics::AddGameFinished();
+            m_cpuBase = m_cpuUsecs.load();
+            m_threadCpuStart = -1;
+            HeapAccount::SetCurrent(nullptr);
+            if (m_tracer)
+                m_tracer->flush();
+            if (m_recorder)
+                m_recorder->close();
+            return;
+        } else if (event == TurnBroken) {
+            ServerPlayer *current = currentPlayer();
+            trigger(TurnBroken, current);
+            ServerPlayer *next = current->nextAlive(1, false);
+            if (current->phase() != Player::Inactive) {
+                QVariant data;
+                m_gameRule->effect(this, PhaseEnd, current, data, current);
+                //@todo:
+                current->setPhase(Player::Inactive);
+                current->broadcastProperty("phase");
             }
+            setCurrentPlayer(next);
         }
     }
 }
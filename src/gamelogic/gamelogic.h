@@ -26,13 +26,27 @@
 
 #include <CAbstractGameLogic>
 
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QWaitCondition>
+
+class BeliefTracker;
 class Card;
 class CardArea;
 class GameRule;
+class GameTracer;
+class HeapAccount;
 class GameMode;
 class ServerPlayer;
 class Package;
+class ReplayRecorder;
+class ReplyStatistics;
 class RoomSettings;
+class SpectatorChannel;
+class TriggerProfiler;
+class UndoJournal;
 
 class GameLogic : public CAbstractGameLogic
 {
@@ -54,6 +68,34 @@ public:
     bool trigger(EventType event, ServerPlayer *target);
     bool trigger(EventType event, ServerPlayer *target, QVariant &data);
 
+    //It's null unless TriggerProfiler is enabled when the room is created
+    const TriggerProfiler *profiler() const { return m_profiler; }
+
+    //It's null unless an output directory is set for GameTracer when the game starts,
+    //and while speculating
+    GameTracer *tracer() const { return isSpeculating() ? nullptr : m_tracer; }
+
+    ReplyStatistics *replyStatistics() const { return m_replyStatistics; }
+
+    //It's null unless an output directory is set for ReplayRecorder when the game starts
+    ReplayRecorder *recorder() const { return m_recorder; }
+
+    uint seed() const { return m_seed; }
+
+    //Public notifications and card moves are published to it. It lives in the thread that
+    //created the logic, the one of Server, which writes the stream off the game thread.
+    SpectatorChannel *spectators() const { return m_spectators; }
+
+    //Notifications must be sent through GameLogic or ServerPlayer so that they can be recorded
+    void broadcastNotification(int command, const QVariant &data = QVariant(), CServerAgent *except = nullptr);
+
+    //Notifications to each agent are held and sent as one S_COMMAND_BATCH when the game thread
+    //is about to block, or once the oldest of them has waited for the window. 0 disables batching,
+    //which is the default as clients older than S_COMMAND_BATCH can't unpack it.
+    static int BatchWindow();
+    static void SetBatchWindow(int msecs);
+    void flushNotifications();
+
     void setCurrentPlayer(ServerPlayer *player) { m_currentPlayer = player; }
     ServerPlayer *currentPlayer() const { return m_currentPlayer; }
 
@@ -70,6 +112,14 @@ public:
 
     bool skipGameRule() const { return m_skipGameRule; }
 
+    //Interrupts the current turn (TurnBroken, StageChange) or the whole game (GameFinish).
+    //trigger(), useCard(), damage() and ServerPlayer::play() return as soon as it is set,
+    //and run() handles it once the stack is back to the turn loop.
+    void interrupt(EventType reason);
+    EventType interruption() const { return m_interruption; }
+    bool isInterrupted() const { return m_interruption != InvalidEvent; }
+    EventType takeInterruption();
+
     Card *getDrawPileCard();
     QList<Card *> getDrawPileCards(int n);
     void reshuffleDrawPile();
@@ -103,28 +153,145 @@ public:
 
     QMap<uint, QList<const General *> > broadcastRequestForGenerals(const QList<ServerPlayer *> &players, int num, int limit);
 
+    //A snapshot holds the state of the game: card areas, players, the current player, round,
+    //reshuffling count and a seed for qrand(). It must be taken in the thread of the game logic,
+    //as qrand() is reseeded. The stack of the current turn isn't saved.
+    QVariant snapshot();
+
+    //Restores a snapshot into a logic that hasn't started yet. No notification is sent.
+    //When the logic starts, the game resumes from a new turn of the current player.
+    bool restore(const QVariant &snapshot);
+
+    //Speculative execution. Changes to card areas, players and the logic after a checkpoint
+    //can be rolled back or committed. Checkpoints can be nested and must be used in the thread
+    //of the game logic. No notification or request is sent while speculating, and
+    //ServerPlayer::waitForReply() returns a null reply.
+    void checkpoint();
+    void rollback();
+    void commit();
+    bool isSpeculating() const;
+
+    //Redeals the cards the viewer can't see, which are the handcards of other players and the
+    //draw pile, keeping the number of cards in each area. It's meant for speculation.
+    void shuffleHiddenCards(const ServerPlayer *viewer);
+
+    //The table as the viewer sees it, in the format of Client::saveState().
+    //The viewer is null for the public view.
+    QVariant resyncState(const ServerPlayer *viewer) const;
+
+    //Makes the next broadcast send resync frames to the players whose agent has changed.
+    //It can be called from any thread.
+    void requestResync() { m_resyncPending.store(1); }
+
+    //A game whose human players have all been disconnected for the threshold in milliseconds
+    //hibernates at the start of the next turn: its state is kept as a compressed snapshot, the
+    //cards are freed and the thread sleeps until wake(). 0 disables hibernation.
+    static int HibernationThreshold();
+    static void SetHibernationThreshold(int msecs);
+
+    bool isHibernating() const;
+    //The size in bytes of the snapshot of a hibernating game
+    int hibernatedSize() const;
+
+    //Resumes a hibernating game from its snapshot. It can be called from any thread.
+    void wake();
+
+    //Hands the game over to the process listening on the target socket at the start of the
+    //next turn, and then tells the users to connect to the host and port. It goes on here if
+    //the target doesn't accept it within a request timeout. It can be called from any thread.
+    void migrate(const QString &target, const QString &host, ushort port);
+
+    //Screen names of the users playing the game
+    QStringList userNames() const;
+
+    //Usage of the room for operators: CPU time of the game thread, heap bytes, messages sent,
+    //triggers and reshuffles. It can be called from any thread.
+    QVariantMap usage() const;
+
+    //Counts a message sent to the agents
+    void addMessage(int command, const QVariant &data, int agentNum = 1);
+
+    //Players of the game by the kind of their agents, kept by the game thread.
+    //They can be read from any thread.
+    int humanNum() const { return m_humanNum.load(); }
+    int robotNum() const { return m_robotNum.load(); }
+
+    //Finishes the game at the next trigger or turn. It can be called from any thread.
+    void kill();
+
+    //Sleeps for the microseconds at every trigger, to slow down a runaway room. 0 stops it.
+    //It can be called from any thread.
+    void setThrottle(int usecs);
+
 protected:
     CAbstractPlayer *createPlayer(CServerAgent *agent) override;
 
     void loadMode(const GameMode *mode);
 
     void prepareToStart();
+    void loadCards();
+    void startRecording();
     CardArea *findArea(const CardsMoveStruct::Area &area);
     void filterCardsMove(QList<CardsMoveStruct> &moves);
 
     void run();
 
 private:
+    QVariant snapshotCards(const CardArea *area) const;
+    void restoreCards(CardArea *area, const QVariant &data);
+    void endSpeculation();
+    //The beliefs of native robots, which aren't updated while speculating
+    QList<BeliefTracker *> beliefTrackers();
+    void updateCpuTime();
+    bool handOver();
+    bool isIdle();
+    void hibernate();
+    void releaseCards();
+    void countPlayers();
+
     QList<const EventHandler *> m_handlers[EventTypeCount];
     QList<ServerPlayer *> m_players;
     ServerPlayer *m_currentPlayer;
     QList<ServerPlayer *> m_extraTurns;
     const GameRule *m_gameRule;
+    const GameMode *m_mode;
     QList<const Package *> m_packages;
     QMap<uint, Card *> m_cards;
     bool m_skipGameRule;
+    EventType m_interruption;
+    TriggerProfiler *m_profiler;
+    GameTracer *m_tracer;
+    ReplyStatistics *m_replyStatistics;
+    ReplayRecorder *m_recorder;
+    SpectatorChannel *m_spectators;
+    uint m_seed;
+    bool m_restored;
     int m_round;
     int m_reshufflingCount;
+    UndoJournal *m_journal;
+    QAtomicInt m_resyncPending;
+
+    mutable QMutex m_hibernationMutex;
+    QWaitCondition m_wakeCondition;
+    bool m_hibernating;
+    int m_hibernatedSize;
+    QElapsedTimer m_idleTimer;
+    HeapAccount *m_heap;
+    qint64 m_cpuBase;
+    qint64 m_threadCpuStart;
+    QAtomicInteger<qint64> m_cpuUsecs;
+    QAtomicInteger<qint64> m_messageNum;
+    QAtomicInteger<qint64> m_messageBytes;
+    QAtomicInteger<qint64> m_triggerNum;
+    QAtomicInt m_reshuffleNum;
+    QAtomicInt m_killed;
+    QAtomicInt m_throttle;
+    QAtomicInt m_humanNum;
+    QAtomicInt m_robotNum;
+
+    QString m_migrationTarget;
+    QString m_redirectHost;
+    ushort m_redirectPort;
 
     CardArea *m_drawPile;
     CardArea *m_discardPile;
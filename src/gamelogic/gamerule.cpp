@@ -37,11 +37,14 @@ void onTurnStart(GameLogic *, ServerPlayer *current, QVariant &)
 
 void onPhaseProceeding(GameLogic *logic, ServerPlayer *current, QVariant &)
 {
-    GameLogic::msleep(500);
+    if (!logic->isSpeculating()) {
+        logic->flushNotifications();
+        GameLogic::msleep(500);
+    }
     switch (current->phase()) {
     case Player::Judge: {
         QList<Card *> tricks = current->delayedTrickArea()->cards();
-        while (tricks.length() > 0 && current->isAlive()) {
+        while (tricks.length() > 0 && current->isAlive() && !logic->isInterrupted()) {
             Card *trick = tricks.takeLast();
 
             if (trick->type() == Card::TrickType && trick->subtype() == TrickCard::DelayedType) {
@@ -143,6 +146,9 @@ void onAfterHpReduced(GameLogic *logic, ServerPlayer *victim, QVariant &data)
         logic->trigger(AskForPeachDone, victim, dyingData);
     }
 
+    if (logic->isInterrupted())
+        return;
+
     victim->setDying(false);
     victim->broadcastProperty("dying");
     logic->trigger(QuitDying, victim, dyingData);
@@ -151,7 +157,7 @@ void onAfterHpReduced(GameLogic *logic, ServerPlayer *victim, QVariant &data)
 void onAskForPeach(GameLogic *logic, ServerPlayer *current, QVariant &data)
 {
     DeathStruct *dying = data.value<DeathStruct *>();
-    while (dying->who->hp() <= 0) {
+    while (dying->who->hp() <= 0 && !logic->isInterrupted()) {
         Card *peach = nullptr;
         if (dying->who->isAlive()) {
             int peachNum = 1 - dying->who->hp();
@@ -212,10 +218,12 @@ bool GameRule::effect(GameLogic *logic, EventType event, ServerPlayer *current,
         return false;
 
     Callback func = m_callbacks[event];
-    if (func)
+    if (func) {
         (*func)(logic, current, data);
-    else
-        throw GameFinish;
+    } else {
+        logic->interrupt(GameFinish);
+        return true;
+    }
 
     return false;
 }
@@ -0,0 +1,147 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+
+#include "gametracer.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+
+namespace {
+
+QMutex DirectoryMutex;
+QString Directory;
+
+}
+
+GameTracer::Span::Span(GameTracer *tracer, const char *name, const char *category)
+    : m_tracer(tracer)
+    , m_index(tracer ? tracer->begin(name, category) : -1)
+{
+}
+
+GameTracer::Span::~Span()
+{
+    if (m_tracer)
+        m_tracer->end(m_index);
+}
+
+void GameTracer::Span::addArgument(const char *name, qint64 value)
+{
+    if (m_tracer == nullptr)
+        return;
+
+    Record &record = m_tracer->m_records[m_index];
+    if (record.argumentNum >= 2)
+        return;
+    record.argumentNames[record.argumentNum] = name;
+    record.argumentValues[record.argumentNum] = value;
+    record.argumentNum++;
+}
+
+GameTracer::GameTracer(uint roomId)
+    : m_roomId(roomId)
+{
+    m_records.reserve(4096);
+    m_timer.start();
+}
+
+QString GameTracer::OutputDirectory()
+{
+    QMutexLocker locker(&DirectoryMutex);
+    return Directory;
+}
+
+void GameTracer::SetOutputDirectory(const QString &directory)
+{
+    QMutexLocker locker(&DirectoryMutex);
+    Directory = directory;
+}
+
+int GameTracer::begin(const char *name, const char *category)
+{
+    Record record;
+    record.name = name;
+    record.category = category;
+    record.begin = m_timer.nsecsElapsed();
+    record.end = -1;
+    record.argumentNum = 0;
+    m_records.append(record);
+    return m_records.length() - 1;
+}
+
+void GameTracer::end(int index)
+{
+    m_records[index].end = m_timer.nsecsElapsed();
+}
+
+bool GameTracer::flush()
+{
+    QString directory = OutputDirectory();
+    if (directory.isEmpty() || m_records.isEmpty())
+        return false;
+
+    QDir().mkpath(directory);
+    QString fileName = QString("%1/room%2-%3.json")
+            .arg(directory)
+            .arg(m_roomId)
+            .arg(QDateTime::currentDateTime().toString("yyyyMMddhhmmss"));
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate)) {
+        qWarning("Failed to write the trace file %s", qPrintable(fileName));
+        return false;
+    }
+
+    qint64 now = m_timer.nsecsElapsed();
+    qint64 pid = QCoreApplication::applicationPid();
+
+    file.write("{\"traceEvents\":[\n");
+    for (int i = 0; i < m_records.length(); i++) {
+        const Record &record = m_records.at(i);
+        qint64 end = record.end >= 0 ? record.end : now;
+
+        QByteArray line = QString("{\"name\":\"%1\",\"cat\":\"%2\",\"ph\":\"X\",\"pid\":%3,\"tid\":%4,\"ts\":%5,\"dur\":%6")
+                .arg(record.name)
+                .arg(record.category)
+                .arg(pid)
+                .arg(m_roomId)
+                .arg(record.begin / 1000.0, 0, 'f', 3)
+                .arg((end - record.begin) / 1000.0, 0, 'f', 3)
+                .toUtf8();
+        if (record.argumentNum > 0) {
+            line.append(",\"args\":{");
+            for (int j = 0; j < record.argumentNum; j++) {
+                if (j > 0)
+                    line.append(',');
+                line.append('"').append(record.argumentNames[j]).append("\":").append(QByteArray::number(record.argumentValues[j]));
+            }
+            line.append('}');
+        }
+        line.append(i < m_records.length() - 1 ? "},\n" : "}\n");
+        file.write(line);
+    }
+    file.write("]}\n");
+
+    m_records.clear();
+    return true;
+}
@@ -0,0 +1,80 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+
+#ifndef GAMETRACER_H
+#define GAMETRACER_H
+
+#include <QElapsedTimer>
+#include <QString>
+#include <QVector>
+
+/* Records nested spans of a game (turns, phases, triggered events, card uses, damages,
+ * card moves and waiting for replies) and writes them in the Chrome trace event format,
+ * which can be loaded by chrome://tracing or Perfetto.
+ *
+ * A tracer belongs to one room and is only written by the thread running its GameLogic,
+ * so records are appended without any lock and written to the file when the game ends.
+ */
+class GameTracer
+{
+public:
+    class Span
+    {
+    public:
+        Span(GameTracer *tracer, const char *name, const char *category = "game");
+        ~Span();
+
+        //Names must be string literals. At most 2 arguments are kept.
+        void addArgument(const char *name, qint64 value);
+
+    private:
+        GameTracer *m_tracer;
+        int m_index;
+    };
+
+    GameTracer(uint roomId);
+
+    static QString OutputDirectory();
+    //Tracing is disabled if the directory is empty
+    static void SetOutputDirectory(const QString &directory);
+
+    bool flush();
+
+private:
+    struct Record
+    {
+        const char *name;
+        const char *category;
+        qint64 begin;
+        qint64 end;
+        int argumentNum;
+        const char *argumentNames[2];
+        qint64 argumentValues[2];
+    };
+
+    int begin(const char *name, const char *category);
+    void end(int index);
+
+    uint m_roomId;
+    QElapsedTimer m_timer;
+    QVector<Record> m_records;
+};
+
+#endif // GAMETRACER_H
@@ -0,0 +1,345 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+#include "card.h"
+#include "cardarea.h"
+#include "cardpattern.h"
+#include "gamelogic.h"
+#include "legalactions.h"
+#include "serverplayer.h"
+#include "skill.h"
+
+const int LegalActions::MaxSubcardNum = 4;
+
+LegalActions::Action::Action()
+    : skill(nullptr)
+{
+}
+
+QVariant LegalActions::Action::toVariant() const
+{
+    QVariantMap data;
+
+    QVariantList cardData;
+    foreach (const Card *card, cards)
+        cardData << card->id();
+    data["cards"] = cardData;
+
+    QVariantList to;
+    foreach (const ServerPlayer *target, targets)
+        to << target->id();
+    data["to"] = to;
+
+    data["skillId"] = skill ? skill->id() : 0;
+    return data;
+}
+
+LegalActions::LegalActions(ServerPlayer *player)
+    : m_player(player)
+    , m_logic(player->logic())
+    , m_candidates(m_logic->allPlayers())
+{
+}
+
+bool LegalActions::forEachUse(const Visitor &visitor, const QString &pattern, const QList<ServerPlayer *> &assignedTargets) const
+{
+    CardPattern p(pattern);
+    Action action;
+
+    QList<Card *> handcards = m_player->handcardArea()->cards();
+    foreach (Card *card, handcards) {
+        if (!pattern.isEmpty() && !p.match(m_player, card))
+            continue;
+        if (!card->isAvailable(m_player))
+            continue;
+
+        action.cards = QList<Card *>() << card;
+        if (!visitCard(card, action, visitor, assignedTargets))
+            return false;
+    }
+
+    QList<Card *> cards = ownedCards();
+    QList<const Skill *> skills = viewAsSkills();
+    foreach (const Skill *skill, skills) {
+        const ViewAsSkill *viewAsSkill = static_cast<const ViewAsSkill *>(skill);
+        if (!viewAsSkill->isAvailable(m_player, pattern))
+            continue;
+
+        action.skill = skill;
+        action.cards.clear();
+        action.targets.clear();
+        if (!visitSubcards(skill, pattern, cards, 0, action, visitor, &assignedTargets))
+            return false;
+    }
+
+    return true;
+}
+
+bool LegalActions::forEachResponse(const Visitor &visitor, const QString &pattern) const
+{
+    CardPattern p(pattern);
+    Action action;
+
+    QList<Card *> cards = ownedCards();
+    foreach (Card *card, cards) {
+        if (p.match(m_player, card)) {
+            action.cards = QList<Card *>() << card;
+            if (!visitor(action))
+                return false;
+        }
+    }
+
+    QList<const Skill *> skills = viewAsSkills();
+    foreach (const Skill *skill, skills) {
+        const ViewAsSkill *viewAsSkill = static_cast<const ViewAsSkill *>(skill);
+        if (skill->subtype() != ViewAsSkill::ConvertType || !viewAsSkill->isAvailable(m_player, pattern))
+            continue;
+
+        action.skill = skill;
+        action.cards.clear();
+        if (!visitSubcards(skill, pattern, cards, 0, action, visitor, nullptr))
+            return false;
+    }
+
+    return true;
+}
+
+bool LegalActions::forEachCards(const Visitor &visitor, const QString &pattern, int minNum, int maxNum) const
+{
+    CardPattern p(pattern);
+    QList<Card *> candidates;
+    QList<Card *> cards = ownedCards();
+    foreach (Card *card, cards) {
+        if (p.match(m_player, card))
+            candidates << card;
+    }
+
+    if (candidates.length() < minNum)
+        return true;
+
+    Action action;
+    return visitCardSets(candidates, 0, minNum, qMax(minNum, maxNum), action, visitor);
+}
+
+bool LegalActions::forEachChoice(const Visitor &visitor, ServerPlayer *owner, const QString &areaFlag, bool handcardVisible) const
+{
+    Action action;
+
+    if (areaFlag.contains('h')) {
+        if (handcardVisible) {
+            QList<Card *> cards = owner->handcardArea()->cards();
+            foreach (Card *card, cards) {
+                action.cards = QList<Card *>() << card;
+                if (!visitor(action))
+                    return false;
+            }
+        } else if (owner->handcardNum() > 0) {
+            action.cards.clear();
+            if (!visitor(action))
+                return false;
+        }
+    }
+
+    QList<Card *> cards;
+    if (areaFlag.contains('e'))
+        cards << owner->equipArea()->cards();
+    if (areaFlag.contains('j'))
+        cards << owner->delayedTrickArea()->cards();
+    foreach (Card *card, cards) {
+        action.cards = QList<Card *>() << card;
+        if (!visitor(action))
+            return false;
+    }
+
+    return true;
+}
+
+QList<LegalActions::Action> LegalActions::uses(int maxNum) const
+{
+    QList<Action> actions;
+    forEachUse([&](const Action &action){
+        actions << action;
+        return maxNum < 0 || actions.length() < maxNum;
+    });
+    return actions;
+}
+
+bool LegalActions::visitCard(const Card *card, Action &action, const Visitor &visitor, const PlayerList &assignedTargets) const
+{
+    action.targets.clear();
+    if (card->isTargetFixed())
+        return !assignedTargets.isEmpty() || visitor(action);
+
+    QList<const Player *> selected;
+    foreach (ServerPlayer *target, assignedTargets) {
+        if (!card->targetFilter(selected, target, m_player))
+            return true;
+        selected << target;
+        action.targets << target;
+    }
+
+    //A recast has no target
+    if (assignedTargets.isEmpty() && card->canRecast() && !visitor(action))
+        return false;
+
+    return visitTargets(card, selected, action, visitor);
+}
+
+bool LegalActions::visitTargets(const Card *card, QList<const Player *> &selected, Action &action, const Visitor &visitor) const
+{
+    if (!selected.isEmpty() && card->targetFeasible(selected, m_player) && !visitor(action))
+        return false;
+
+    foreach (ServerPlayer *candidate, m_candidates) {
+        if (selected.contains(candidate) || !card->targetFilter(selected, candidate, m_player))
+            continue;
+
+        selected << candidate;
+        action.targets << candidate;
+        bool finished = visitTargets(card, selected, action, visitor);
+        selected.removeLast();
+        action.targets.removeLast();
+        if (!finished)
+            return false;
+    }
+
+    return true;
+}
+
+bool LegalActions::visitSkillTargets(const Skill *skill, QList<const Player *> &selected, Action &action, const Visitor &visitor) const
+{
+    const ProactiveSkill *proactiveSkill = static_cast<const ProactiveSkill *>(skill);
+    if (proactiveSkill->playerFeasible(selected, m_player) && !visitor(action))
+        return false;
+
+    foreach (ServerPlayer *candidate, m_candidates) {
+        if (selected.contains(candidate) || !proactiveSkill->playerFilter(selected, candidate, m_player))
+            continue;
+
+        selected << candidate;
+        action.targets << candidate;
+        bool finished = visitSkillTargets(skill, selected, action, visitor);
+        selected.removeLast();
+        action.targets.removeLast();
+        if (!finished)
+            return false;
+    }
+
+    return true;
+}
+
+bool LegalActions::visitSubcards(const Skill *skill, const QString &pattern, const QList<Card *> &candidates, int from, Action &action, const Visitor &visitor, const PlayerList *assignedTargets) const
+{
+    //Proactive skills may need no card at all
+    if ((!action.cards.isEmpty() || skill->subtype() == ViewAsSkill::ProactiveType) && !visitViewAs(skill, pattern, action, visitor, assignedTargets))
+        return false;
+
+    if (action.cards.length() >= MaxSubcardNum)
+        return true;
+
+    const ViewAsSkill *viewAsSkill = static_cast<const ViewAsSkill *>(skill);
+    QList<const Card *> selected;
+    foreach (const Card *card, action.cards)
+        selected << card;
+
+    for (int i = from; i < candidates.length(); i++) {
+        Card *card = candidates.at(i);
+        if (!viewAsSkill->viewFilter(selected, card, m_player, pattern))
+            continue;
+
+        action.cards << card;
+        bool finished = visitSubcards(skill, pattern, candidates, i + 1, action, visitor, assignedTargets);
+        action.cards.removeLast();
+        if (!finished)
+            return false;
+    }
+
+    return true;
+}
+
+bool LegalActions::visitViewAs(const Skill *skill, const QString &pattern, Action &action, const Visitor &visitor, const PlayerList *assignedTargets) const
+{
+    if (skill->subtype() == ViewAsSkill::ProactiveType) {
+        const ProactiveSkill *proactiveSkill = static_cast<const ProactiveSkill *>(skill);
+        if (assignedTargets == nullptr || !assignedTargets->isEmpty() || !proactiveSkill->isValid(action.cards, m_player, pattern))
+            return true;
+
+        QList<const Player *> selected;
+        action.targets.clear();
+        return visitSkillTargets(skill, selected, action, visitor);
+    }
+
+    const ViewAsSkill *viewAsSkill = static_cast<const ViewAsSkill *>(skill);
+    Card *card = viewAsSkill->viewAs(action.cards, m_player);
+    if (card == nullptr)
+        return true;
+
+    bool finished = true;
+    if (pattern.isEmpty() || CardPattern(pattern).match(m_player, card)) {
+        if (assignedTargets) {
+            if (card->isAvailable(m_player))
+                finished = visitCard(card, action, visitor, *assignedTargets);
+        } else {
+            action.targets.clear();
+            finished = visitor(action);
+        }
+    }
+
+    delete card;
+    return finished;
+}
+
+bool LegalActions::visitCardSets(const QList<Card *> &candidates, int from, int minNum, int maxNum, Action &action, const Visitor &visitor) const
+{
+    if (action.cards.length() >= minNum && !visitor(action))
+        return false;
+
+    if (action.cards.length() >= maxNum)
+        return true;
+
+    for (int i = from; i < candidates.length(); i++) {
+        //Not enough cards are left to reach minNum
+        if (action.cards.length() + candidates.length() - i < minNum)
+            break;
+
+        action.cards << candidates.at(i);
+        bool finished = visitCardSets(candidates, i + 1, minNum, maxNum, action, visitor);
+        action.cards.removeLast();
+        if (!finished)
+            return false;
+    }
+
+    return true;
+}
+
+QList<Card *> LegalActions::ownedCards() const
+{
+    return m_player->handcardArea()->cards() + m_player->equipArea()->cards();
+}
+
+QList<const Skill *> LegalActions::viewAsSkills() const
+{
+    QList<const Skill *> skills;
+    QList<const Skill *> allSkills = m_player->skills() + m_player->acquiredSkills();
+    foreach (const Skill *skill, allSkills) {
+        if (skill->type() == Skill::ViewAsType)
+            skills << skill;
+    }
+    return skills;
+}
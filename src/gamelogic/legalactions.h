@@ -0,0 +1,100 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+#ifndef LEGALACTIONS_H
+#define LEGALACTIONS_H
+
+#include <QList>
+#include <QVariant>
+
+#include <functional>
+
+class Card;
+class GameLogic;
+class Player;
+class ServerPlayer;
+class Skill;
+
+/* Enumerates what a player can legally do at a decision point, using the same checks as the
+ * game logic: Card::isAvailable(), targetFilter() and targetFeasible(), the view filters of
+ * view-as skills and the card and player filters of proactive skills.
+ *
+ * Actions are generated one by one and passed to a visitor, which returns false to stop the
+ * enumeration. Candidates are pruned as soon as a filter rejects a partial selection.
+ * Targets are enumerated in every order the filters accept, since some cards depend on it.
+ */
+class LegalActions
+{
+public:
+    struct Action
+    {
+        Action();
+
+        //A view-as skill, or null if the cards are used directly
+        const Skill *skill;
+        //The selected cards. It's empty if a random hidden handcard is chosen.
+        QList<Card *> cards;
+        QList<ServerPlayer *> targets;
+
+        //The reply to S_COMMAND_ACT or S_COMMAND_ASK_FOR_CARD for this action
+        QVariant toVariant() const;
+    };
+
+    typedef std::function<bool(const Action &)> Visitor;
+
+    //Skills can't convert more cards than this
+    static const int MaxSubcardNum;
+
+    LegalActions(ServerPlayer *player);
+
+    //Cards and view-as skills that can be used in the play phase, or to answer askToUseCard()
+    //if a pattern is given. Assigned targets are always selected first. Ending the phase
+    //isn't included. They return false if the visitor stopped the enumeration.
+    bool forEachUse(const Visitor &visitor, const QString &pattern = QString(), const QList<ServerPlayer *> &assignedTargets = QList<ServerPlayer *>()) const;
+
+    //Cards and convert skills that can answer askForCard()
+    bool forEachResponse(const Visitor &visitor, const QString &pattern) const;
+
+    //Sets of minNum to maxNum cards matching the pattern, which answer askForCards()
+    bool forEachCards(const Visitor &visitor, const QString &pattern, int minNum, int maxNum) const;
+
+    //Cards that can be chosen by askToChooseCard()
+    bool forEachChoice(const Visitor &visitor, ServerPlayer *owner, const QString &areaFlag, bool handcardVisible) const;
+
+    QList<Action> uses(int maxNum = -1) const;
+
+private:
+    typedef QList<ServerPlayer *> PlayerList;
+
+    bool visitCard(const Card *card, Action &action, const Visitor &visitor, const PlayerList &assignedTargets) const;
+    bool visitTargets(const Card *card, QList<const Player *> &selected, Action &action, const Visitor &visitor) const;
+    bool visitSkillTargets(const Skill *skill, QList<const Player *> &selected, Action &action, const Visitor &visitor) const;
+    bool visitSubcards(const Skill *skill, const QString &pattern, const QList<Card *> &candidates, int from, Action &action, const Visitor &visitor, const PlayerList *assignedTargets) const;
+    bool visitViewAs(const Skill *skill, const QString &pattern, Action &action, const Visitor &visitor, const PlayerList *assignedTargets) const;
+    bool visitCardSets(const QList<Card *> &candidates, int from, int minNum, int maxNum, Action &action, const Visitor &visitor) const;
+
+    QList<Card *> ownedCards() const;
+    QList<const Skill *> viewAsSkills() const;
+
+    ServerPlayer *m_player;
+    GameLogic *m_logic;
+    QList<ServerPlayer *> m_candidates;
+};
+
+#endif // LEGALACTIONS_H
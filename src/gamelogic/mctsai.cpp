@@ -0,0 +1,233 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+#include "ai.h"
+#include "cardarea.h"
+#include "gamelogic.h"
+#include "mctsai.h"
+#include "serverplayer.h"
+
+#include <CRoom>
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <qmath.h>
+
+namespace {
+
+QAtomicInt Budget(0);
+QAtomicInt HalfSeats(0);
+QAtomicInt Turns(4);
+
+QMutex StatisticsMutex;
+qint64 RolloutNum = 0;
+qint64 RolloutMsecs = 0;
+
+//Stops the rest of the play phase from looping forever if a card can't be used
+const int MaxActNum = 20;
+
+//Cards with many target combinations are left to the heuristics beyond this
+const int MaxActionNum = 32;
+
+const double Exploration = 0.7;
+
+}
+
+MctsAi::Action::Action()
+    : move(nullptr)
+    , visits(0)
+    , totalScore(0.0)
+{
+}
+
+MctsAi::MctsAi(ServerPlayer *self)
+    : m_self(self)
+    , m_logic(self->logic())
+    , m_rolloutNum(0)
+{
+}
+
+int MctsAi::TimeBudget()
+{
+    return Budget.load();
+}
+
+void MctsAi::SetTimeBudget(int msecs)
+{
+    Budget.store(qMax(msecs, 0));
+}
+
+bool MctsAi::HalfSeatsOnly()
+{
+    return HalfSeats.load() != 0;
+}
+
+void MctsAi::SetHalfSeatsOnly(bool halfSeatsOnly)
+{
+    HalfSeats.store(halfSeatsOnly ? 1 : 0);
+}
+
+bool MctsAi::IsSearching(const ServerPlayer *robot)
+{
+    if (TimeBudget() <= 0)
+        return false;
+    if (!HalfSeatsOnly())
+        return true;
+    CRoom *room = robot->logic()->room();
+    uint roomId = room ? room->id() : 0;
+    return (robot->seat() + roomId) % 2 == 1;
+}
+
+int MctsAi::RolloutTurns()
+{
+    return Turns.load();
+}
+
+void MctsAi::SetRolloutTurns(int turns)
+{
+    Turns.store(qMax(turns, 0));
+}
+
+qint64 MctsAi::TotalRolloutNum()
+{
+    QMutexLocker locker(&StatisticsMutex);
+    return RolloutNum;
+}
+
+qint64 MctsAi::TotalRolloutMsecs()
+{
+    QMutexLocker locker(&StatisticsMutex);
+    return RolloutMsecs;
+}
+
+QVariant MctsAi::act()
+{
+    QList<LegalActions::Action> moves = LegalActions(m_self).uses(MaxActionNum);
+    if (moves.isEmpty())
+        return QVariant();
+
+    //Ending the play phase is always an option
+    QList<Action> actions;
+    actions << Action();
+    for (int i = 0; i < moves.length(); i++) {
+        Action action;
+        action.move = &moves[i];
+        actions << action;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    int budget = TimeBudget();
+
+    int iteration = 0;
+    do {
+        //Every action is tried once before UCB1 takes over
+        int chosen = 0;
+        if (iteration < actions.length()) {
+            chosen = iteration;
+        } else {
+            double logVisits = qLn(iteration);
+            double bestValue = -1.0;
+            for (int i = 0; i < actions.length(); i++) {
+                const Action &action = actions.at(i);
+                double value = action.totalScore / action.visits + Exploration * qSqrt(logVisits / action.visits);
+                if (value > bestValue) {
+                    bestValue = value;
+                    chosen = i;
+                }
+            }
+        }
+
+        Action &action = actions[chosen];
+        action.totalScore += rollout(action);
+        action.visits++;
+        iteration++;
+    } while (timer.elapsed() < budget);
+
+    m_rolloutNum = iteration;
+    {
+        QMutexLocker locker(&StatisticsMutex);
+        RolloutNum += iteration;
+        RolloutMsecs += timer.elapsed();
+    }
+
+    const Action *best = &actions.first();
+    foreach (const Action &action, actions) {
+        if (action.visits > best->visits)
+            best = &action;
+    }
+    return best->move ? best->move->toVariant() : QVariant();
+}
+
+double MctsAi::rollout(const Action &action)
+{
+    m_logic->checkpoint();
+    m_logic->shuffleHiddenCards(m_self);
+
+    if (action.move && !m_self->activate(action.move->toVariant())) {
+        for (int i = 0; i < MaxActNum && !m_logic->isInterrupted(); i++) {
+            if (m_self->activate())
+                break;
+        }
+    }
+
+    ServerPlayer *current = m_self;
+    int turns = RolloutTurns();
+    for (int i = 0; i < turns; i++) {
+        if (m_logic->isInterrupted()) {
+            if (m_logic->interruption() == GameFinish)
+                break;
+            m_logic->takeInterruption();
+        }
+
+        current = current->nextAlive();
+        if (current == nullptr || current == m_self)
+            break;
+        m_logic->setCurrentPlayer(current);
+        m_logic->trigger(TurnStart, current);
+    }
+
+    double score = evaluate();
+    m_logic->rollback();
+    return score;
+}
+
+double MctsAi::evaluate() const
+{
+    if (m_self->isDead())
+        return 0.0;
+
+    const Ai *ai = m_self->ai();
+    double score = 0.0;
+    QList<ServerPlayer *> players = m_logic->allPlayers(true);
+    foreach (const ServerPlayer *player, players) {
+        int relation = ai->relationTo(player);
+        if (relation == 0)
+            continue;
+
+        double value = player->isDead() ? -5.0 : player->hp() + 0.3 * player->handcardNum() + 0.2 * player->equipArea()->length();
+        score += relation > 0 ? value : -value;
+    }
+
+    //Squashes the score into (0, 1)
+    return 0.5 + qAtan(score / 10.0) / M_PI;
+}
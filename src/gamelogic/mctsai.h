@@ -0,0 +1,85 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+#ifndef MCTSAI_H
+#define MCTSAI_H
+
+#include "legalactions.h"
+
+class GameLogic;
+class ServerPlayer;
+
+/* Information set Monte Carlo search for the play phase of a robot.
+ *
+ * Each iteration picks a legal action with UCB1, redeals the cards the robot can't see,
+ * applies the action and plays a few more turns with the native AI for every player.
+ * Everything runs speculatively on the live game logic and is rolled back by the undo
+ * journal. The most visited action is chosen once the time budget runs out.
+ */
+class MctsAi
+{
+public:
+    MctsAi(ServerPlayer *self);
+
+    //Milliseconds per decision. The search is disabled if it's 0.
+    static int TimeBudget();
+    static void SetTimeBudget(int msecs);
+
+    //Only robots in every other seat search if it's set, so that the others play against them
+    //with the heuristics in the same games and the win rates of both can be compared. The seats
+    //alternate between rooms, as the lord always takes the first one.
+    static bool HalfSeatsOnly();
+    static void SetHalfSeatsOnly(bool halfSeatsOnly);
+
+    //Whether the play phase of the robot is searched
+    static bool IsSearching(const ServerPlayer *robot);
+
+    //Turns played after the current one in each rollout
+    static int RolloutTurns();
+    static void SetRolloutTurns(int turns);
+
+    //Process-wide statistics
+    static qint64 TotalRolloutNum();
+    static qint64 TotalRolloutMsecs();
+
+    //The reply to S_COMMAND_ACT in the play phase
+    QVariant act();
+
+    int rolloutNum() const { return m_rolloutNum; }
+
+private:
+    struct Action
+    {
+        Action();
+
+        //Ending the play phase if it's null
+        LegalActions::Action *move;
+        int visits;
+        double totalScore;
+    };
+
+    double rollout(const Action &action);
+    double evaluate() const;
+
+    ServerPlayer *m_self;
+    GameLogic *m_logic;
+    int m_rolloutNum;
+};
+
+#endif // MCTSAI_H
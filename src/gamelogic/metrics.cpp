@@ -0,0 +1,204 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+
+#include "metrics.h"
+
+#include <QAtomicInteger>
+#include <QList>
+#include <QMutex>
+
+#include <algorithm>
+
+namespace {
+
+typedef QAtomicInteger<qint64> Counter;
+
+//Labels of the enumerators in eventtype.h and protocol.h
+const char *const EventNames[] = {
+    "InvalidEvent", "GameStart", "GameFinish", "TurnStart", "PhaseStart", "PhaseProceeding",
+    "PhaseEnd", "PhaseChanging", "PhaseSkipping", "TurnBroken", "StageChange", "BeforeCardsMove",
+    "CardsMove", "AfterCardsMove", "DrawNCards", "AfterDrawNCards", "CountMaxCardNum",
+    "PreCardUsed", "CardUsed", "TargetChoosing", "TargetConfirming", "TargetChosen",
+    "TargetConfirmed", "CardEffect", "CardEffected", "PostCardEffected", "CardFinished",
+    "TrickCardCanceling", "CardResponded", "SlashEffect", "SlashEffected", "SlashProceed",
+    "SlashHit", "SlashMissed", "ConfirmDamage", "BeforeDamage", "DamageStart", "Damaging",
+    "Damaged", "AfterDamaging", "AfterDamaged", "DamageComplete", "BeforeRecover", "AfterRecover",
+    "HpLost", "AfterHpLost", "BeforeHpReduced", "AfterHpReduced", "MaxHpChanged", "StartJudge",
+    "AskForRetrial", "FinishRetrial", "FinishJudge", "SkillAdded", "SkillRemoved", "EnterDying",
+    "QuitDying", "AskForPeach", "AskForPeachDone", "BeforeGameOverJudge", "GameOverJudge", "Died",
+    "BuryVictim"
+};
+
+const char *const CommandNames[] = {
+    "S_COMMAND_INVALID_SANGUOSHA_COMMAND", "S_COMMAND_SHOW_PROMPT", "S_COMMAND_ARRANGE_SEAT",
+    "S_COMMAND_PREPARE_CARDS", "S_COMMAND_UPDATE_PLAYER_PROPERTY", "S_COMMAND_CHOOSE_GENERAL",
+    "S_COMMAND_MOVE_CARDS", "S_COMMAND_USE_CARD", "S_COMMAND_ADD_CARD_HISTORY", "S_COMMAND_DAMAGE",
+    "S_COMMAND_LOSE_HP", "S_COMMAND_RECOVER", "S_COMMAND_ASK_FOR_CARD",
+    "S_COMMAND_SHOW_AMAZING_GRACE", "S_COMMAND_TAKE_AMAZING_GRACE", "S_COMMAND_CLEAR_AMAZING_GRACE",
+    "S_COMMAND_CHOOSE_PLAYER_CARD", "S_COMMAND_SHOW_CARD", "S_COMMAND_ADD_SKILL",
+    "S_COMMAND_REMOVE_SKILL", "S_COMMAND_INVOKE_SKILL", "S_COMMAND_CLEAR_SKILL_HISTORY",
+    "S_COMMAND_TRIGGER_ORDER", "S_COMMAND_ARRANGE_CARD", "S_COMMAND_ARRANGE_CARD_START",
+    "S_COMMAND_ARRANGE_CARD_MOVE", "S_COMMAND_ARRANGE_CARD_END", "S_COMMAND_ASK_FOR_OPTION",
+    "S_COMMAND_SET_VIRTUAL_CARD", "S_COMMAND_SET_PLAYER_TAG", "S_COMMAND_GAME_OVER",
+    "S_COMMAND_ACT", "S_COMMAND_RESYNC", "S_COMMAND_BATCH", "S_COMMAND_COMPRESSED",
+    "S_COMMAND_MIGRATE"
+};
+
+static_assert(sizeof(EventNames) / sizeof(EventNames[0]) == EventTypeCount, "EventNames must match EventType");
+static_assert(sizeof(CommandNames) / sizeof(CommandNames[0]) == SANGUOSHA_COMMAND_COUNT - S_COMMAND_INVALID_SANGUOSHA_COMMAND,
+              "CommandNames must match SanguoshaCommand");
+
+//Only the owner thread writes it
+struct Block
+{
+    Counter triggers[EventTypeCount];
+    Counter messages[SANGUOSHA_COMMAND_COUNT];
+    Counter messageBytes[SANGUOSHA_COMMAND_COUNT];
+    Counter gamesFinished;
+    Counter robotGames[2];
+    Counter robotWins[2];
+};
+
+inline void Add(Counter &counter, qint64 value)
+{
+    counter.store(counter.load() + value);
+}
+
+void AddTo(Metrics::Totals &totals, const Block *block)
+{
+    for (int i = 0; i < EventTypeCount; i++)
+        totals.triggers[i] += block->triggers[i].load();
+    for (int i = 0; i < SANGUOSHA_COMMAND_COUNT; i++) {
+        totals.messages[i] += block->messages[i].load();
+        totals.messageBytes[i] += block->messageBytes[i].load();
+    }
+    totals.gamesFinished += block->gamesFinished.load();
+    for (int i = 0; i < 2; i++) {
+        totals.robotGames[i] += block->robotGames[i].load();
+        totals.robotWins[i] += block->robotWins[i].load();
+    }
+}
+
+struct Registry
+{
+    QMutex mutex;
+    QList<Block *> blocks;
+    Metrics::Totals retired;
+};
+
+Registry *GlobalRegistry()
+{
+    static Registry registry;
+    return &registry;
+}
+
+//Registers a block on the first use in a thread, and retires it when the thread finishes
+struct LocalBlock
+{
+    Block *block;
+
+    LocalBlock()
+        : block(new Block)
+    {
+        Registry *registry = GlobalRegistry();
+        QMutexLocker locker(&registry->mutex);
+        registry->blocks << block;
+    }
+
+    ~LocalBlock()
+    {
+        Registry *registry = GlobalRegistry();
+        QMutexLocker locker(&registry->mutex);
+        registry->blocks.removeOne(block);
+        AddTo(registry->retired, block);
+        delete block;
+    }
+};
+
+Block *CurrentBlock()
+{
+    static thread_local LocalBlock local;
+    return local.block;
+}
+
+}
+
+Metrics::Totals::Totals()
+    : gamesFinished(0)
+{
+    std::fill(triggers, triggers + EventTypeCount, 0);
+    std::fill(messages, messages + SANGUOSHA_COMMAND_COUNT, 0);
+    std::fill(messageBytes, messageBytes + SANGUOSHA_COMMAND_COUNT, 0);
+    std::fill(robotGames, robotGames + 2, 0);
+    std::fill(robotWins, robotWins + 2, 0);
+}
+
+void Metrics::AddTrigger(EventType event)
+{
+    if (event >= 0 && event < EventTypeCount)
+        Add(CurrentBlock()->triggers[event], 1);
+}
+
+void Metrics::AddMessage(int command, qint64 bytes, int num)
+{
+    if (command < 0 || command >= SANGUOSHA_COMMAND_COUNT)
+        return;
+    Block *block = CurrentBlock();
+    Add(block->messages[command], num);
+    Add(block->messageBytes[command], bytes * num);
+}
+
+void Metrics::AddGameFinished()
+{
+    Add(CurrentBlock()->gamesFinished, 1);
+}
+
+void Metrics::AddRobotGame(bool searching, bool won)
+{
+    Block *block = CurrentBlock();
+    Add(block->robotGames[searching], 1);
+    if (won)
+        Add(block->robotWins[searching], 1);
+}
+
+QByteArray Metrics::EventName(int event)
+{
+    if (event >= 0 && event < EventTypeCount)
+        return EventNames[event];
+    return QByteArray::number(event);
+}
+
+QByteArray Metrics::CommandName(int command)
+{
+    //System commands of Cardirector are left as numbers
+    if (command >= S_COMMAND_INVALID_SANGUOSHA_COMMAND && command < SANGUOSHA_COMMAND_COUNT)
+        return CommandNames[command - S_COMMAND_INVALID_SANGUOSHA_COMMAND];
+    return QByteArray::number(command);
+}
+
+Metrics::Totals Metrics::Collect()
+{
+    Registry *registry = GlobalRegistry();
+    QMutexLocker locker(&registry->mutex);
+    Totals totals = registry->retired;
+    foreach (const Block *block, registry->blocks)
+        AddTo(totals, block);
+    return totals;
+}
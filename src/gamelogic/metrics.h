@@ -0,0 +1,61 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "eventtype.h"
+#include "protocol.h"
+
+#include <QByteArray>
+
+/* Process-wide counters for the metrics exporter. Every thread increments a block of its own
+ * with relaxed loads and stores, so game threads take no lock and no read-modify-write.
+ * Collect() adds up the blocks of all threads, including those of threads that have finished.
+ */
+class Metrics
+{
+public:
+    struct Totals
+    {
+        qint64 triggers[EventTypeCount];
+        qint64 messages[SANGUOSHA_COMMAND_COUNT];
+        qint64 messageBytes[SANGUOSHA_COMMAND_COUNT];
+        qint64 gamesFinished;
+        //Indexed by whether the robots searched
+        qint64 robotGames[2];
+        qint64 robotWins[2];
+
+        Totals();
+    };
+
+    static void AddTrigger(EventType event);
+    static void AddMessage(int command, qint64 bytes, int num = 1);
+    static void AddGameFinished();
+    static void AddRobotGame(bool searching, bool won);
+
+    static Totals Collect();
+
+    //Enumerator names for labels, or the number if it's out of range
+    static QByteArray EventName(int event);
+    static QByteArray CommandName(int command);
+};
+
+#endif // METRICS_H
@@ -0,0 +1,121 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+
+#include "replayrecorder.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+
+namespace {
+
+QMutex DirectoryMutex;
+QString Directory;
+
+}
+
+ReplayRecorder::ReplayRecorder(const QString &fileName, const ReplayHeader &header)
+    : m_fileName(fileName)
+    , m_header(header)
+    , m_closed(false)
+{
+    m_frames.reserve(256);
+    m_timer.start();
+}
+
+ReplayRecorder::~ReplayRecorder()
+{
+    close();
+}
+
+QString ReplayRecorder::OutputDirectory()
+{
+    QMutexLocker locker(&DirectoryMutex);
+    return Directory;
+}
+
+void ReplayRecorder::SetOutputDirectory(const QString &directory)
+{
+    QMutexLocker locker(&DirectoryMutex);
+    Directory = directory;
+}
+
+void ReplayRecorder::record(ReplayFrame::Type type, uint agentId, int command, const QVariant &data)
+{
+    ReplayFrame frame;
+    frame.type = type;
+    frame.timestamp = m_timer.elapsed();
+    frame.agentId = agentId;
+    frame.command = command;
+    frame.data = data;
+
+    QMutexLocker locker(&m_mutex);
+    if (m_closed)
+        return;
+    bool wasEmpty = m_frames.isEmpty();
+    m_frames.append(frame);
+    if (wasEmpty)
+        m_frameAdded.wakeOne();
+}
+
+void ReplayRecorder::close()
+{
+    m_mutex.lock();
+    m_closed = true;
+    m_frameAdded.wakeOne();
+    m_mutex.unlock();
+
+    wait();
+}
+
+void ReplayRecorder::run()
+{
+    QDir().mkpath(QFileInfo(m_fileName).absolutePath());
+    QFile file(m_fileName);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate)) {
+        qWarning("Failed to write the replay file %s", qPrintable(m_fileName));
+        QMutexLocker locker(&m_mutex);
+        m_closed = true;
+        m_frames.clear();
+        return;
+    }
+    file.write(ReplayFile::Serialize(m_header));
+
+    QVector<ReplayFrame> frames;
+    forever {
+        m_mutex.lock();
+        while (m_frames.isEmpty() && !m_closed)
+            m_frameAdded.wait(&m_mutex);
+        frames.swap(m_frames);
+        bool closed = m_closed;
+        m_mutex.unlock();
+
+        QByteArray buffer;
+        foreach (const ReplayFrame &frame, frames)
+            buffer.append(ReplayFile::Serialize(frame));
+        file.write(buffer);
+        file.flush();
+        frames.clear();
+
+        if (closed)
+            break;
+    }
+}
@@ -0,0 +1,69 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+
+#ifndef REPLAYRECORDER_H
+#define REPLAYRECORDER_H
+
+#include "replayfile.h"
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+
+/* Records the notifications, requests and replies of a room into a replay file.
+ *
+ * record() only copies the implicitly shared payload into a queue, so the thread of the
+ * game logic never serializes anything or touches the disk. The frames are serialized and
+ * appended to the file by the recorder's own thread, which is started by start().
+ */
+class ReplayRecorder : public QThread
+{
+public:
+    ReplayRecorder(const QString &fileName, const ReplayHeader &header);
+    ~ReplayRecorder();
+
+    static QString OutputDirectory();
+    //Recording is disabled if the directory is empty
+    static void SetOutputDirectory(const QString &directory);
+
+    QString fileName() const { return m_fileName; }
+
+    void record(ReplayFrame::Type type, uint agentId, int command, const QVariant &data);
+
+    //Writes all the pending frames and stops the thread
+    void close();
+
+protected:
+    void run() override;
+
+private:
+    QString m_fileName;
+    ReplayHeader m_header;
+    QElapsedTimer m_timer;
+
+    QMutex m_mutex;
+    QWaitCondition m_frameAdded;
+    QVector<ReplayFrame> m_frames;
+    bool m_closed;
+};
+
+#endif // REPLAYRECORDER_H
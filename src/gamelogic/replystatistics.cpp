@@ -0,0 +1,233 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+
+#include "replystatistics.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QSet>
+
+namespace {
+
+const int LinearBucketNum = 32;
+const int SubBucketBits = 4;
+const int SubBucketNum = 1 << SubBucketBits;
+
+struct GlobalStatistics
+{
+    QMutex mutex;
+    QSet<const ReplyStatistics *> statistics;
+    QMap<QPair<int, ReplyStatistics::AgentType>, ReplyStatistics::Record> finished;
+};
+
+GlobalStatistics *Global()
+{
+    static GlobalStatistics statistics;
+    return &statistics;
+}
+
+}
+
+LatencyHistogram::LatencyHistogram()
+    : m_count(0)
+    , m_sum(0)
+    , m_min(0)
+    , m_max(0)
+{
+}
+
+int LatencyHistogram::BucketIndex(qint64 value)
+{
+    if (value < LinearBucketNum)
+        return value < 0 ? 0 : int(value);
+
+    int highestBit = 0;
+    while ((value >> (highestBit + 1)) > 0)
+        highestBit++;
+
+    int shift = highestBit - SubBucketBits;
+    int subBucket = int(value >> shift) - SubBucketNum;
+    return LinearBucketNum + (shift - 1) * SubBucketNum + subBucket;
+}
+
+qint64 LatencyHistogram::BucketValue(int index)
+{
+    if (index < LinearBucketNum)
+        return index;
+
+    index -= LinearBucketNum;
+    int shift = index / SubBucketNum + 1;
+    qint64 subBucket = index % SubBucketNum + SubBucketNum;
+    return ((subBucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(qint64 value)
+{
+    int index = BucketIndex(value);
+    if (index >= m_buckets.size())
+        m_buckets.resize(index + 1);
+    m_buckets[index]++;
+
+    if (m_count == 0 || value < m_min)
+        m_min = value;
+    if (value > m_max)
+        m_max = value;
+    m_count++;
+    m_sum += value;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &histogram)
+{
+    if (histogram.m_count <= 0)
+        return;
+
+    if (m_buckets.size() < histogram.m_buckets.size())
+        m_buckets.resize(histogram.m_buckets.size());
+    for (int i = 0; i < histogram.m_buckets.size(); i++)
+        m_buckets[i] += histogram.m_buckets.at(i);
+
+    if (m_count == 0 || histogram.m_min < m_min)
+        m_min = histogram.m_min;
+    if (histogram.m_max > m_max)
+        m_max = histogram.m_max;
+    m_count += histogram.m_count;
+    m_sum += histogram.m_sum;
+}
+
+qint64 LatencyHistogram::valueAtPercentile(double percentile) const
+{
+    if (m_count <= 0)
+        return 0;
+
+    qint64 rank = qMax<qint64>(1, qint64(percentile / 100.0 * m_count + 0.5));
+    qint64 counted = 0;
+    for (int i = 0; i < m_buckets.size(); i++) {
+        counted += m_buckets.at(i);
+        if (counted >= rank)
+            return qMin(BucketValue(i), m_max);
+    }
+    return m_max;
+}
+
+QVariantMap LatencyHistogram::toVariant() const
+{
+    QVariantMap data;
+    data["count"] = m_count;
+    data["min"] = m_min;
+    data["max"] = m_max;
+    data["sum"] = m_sum;
+    data["mean"] = mean();
+    data["p50"] = valueAtPercentile(50.0);
+    data["p90"] = valueAtPercentile(90.0);
+    data["p99"] = valueAtPercentile(99.0);
+    data["p99.9"] = valueAtPercentile(99.9);
+    return data;
+}
+
+ReplyStatistics::Record::Record()
+    : timeoutCount(0)
+{
+}
+
+void ReplyStatistics::Record::merge(const Record &record)
+{
+    latency.merge(record.latency);
+    timeoutCount += record.timeoutCount;
+}
+
+QVariantMap ReplyStatistics::Record::toVariant() const
+{
+    QVariantMap data = latency.toVariant();
+    data["timeouts"] = timeoutCount;
+    data["timeoutRate"] = latency.count() > 0 ? double(timeoutCount) / latency.count() : 0.0;
+    return data;
+}
+
+ReplyStatistics::ReplyStatistics()
+{
+    GlobalStatistics *global = Global();
+    QMutexLocker locker(&global->mutex);
+    global->statistics.insert(this);
+}
+
+ReplyStatistics::~ReplyStatistics()
+{
+    GlobalStatistics *global = Global();
+    QMutexLocker locker(&global->mutex);
+    global->statistics.remove(this);
+    mergeTo(global->finished);
+}
+
+void ReplyStatistics::record(int command, AgentType type, qint64 usecs, bool timedOut)
+{
+    QMutexLocker locker(&m_mutex);
+    Record &record = m_records[qMakePair(command, type)];
+    record.latency.record(usecs);
+    if (timedOut)
+        record.timeoutCount++;
+}
+
+QVariantMap ReplyStatistics::toVariant() const
+{
+    QMutexLocker locker(&m_mutex);
+    return ToVariant(m_records);
+}
+
+QVariantMap ReplyStatistics::GlobalVariant()
+{
+    GlobalStatistics *global = Global();
+    QMutexLocker locker(&global->mutex);
+
+    RecordMap records = global->finished;
+    foreach (const ReplyStatistics *statistics, global->statistics)
+        statistics->mergeTo(records);
+
+    return ToVariant(records);
+}
+
+QByteArray ReplyStatistics::Dump()
+{
+    return QJsonDocument(QJsonObject::fromVariantMap(GlobalVariant())).toJson();
+}
+
+QVariantMap ReplyStatistics::ToVariant(const RecordMap &records)
+{
+    QVariantMap data;
+    QMapIterator<QPair<int, AgentType>, Record> iter(records);
+    while (iter.hasNext()) {
+        iter.next();
+        QString command = QString::number(iter.key().first);
+        QVariantMap commandData = data.value(command).toMap();
+        commandData[iter.key().second == RobotAgent ? "robot" : "human"] = iter.value().toVariant();
+        data[command] = commandData;
+    }
+    return data;
+}
+
+void ReplyStatistics::mergeTo(RecordMap &records) const
+{
+    QMutexLocker locker(&m_mutex);
+    QMapIterator<QPair<int, AgentType>, Record> iter(m_records);
+    while (iter.hasNext()) {
+        iter.next();
+        records[iter.key()].merge(iter.value());
+    }
+}
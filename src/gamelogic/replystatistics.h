@@ -0,0 +1,104 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+
+#ifndef REPLYSTATISTICS_H
+#define REPLYSTATISTICS_H
+
+#include <QMap>
+#include <QMutex>
+#include <QPair>
+#include <QVariant>
+#include <QVector>
+
+/* A histogram with a bounded relative error, in the manner of HdrHistogram.
+ * Values below 32 are counted exactly, and every power of two above is split into 16 buckets.
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void record(qint64 value);
+    void merge(const LatencyHistogram &histogram);
+
+    qint64 count() const { return m_count; }
+    qint64 min() const { return m_min; }
+    qint64 max() const { return m_max; }
+    qint64 sum() const { return m_sum; }
+    double mean() const { return m_count > 0 ? double(m_sum) / m_count : 0.0; }
+    qint64 valueAtPercentile(double percentile) const;
+
+    QVariantMap toVariant() const;
+
+private:
+    static int BucketIndex(qint64 value);
+    static qint64 BucketValue(int index);
+
+    QVector<quint32> m_buckets;
+    qint64 m_count;
+    qint64 m_sum;
+    qint64 m_min;
+    qint64 m_max;
+};
+
+/* Latency of replies from agents and the number of requests that timed out,
+ * by command and by the kind of agent. Latencies are in microseconds.
+ * Every GameLogic owns one, and the statistics of all rooms are merged into a process-wide dump.
+ */
+class ReplyStatistics
+{
+public:
+    enum AgentType
+    {
+        HumanAgent,
+        RobotAgent
+    };
+
+    struct Record
+    {
+        LatencyHistogram latency;
+        qint64 timeoutCount;
+
+        Record();
+        void merge(const Record &record);
+        QVariantMap toVariant() const;
+    };
+
+    ReplyStatistics();
+    ~ReplyStatistics();
+
+    void record(int command, AgentType type, qint64 usecs, bool timedOut);
+
+    QVariantMap toVariant() const;
+
+    static QVariantMap GlobalVariant();
+    static QByteArray Dump();
+
+private:
+    typedef QMap<QPair<int, AgentType>, Record> RecordMap;
+
+    static QVariantMap ToVariant(const RecordMap &records);
+    void mergeTo(RecordMap &records) const;
+
+    mutable QMutex m_mutex;
+    RecordMap m_records;
+};
+
+#endif // REPLYSTATISTICS_H
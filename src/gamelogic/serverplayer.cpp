@@ -17,30 +17,87 @@
     Mogara
 *********************************************************************/
 
+#include "ai.h"
 #include "card.h"
+#include "cardarea.h"
 #include "cardpattern.h"
+#include "engine.h"
 #include "gamelogic.h"
+#include "gametracer.h"
 #include "general.h"
+#include "payloadcompressor.h"
 #include "protocol.h"
+#include "replayrecorder.h"
+#include "replystatistics.h"
 #include "roomsettings.h"
 #include "serverplayer.h"
 #include "skill.h"
+#include "timerwheel.h"
 
 #include <CRoom>
 #include <CServerAgent>
+#include <CServerRobot>
+#include <CServerUser>
+
+#include <QMetaProperty>
+
+namespace {
+
+//Properties that only forward to other properties aren't saved
+const QSet<QByteArray> AliasProperties = {"dead", "generalId"};
+
+QVariant ResyncArea(const CardArea *area, bool visible)
+{
+    QVariantMap data;
+    if (visible) {
+        QVariantList cards;
+        foreach (const Card *card, area->cards())
+            cards << card->id();
+        data["cards"] = cards;
+    } else {
+        data["hidden"] = area->length();
+    }
+
+    QStringList virtualCards = area->virtualCards();
+    if (!virtualCards.isEmpty())
+        data["virtualCards"] = virtualCards;
+    return data;
+}
+
+QVariantList SkillIds(const QList<const Skill *> &skills)
+{
+    QVariantList ids;
+    foreach (const Skill *skill, skills)
+        ids << skill->id();
+    return ids;
+}
+
+}
 
 ServerPlayer::ServerPlayer(GameLogic *logic, CServerAgent *agent)
     : Player(logic)
     , m_logic(logic)
     , m_room(logic->room())
     , m_agent(agent)
+    , m_requestCommand(S_COMMAND_INVALID_SANGUOSHA_COMMAND)
+    , m_requestTimeout(0)
+    , m_ai(nullptr)
+    , m_hasAiReply(false)
+    , m_batchDeadline(0)
+    , m_batchSerial(0)
+    , m_waitingSerial(0)
+    , m_lastSerial(0)
 {
     m_equipArea->setKeepVirtualCard(true);
     m_delayedTrickArea->setKeepVirtualCard(true);
+    watchAgent();
 }
 
 ServerPlayer::~ServerPlayer()
 {
+    if (m_batchDeadline)
+        TimerWheel::Global()->cancel(m_batchDeadline);
+    delete m_ai;
 }
 
 CServerAgent *ServerPlayer::agent() const
@@ -51,12 +108,292 @@ CServerAgent *ServerPlayer::agent() const
 void ServerPlayer::setAgent(CServerAgent *agent)
 {
     m_agent = agent;
+    watchAgent();
+    if (agent && m_logic->isRunning()) {
+        m_resyncPending.store(1);
+        m_logic->requestResync();
+        if (m_logic->isHibernating())
+            m_logic->wake();
+    }
+}
+
+void ServerPlayer::watchAgent()
+{
+    disconnect(m_disconnection);
+    m_disconnected.store(0);
+
+    CServerUser *user = qobject_cast<CServerUser *>(m_agent);
+    if (user) {
+        m_disconnection = connect(user, &CServerUser::disconnected, this, [this](){
+            m_disconnected.store(1);
+        });
+    }
+}
+
+void ServerPlayer::notify(int command, const QVariant &data)
+{
+    if (m_agent == nullptr || m_logic->isSpeculating())
+        return;
+    resyncIfNeeded();
+
+    ReplayRecorder *recorder = m_logic->recorder();
+    if (recorder)
+        recorder->record(ReplayFrame::Notification, m_agent->id(), command, data);
+
+    //It's still recorded, so that a replay can be watched from the robot's seat
+    if (!isNativeRobot())
+        sendNotification(command, data);
+}
+
+void ServerPlayer::sendNotification(int command, const QVariant &data)
+{
+    int window = GameLogic::BatchWindow();
+    if (window <= 0) {
+        deliver(command, data);
+        return;
+    }
+
+    uint serial;
+    {
+        QMutexLocker locker(&m_batchMutex);
+        m_batch << QVariant(QVariantList() << command << data);
+        if (m_batch.length() > 1)
+            return;
+        serial = ++m_batchSerial;
+    }
+
+    //The game thread may not send or block again for a while, so the first notification of a
+    //batch sets a deadline in the timer wheel. The wheel only posts the flush to the thread that
+    //owns the logic object, which the player and the agents live in.
+    //It's scheduled with the batch unlocked, as the wheel holds its lock while firing.
+    TimerWheel *wheel = TimerWheel::Global();
+    TimerWheel::Handle deadline = wheel->schedule(window, [this, serial](){
+        QMetaObject::invokeMethod(this, "flushExpiredNotifications", Qt::QueuedConnection, Q_ARG(uint, serial));
+    });
+
+    bool flushed;
+    {
+        QMutexLocker locker(&m_batchMutex);
+        flushed = m_batchSerial != serial;
+        if (!flushed)
+            m_batchDeadline = deadline;
+    }
+    if (flushed)
+        wheel->cancel(deadline);
+}
+
+void ServerPlayer::flushNotifications()
+{
+    TimerWheel::Handle deadline;
+    {
+        QMutexLocker locker(&m_batchMutex);
+        if (m_batch.isEmpty())
+            return;
+        //A deadline firing meanwhile finds the serial changed and does nothing
+        m_batchSerial++;
+        deadline = m_batchDeadline;
+        m_batchDeadline = 0;
+        deliverBatch();
+    }
+
+    //It's cancelled with the batch unlocked, as the wheel holds its lock while firing
+    if (deadline)
+        TimerWheel::Global()->cancel(deadline);
+}
+
+void ServerPlayer::flushExpiredNotifications(uint serial)
+{
+    //The game thread has flushed the batch since the deadline if the serial has changed
+    QMutexLocker locker(&m_batchMutex);
+    if (m_batchSerial != serial)
+        return;
+    m_batchSerial++;
+    m_batchDeadline = 0;
+    deliverBatch();
+}
+
+void ServerPlayer::deliverBatch()
+{
+    if (m_agent) {
+        if (m_batch.length() == 1) {
+            QVariantList notification = m_batch.first().toList();
+            deliver(notification.at(0).toInt(), notification.at(1));
+        } else {
+            deliver(S_COMMAND_BATCH, m_batch);
+        }
+    }
+    m_batch.clear();
+}
+
+void ServerPlayer::deliver(int command, const QVariant &data)
+{
+    //Robots live in the process, so only users over the network get compressed payloads
+    if (PayloadCompressor::Level() > 0 && qobject_cast<CServerUser *>(m_agent)) {
+        QVariant packed = PayloadCompressor::Compress(command, data);
+        if (packed.isValid()) {
+            m_logic->addMessage(S_COMMAND_COMPRESSED, packed);
+            m_agent->notify(S_COMMAND_COMPRESSED, packed);
+            return;
+        }
+    }
+    m_logic->addMessage(command, data);
+    m_agent->notify(command, data);
+}
+
+void ServerPlayer::request(int command, const QVariant &data)
+{
+    //Every player is played by the native AI while speculating
+    if (m_logic->isSpeculating()) {
+        m_aiReply = ai()->reply(command, data);
+        m_hasAiReply = true;
+        return;
+    }
+    resyncIfNeeded();
+
+    m_requestCommand = command;
+    m_requestTimeout = 0;
+    m_requestTimer.start();
+    ReplayRecorder *recorder = m_logic->recorder();
+    if (recorder)
+        recorder->record(ReplayFrame::Request, m_agent->id(), command, data);
+    if (isNativeRobot()) {
+        m_aiReply = ai()->reply(command, data);
+        m_hasAiReply = true;
+        return;
+    }
+    m_logic->flushNotifications();
+    m_logic->addMessage(command, data);
+    m_agent->request(command, data);
+}
+
+void ServerPlayer::request(int command, const QVariant &data, int timeout)
+{
+    //Every player is played by the native AI while speculating
+    if (m_logic->isSpeculating()) {
+        m_aiReply = ai()->reply(command, data);
+        m_hasAiReply = true;
+        return;
+    }
+    resyncIfNeeded();
+
+    m_requestCommand = command;
+    m_requestTimeout = timeout;
+    m_requestTimer.start();
+    ReplayRecorder *recorder = m_logic->recorder();
+    if (recorder)
+        recorder->record(ReplayFrame::Request, m_agent->id(), command, data);
+    if (isNativeRobot()) {
+        m_aiReply = ai()->reply(command, data);
+        m_hasAiReply = true;
+        return;
+    }
+    m_logic->flushNotifications();
+    m_logic->addMessage(command, data);
+    m_agent->request(command, data, timeout);
+}
+
+QVariant ServerPlayer::waitForReply()
+{
+    if (m_logic->isSpeculating()) {
+        QVariant reply = m_aiReply;
+        m_aiReply.clear();
+        m_hasAiReply = false;
+        return reply;
+    }
+
+    GameTracer::Span span(m_logic->tracer(), "waitForReply", "request");
+    span.addArgument("player", id());
+    span.addArgument("command", m_requestCommand);
+    if (m_hasAiReply) {
+        QVariant reply = m_aiReply;
+        m_aiReply.clear();
+        m_hasAiReply = false;
+        addReplyRecord(reply);
+        return reply;
+    }
+
+    QVariant reply = m_agent->waitForReply();
+    addReplyRecord(reply);
+    return reply;
+}
+
+QVariant ServerPlayer::waitForReply(int timeout)
+{
+    if (m_logic->isSpeculating()) {
+        QVariant reply = m_aiReply;
+        m_aiReply.clear();
+        m_hasAiReply = false;
+        return reply;
+    }
+
+    GameTracer::Span span(m_logic->tracer(), "waitForReply", "request");
+    span.addArgument("player", id());
+    span.addArgument("command", m_requestCommand);
+    if (m_hasAiReply) {
+        QVariant reply = m_aiReply;
+        m_aiReply.clear();
+        m_hasAiReply = false;
+        addReplyRecord(reply);
+        return reply;
+    }
+
+    //The deadline is kept by the process-wide timer wheel instead of a timed wait per request.
+    //It cancels the request from the wheel's thread, which wakes up the wait with a null reply,
+    //so Cardirector must have a CServerAgent::cancelRequest() that can be called from any thread.
+    uint serial;
+    {
+        QMutexLocker locker(&m_waitingMutex);
+        serial = ++m_lastSerial;
+        m_waitingSerial = serial;
+    }
+    TimerWheel *wheel = TimerWheel::Global();
+    TimerWheel::Handle deadline = wheel->schedule(timeout, [this, serial](){
+        QMutexLocker locker(&m_waitingMutex);
+        if (m_waitingSerial == serial) {
+            m_waitingSerial = 0;
+            m_agent->cancelRequest();
+        }
+    });
+
+    QVariant reply = m_agent->waitForReply();
+    bool cancelled;
+    {
+        QMutexLocker locker(&m_waitingMutex);
+        cancelled = m_waitingSerial != serial;
+        m_waitingSerial = 0;
+    }
+    wheel->cancel(deadline);
+
+    addReplyRecord(reply, cancelled);
+    return reply;
+}
+
+bool ServerPlayer::isHuman() const
+{
+    return qobject_cast<CServerUser *>(m_agent) != nullptr;
+}
+
+bool ServerPlayer::isOnline() const
+{
+    return isHuman() && m_disconnected.load() == 0;
+}
+
+bool ServerPlayer::isNativeRobot() const
+{
+    return Ai::IsEnabled() && qobject_cast<CServerRobot *>(m_agent) != nullptr;
+}
+
+Ai *ServerPlayer::ai()
+{
+    if (m_ai == nullptr)
+        m_ai = new Ai(this);
+    return m_ai;
 }
 
 CRoom *ServerPlayer::room() const
 {
     if (m_room->isAbandoned())
-        throw GameFinish;
+        m_logic->interrupt(GameFinish);
     return m_room;
 }
 
@@ -100,7 +437,7 @@ void ServerPlayer::showCard(Card *card)
     QVariantMap data;
     data["from"] = id();
     data["cards"] = cardData;
-    m_room->broadcastNotification(S_COMMAND_SHOW_CARD, data);
+    m_logic->broadcastNotification(S_COMMAND_SHOW_CARD, data);
 }
 
 void ServerPlayer::showCards(const QList<Card *> &cards)
@@ -112,7 +449,7 @@ void ServerPlayer::showCards(const QList<Card *> &cards)
     QVariantMap data;
     data["from"] = id();
     data["cards"] = cardData;
-    m_agent->notify(S_COMMAND_SHOW_CARD, data);
+    notify(S_COMMAND_SHOW_CARD, data);
 }
 
 void ServerPlayer::play()
@@ -134,11 +471,18 @@ void ServerPlayer::play(const QList<Player::Phase> &phases)
     foreach (Phase to, phases) {
         if (to == Inactive)
             break;
+
+        GameTracer::Span span(m_logic->tracer(), "phase");
+        span.addArgument("player", id());
+        span.addArgument("phase", to);
+
         change.from = phase();
         change.to = to;
 
         QVariant data = QVariant::fromValue(&change);
         bool skip = m_logic->trigger(PhaseChanging, this, data);
+        if (m_logic->isInterrupted())
+            return;
 
         setPhase(change.to);
         broadcastProperty("phase");
@@ -149,6 +493,9 @@ void ServerPlayer::play(const QList<Player::Phase> &phases)
         if (!m_logic->trigger(PhaseStart, this))
             m_logic->trigger(PhaseProceeding, this);
         m_logic->trigger(PhaseEnd, this);
+
+        if (m_logic->isInterrupted())
+            return;
     }
 
     change.from = phase();
@@ -156,6 +503,8 @@ void ServerPlayer::play(const QList<Player::Phase> &phases)
 
     QVariant data = QVariant::fromValue(&change);
     m_logic->trigger(PhaseChanging, this, data);
+    if (m_logic->isInterrupted())
+        return;
 
     setPhase(change.to);
     broadcastProperty("phase");
@@ -165,9 +514,17 @@ void ServerPlayer::play(const QList<Player::Phase> &phases)
 
 bool ServerPlayer::activate()
 {
+    if (m_logic->isInterrupted())
+        return true;
+
     int timeout = m_logic->settings()->timeout * 1000;
-    m_agent->request(S_COMMAND_ACT, QVariant(), timeout);
-    QVariant replyData = m_agent->waitForReply(timeout);
+    request(S_COMMAND_ACT, QVariant(), timeout);
+    QVariant replyData = waitForReply(timeout);
+    return activate(replyData);
+}
+
+bool ServerPlayer::activate(const QVariant &replyData)
+{
     if (replyData.isNull())
         return true;
     const QVariantMap reply = replyData.toMap();
@@ -241,7 +598,7 @@ void ServerPlayer::showPrompt(const QString &message, int number)
     QVariantList data;
     data << message;
     data << number;
-    m_agent->notify(S_COMMAND_SHOW_PROMPT, data);
+    notify(S_COMMAND_SHOW_PROMPT, data);
 }
 
 void ServerPlayer::showPrompt(const QString &message, const QVariantList &args)
@@ -249,7 +606,7 @@ void ServerPlayer::showPrompt(const QString &message, const QVariantList &args)
     QVariantList data;
     data << message;
     data << args;
-    m_agent->notify(S_COMMAND_SHOW_PROMPT, data);
+    notify(S_COMMAND_SHOW_PROMPT, data);
 }
 
 void ServerPlayer::showPrompt(const QString &message, const Card *card)
@@ -296,8 +653,8 @@ Event ServerPlayer::askForTriggerOrder(const EventList &options, bool cancelable
     data["options"] = optionData;
 
     int timeout = m_logic->settings()->timeout * 1000;
-    m_agent->request(S_COMMAND_TRIGGER_ORDER, data, timeout);
-    QVariant replyData = m_agent->waitForReply(timeout);
+    request(S_COMMAND_TRIGGER_ORDER, data, timeout);
+    QVariant replyData = waitForReply(timeout);
     if (replyData.isNull())
         return cancelable ? Event() : options.first();
 
@@ -317,8 +674,8 @@ Card *ServerPlayer::askForCard(const QString &pattern, bool optional)
     int timeout = m_logic->settings()->timeout * 1000;
     QVariant replyData;
     forever {
-        m_agent->request(S_COMMAND_ASK_FOR_CARD, data, timeout);
-        replyData = m_agent->waitForReply(timeout);
+        request(S_COMMAND_ASK_FOR_CARD, data, timeout);
+        replyData = waitForReply(timeout);
         if (replyData.isNull())
             break;
 
@@ -378,8 +735,8 @@ QList<Card *> ServerPlayer::askForCards(const QString &pattern, int minNum, int
     data["optional"] = optional;
 
     int timeout = m_logic->settings()->timeout * 1000;
-    m_agent->request(S_COMMAND_ASK_FOR_CARD, data, timeout);
-    const QVariantMap replyData = m_agent->waitForReply(timeout).toMap();
+    request(S_COMMAND_ASK_FOR_CARD, data, timeout);
+    const QVariantMap replyData = waitForReply(timeout).toMap();
 
     if (optional) {
         if (replyData.isEmpty())
@@ -448,8 +805,8 @@ Card *ServerPlayer::askToChooseCard(ServerPlayer *owner, const QString &areaFlag
     }
 
     int timeout = m_logic->settings()->timeout * 1000;
-    m_agent->request(S_COMMAND_CHOOSE_PLAYER_CARD, data, timeout);
-    uint cardId = m_agent->waitForReply(timeout).toUInt();
+    request(S_COMMAND_CHOOSE_PLAYER_CARD, data, timeout);
+    uint cardId = waitForReply(timeout).toUInt();
     if (cardId > 0) {
         if (areaFlag.contains('h') && handcardVisible) {
             Card *card = handcards->findCard(cardId);
@@ -491,8 +848,8 @@ bool ServerPlayer::askToUseCard(const QString &pattern, const QList<ServerPlayer
     data["assignedTargets"] = targetIds;
 
     int timeout = m_logic->settings()->timeout * 1000;
-    m_agent->request(S_COMMAND_ACT, data, timeout);
-    const QVariantMap reply = m_agent->waitForReply(timeout).toMap();
+    request(S_COMMAND_ACT, data, timeout);
+    const QVariantMap reply = waitForReply(timeout).toMap();
     CardUseStruct use;
     if (reply.isEmpty())
         return false;
@@ -564,10 +921,10 @@ QList<QList<Card *>> ServerPlayer::askToArrangeCard(const QList<Card *> &cards,
     data["areaNames"] = areaNames;
 
     int timeout = m_logic->settings()->timeout * 1000;
-    m_agent->request(S_COMMAND_ARRANGE_CARD, data, timeout * 3);
+    request(S_COMMAND_ARRANGE_CARD, data, timeout * 3);
 
     QList<QList<Card *>> result;
-    const QVariantList reply = m_agent->waitForReply().toList();
+    const QVariantList reply = waitForReply().toList();
     int maxi = qMin(capacities.length(), reply.length());
     for (int i = 0; i < maxi; i++) {
         const QVariant cardData = reply.at(i);
@@ -585,30 +942,46 @@ QString ServerPlayer::askForOption(const QStringList &options)
     if (options.length() == 1)
         return options.first();
 
-    m_agent->request(S_COMMAND_ASK_FOR_OPTION, options);
-    int reply = m_agent->waitForReply().toInt();
+    request(S_COMMAND_ASK_FOR_OPTION, options);
+    int reply = waitForReply().toInt();
     if (0 <= reply && reply < options.length())
         return options.at(reply);
     else
         return options.first();
 }
 
+QVariant ServerPlayer::publicProperty(const char *name) const
+{
+    if (m_hiddenProperties.contains(name))
+        return m_hiddenProperties.value(name);
+    return property(name);
+}
+
 void ServerPlayer::broadcastProperty(const char *name) const
 {
+    UndoJournal::Save(m_hiddenProperties);
+    m_hiddenProperties.remove(name);
+
     QVariantList data;
     data << id();
     data << name;
     data << property(name);
-    m_room->broadcastNotification(S_COMMAND_UPDATE_PLAYER_PROPERTY, data);
+    m_logic->broadcastNotification(S_COMMAND_UPDATE_PLAYER_PROPERTY, data);
 }
 
 void ServerPlayer::broadcastProperty(const char *name, const QVariant &value, ServerPlayer *except) const
 {
+    UndoJournal::Save(m_hiddenProperties);
+    if (value != property(name))
+        m_hiddenProperties[name] = value;
+    else
+        m_hiddenProperties.remove(name);
+
     QVariantList data;
     data << id();
     data << name;
     data << value;
-    m_room->broadcastNotification(S_COMMAND_UPDATE_PLAYER_PROPERTY, data, except ? except->agent() : nullptr);
+    m_logic->broadcastNotification(S_COMMAND_UPDATE_PLAYER_PROPERTY, data, except ? except->agent() : nullptr);
 }
 
 void ServerPlayer::unicastPropertyTo(const char *name, ServerPlayer *player)
@@ -617,9 +990,7 @@ void ServerPlayer::unicastPropertyTo(const char *name, ServerPlayer *player)
     data << id();
     data << name;
     data << property(name);
-    CServerAgent *agent = player->agent();
-    if (agent)
-        agent->notify(S_COMMAND_UPDATE_PLAYER_PROPERTY, data);
+    player->notify(S_COMMAND_UPDATE_PLAYER_PROPERTY, data);
 }
 
 void ServerPlayer::addSkillHistory(const Skill *skill)
@@ -630,7 +1001,7 @@ void ServerPlayer::addSkillHistory(const Skill *skill)
     data["invokerId"] = this->id();
     data["skillId"] = skill->id();
 
-    m_agent->notify(S_COMMAND_INVOKE_SKILL, data);
+    notify(S_COMMAND_INVOKE_SKILL, data);
 }
 
 void ServerPlayer::addSkillHistory(const Skill *skill, const QList<Card *> &cards)
@@ -646,7 +1017,7 @@ void ServerPlayer::addSkillHistory(const Skill *skill, const QList<Card *> &card
         cardData << card->id();
     data["cards"] = cardData;
 
-    m_agent->notify(S_COMMAND_INVOKE_SKILL, data);
+    notify(S_COMMAND_INVOKE_SKILL, data);
 }
 
 void ServerPlayer::addSkillHistory(const Skill *skill, const QList<ServerPlayer *> &targets)
@@ -662,7 +1033,7 @@ void ServerPlayer::addSkillHistory(const Skill *skill, const QList<ServerPlayer
         targetData << target->id();
     data["targets"] = targetData;
 
-    m_room->broadcastNotification(S_COMMAND_INVOKE_SKILL, data);
+    m_logic->broadcastNotification(S_COMMAND_INVOKE_SKILL, data);
 }
 
 void ServerPlayer::addSkillHistory(const Skill *skill, const QList<Card *> &cards, const QList<ServerPlayer *> &targets)
@@ -683,13 +1054,13 @@ void ServerPlayer::addSkillHistory(const Skill *skill, const QList<Card *> &card
         targetData << target->id();
     data["targets"] = targetData;
 
-    m_room->broadcastNotification(S_COMMAND_INVOKE_SKILL, data);
+    m_logic->broadcastNotification(S_COMMAND_INVOKE_SKILL, data);
 }
 
 void ServerPlayer::clearSkillHistory()
 {
     Player::clearSkillHistory();
-    m_room->broadcastNotification(S_COMMAND_CLEAR_SKILL_HISTORY, id());
+    m_logic->broadcastNotification(S_COMMAND_CLEAR_SKILL_HISTORY, id());
 }
 
 void ServerPlayer::addCardHistory(const QString &name, int times)
@@ -699,13 +1070,13 @@ void ServerPlayer::addCardHistory(const QString &name, int times)
     data << name;
     data << times;
 
-    m_agent->notify(S_COMMAND_ADD_CARD_HISTORY, data);
+    notify(S_COMMAND_ADD_CARD_HISTORY, data);
 }
 
 void ServerPlayer::clearCardHistory()
 {
     Player::clearCardHistory();
-    m_agent->notify(S_COMMAND_ADD_CARD_HISTORY);
+    notify(S_COMMAND_ADD_CARD_HISTORY);
 }
 
 void ServerPlayer::addSkill(const Skill *skill, Player::SkillArea area)
@@ -741,7 +1112,7 @@ void ServerPlayer::attachSkill(const Skill *skill, SkillArea area)
     data["playerId"] = id();
     data["skillId"] = skill->id();
     data["skillArea"] = area;
-    m_room->broadcastNotification(S_COMMAND_ADD_SKILL, data);
+    m_logic->broadcastNotification(S_COMMAND_ADD_SKILL, data);
 }
 
 void ServerPlayer::detachSkill(const Skill *skill, SkillArea area)
@@ -753,16 +1124,19 @@ void ServerPlayer::detachSkill(const Skill *skill, SkillArea area)
     data["playerId"] = id();
     data["skillId"] = skill->id();
     data["skillArea"] = area;
-    m_room->broadcastNotification(S_COMMAND_REMOVE_SKILL, data);
+    m_logic->broadcastNotification(S_COMMAND_REMOVE_SKILL, data);
 }
 
 void ServerPlayer::broadcastTag(const QString &key)
 {
+    UndoJournal::Save(m_publicTags);
+    m_publicTags.insert(key);
+
     QVariantMap data;
     data["playerId"] = id();
     data["key"] = key;
     data["value"] = tag.value(key);
-    m_room->broadcastNotification(S_COMMAND_SET_PLAYER_TAG, data);
+    m_logic->broadcastNotification(S_COMMAND_SET_PLAYER_TAG, data);
 }
 
 void ServerPlayer::unicastTagTo(const QString &key, ServerPlayer *to)
@@ -771,9 +1145,7 @@ void ServerPlayer::unicastTagTo(const QString &key, ServerPlayer *to)
     data["playerId"] = id();
     data["key"] = key;
     data["value"] = tag.value(key);
-    CServerAgent *agent = to->agent();
-    if (agent)
-        agent->notify(S_COMMAND_SET_PLAYER_TAG, data);
+    to->notify(S_COMMAND_SET_PLAYER_TAG, data);
 }
 
 QList<const General *> ServerPlayer::askForGeneral(const QList<const General *> &candidates, int num)
@@ -787,8 +1159,8 @@ QList<const General *> ServerPlayer::askForGeneral(const QList<const General *>
     data["candidates"] = candidateData;
 
     int timeout = m_logic->settings()->timeout * 1000;
-    m_agent->request(S_COMMAND_CHOOSE_GENERAL, data, timeout);
-    QVariantList reply = m_agent->waitForReply(timeout).toList();
+    request(S_COMMAND_CHOOSE_GENERAL, data, timeout);
+    QVariantList reply = waitForReply(timeout).toList();
 
     GeneralList result;
     foreach (const QVariant &idData, reply) {
@@ -807,6 +1179,138 @@ QList<const General *> ServerPlayer::askForGeneral(const QList<const General *>
     return result;
 }
 
+QVariant ServerPlayer::snapshot() const
+{
+    QVariantMap data;
+    data["id"] = id();
+    data["agentId"] = m_agent ? m_agent->id() : 0;
+    if (isHuman())
+        data["screenName"] = m_agent->screenName();
+
+    QVariantMap properties;
+    const QMetaObject *metaObject = &Player::staticMetaObject;
+    for (int i = metaObject->propertyOffset(); i < metaObject->propertyCount(); i++) {
+        QMetaProperty property = metaObject->property(i);
+        if (property.isWritable() && !AliasProperties.contains(property.name()))
+            properties[property.name()] = property.read(this);
+    }
+    data["properties"] = properties;
+    //What the other players have been told, which resync frames are made of
+    data["hiddenProperties"] = m_hiddenProperties;
+    data["headGeneralShown"] = hasShownHeadGeneral();
+    data["deputyGeneralShown"] = hasShownDeputyGeneral();
+
+    data["headSkills"] = SkillIds(headSkills());
+    data["deputySkills"] = SkillIds(deputySkills());
+    data["acquiredSkills"] = SkillIds(acquiredSkills());
+
+    QVariantMap skillHistory;
+    QMapIterator<const Skill *, int> skillIter(m_skillHistory);
+    while (skillIter.hasNext()) {
+        skillIter.next();
+        skillHistory[QString::number(skillIter.key()->id())] = skillIter.value();
+    }
+    data["skillHistory"] = skillHistory;
+
+    QVariantMap cardHistory;
+    QHashIterator<QString, int> cardIter(m_cardHistory);
+    while (cardIter.hasNext()) {
+        cardIter.next();
+        cardHistory[cardIter.key()] = cardIter.value();
+    }
+    data["cardHistory"] = cardHistory;
+
+    data["tags"] = tag;
+    data["publicTags"] = QStringList(m_publicTags.toList());
+
+    QVariantList skippedPhases;
+    foreach (Phase phase, m_skippedPhase)
+        skippedPhases << phase;
+    data["skippedPhases"] = skippedPhases;
+
+    return data;
+}
+
+void ServerPlayer::restore(const QVariant &snapshot)
+{
+    const QVariantMap data = snapshot.toMap();
+
+    //The beliefs of the AI refer to the cards before the restore
+    delete m_ai;
+    m_ai = nullptr;
+
+    const QVariantMap properties = data["properties"].toMap();
+    for (QVariantMap::const_iterator i = properties.constBegin(); i != properties.constEnd(); i++)
+        setProperty(i.key().toLatin1().constData(), i.value());
+    m_hiddenProperties = data["hiddenProperties"].toMap();
+    setHeadGeneralShown(data["headGeneralShown"].toBool());
+    setDeputyGeneralShown(data["deputyGeneralShown"].toBool());
+
+    Engine *engine = Engine::instance();
+    const SkillArea skillAreas[] = {HeadSkillArea, DeputySkillArea, AcquiredSkillArea};
+    const char *skillKeys[] = {"headSkills", "deputySkills", "acquiredSkills"};
+
+    //A hibernating game wakes up on the same players, so their skills and handlers are still there
+    const QList<const Skill *> oldSkills[] = {headSkills(), deputySkills(), acquiredSkills()};
+    for (int i = 0; i < 3; i++) {
+        foreach (const Skill *skill, oldSkills[i]) {
+            Player::removeSkill(skill, skillAreas[i]);
+            removeTriggerSkill(skill);
+        }
+    }
+
+    for (int i = 0; i < 3; i++) {
+        const QVariantList skills = data[skillKeys[i]].toList();
+        foreach (const QVariant &skillId, skills) {
+            const Skill *skill = engine->getSkill(skillId.toUInt());
+            if (skill == nullptr)
+                continue;
+            Player::addSkill(skill, skillAreas[i]);
+            addTriggerSkill(skill);
+        }
+    }
+
+    m_skillHistory.clear();
+    const QVariantMap skillHistory = data["skillHistory"].toMap();
+    for (QVariantMap::const_iterator i = skillHistory.constBegin(); i != skillHistory.constEnd(); i++) {
+        const Skill *skill = engine->getSkill(i.key().toUInt());
+        if (skill)
+            m_skillHistory[skill] = i.value().toInt();
+    }
+
+    m_cardHistory.clear();
+    const QVariantMap cardHistory = data["cardHistory"].toMap();
+    for (QVariantMap::const_iterator i = cardHistory.constBegin(); i != cardHistory.constEnd(); i++)
+        m_cardHistory[i.key()] = i.value().toInt();
+
+    tag = data["tags"].toMap();
+    m_publicTags = data["publicTags"].toStringList().toSet();
+
+    m_skippedPhase.clear();
+    const QVariantList skippedPhases = data["skippedPhases"].toList();
+    foreach (const QVariant &phase, skippedPhases)
+        m_skippedPhase.insert(static_cast<Phase>(phase.toInt()));
+}
+
+void ServerPlayer::addReplyRecord(const QVariant &reply, bool cancelled)
+{
+    ReplayRecorder *recorder = m_logic->recorder();
+    if (recorder)
+        recorder->record(ReplayFrame::Reply, m_agent->id(), m_requestCommand, reply);
+
+    if (!m_requestTimer.isValid())
+        return;
+
+    //Users also reply null to decline or to end the play phase, so a null reply is a timeout
+    //only if the deadline has cancelled the request or passed
+    qint64 usecs = m_requestTimer.nsecsElapsed() / 1000;
+    bool timedOut = reply.isNull() && (cancelled || (m_requestTimeout > 0 && usecs >= m_requestTimeout * 1000LL));
+
+    ReplyStatistics::AgentType type = qobject_cast<CServerRobot *>(m_agent) ? ReplyStatistics::RobotAgent : ReplyStatistics::HumanAgent;
+    m_logic->replyStatistics()->record(m_requestCommand, type, usecs, timedOut);
+    m_requestTimer.invalidate();
+}
+
 void ServerPlayer::addTriggerSkill(const Skill *skill)
 {
     if (skill->type() == Skill::TriggerType)
@@ -838,3 +1342,72 @@ void ServerPlayer::removeTriggerSkill(const Skill *skill)
             m_logic->removeEventHandler(static_cast<const TriggerSkill *>(subskill));
     }
 }
+
+QVariant ServerPlayer::resyncState(const ServerPlayer *viewer) const
+{
+    bool isSelf = viewer == this;
+
+    QVariantMap data;
+    data["id"] = id();
+    data["agentId"] = m_agent ? m_agent->id() : 0;
+
+    QVariantMap properties;
+    const QMetaObject *metaObject = &Player::staticMetaObject;
+    for (int i = metaObject->propertyOffset(); i < metaObject->propertyCount(); i++) {
+        QMetaProperty property = metaObject->property(i);
+        if (!property.isWritable() || AliasProperties.contains(property.name()))
+            continue;
+        properties[property.name()] = isSelf ? property.read(this) : publicProperty(property.name());
+    }
+    data["properties"] = properties;
+
+    data["handcards"] = ResyncArea(handcardArea(), isSelf);
+    data["equips"] = ResyncArea(equipArea(), true);
+    data["delayedTricks"] = ResyncArea(delayedTrickArea(), true);
+    data["judgeCards"] = ResyncArea(judgeCards(), true);
+
+    data["headSkills"] = SkillIds(headSkills());
+    data["deputySkills"] = SkillIds(deputySkills());
+    data["acquiredSkills"] = SkillIds(acquiredSkills());
+
+    //Histories are only notified to the player itself
+    if (isSelf) {
+        QVariantMap skillHistory;
+        QMapIterator<const Skill *, int> skillIter(m_skillHistory);
+        while (skillIter.hasNext()) {
+            skillIter.next();
+            skillHistory[QString::number(skillIter.key()->id())] = skillIter.value();
+        }
+        data["skillHistory"] = skillHistory;
+
+        QVariantMap cardHistory;
+        QHashIterator<QString, int> cardIter(m_cardHistory);
+        while (cardIter.hasNext()) {
+            cardIter.next();
+            cardHistory[cardIter.key()] = cardIter.value();
+        }
+        data["cardHistory"] = cardHistory;
+    }
+
+    QVariantMap tags;
+    foreach (const QString &key, m_publicTags) {
+        if (tag.contains(key))
+            tags[key] = tag.value(key);
+    }
+    data["tags"] = tags;
+
+    return data;
+}
+
+void ServerPlayer::resyncIfNeeded()
+{
+    if (m_agent == nullptr || !m_resyncPending.testAndSetRelaxed(1, 0))
+        return;
+
+    //The new agent gets the whole table, so what was held for the old one is dropped
+    {
+        QMutexLocker locker(&m_batchMutex);
+        m_batch.clear();
+    }
+    notify(S_COMMAND_RESYNC, m_logic->resyncState(this));
+}
@@ -23,7 +23,13 @@
 #include "event.h"
 #include "player.h"
 #include "structs.h"
+#include "timerwheel.h"
 
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QMutex>
+
+class Ai;
 class CRoom;
 class CServerAgent;
 class GameLogic;
@@ -37,11 +43,40 @@ public:
     ServerPlayer(GameLogic *logic, CServerAgent *agent);
     ~ServerPlayer();
 
+    GameLogic *logic() const { return m_logic; }
+
     CServerAgent *agent() const;
+
+    //A new agent of a game in progress is sent the current table as a resync frame
+    //before the next notification or request.
     void setAgent(CServerAgent *agent);
 
+    //Makes the next notification or request send a resync frame, as for a new agent
+    void requestResync() { m_resyncPending.store(1); }
+
     CRoom *room() const;
 
+    //A human player is played by a user, who is online until disconnected or replaced
+    bool isHuman() const;
+    bool isOnline() const;
+
+    //A robot is answered by the native AI in the thread of the game logic if Ai is enabled
+    bool isNativeRobot() const;
+    Ai *ai();
+
+    //Notifications and requests must be sent through these functions so that they can be recorded.
+    void notify(int command, const QVariant &data = QVariant());
+
+    //Sends or batches a notification without recording it, for GameLogic::broadcastNotification()
+    void sendNotification(int command, const QVariant &data);
+    void flushNotifications();
+
+    //Requests to the agent. They must be sent from the thread of the game logic.
+    void request(int command, const QVariant &data = QVariant());
+    void request(int command, const QVariant &data, int timeout);
+    QVariant waitForReply();
+    QVariant waitForReply(int timeout);
+
     ServerPlayer *next() const { return qobject_cast<ServerPlayer *>(Player::next()); }
     ServerPlayer *next(bool ignoreRemoved) const{ return qobject_cast<ServerPlayer *>(Player::next(ignoreRemoved)); }
     ServerPlayer *nextAlive(int step = 1, bool ignoreRemoved = true) const { return qobject_cast<ServerPlayer *>(Player::nextAlive(step, ignoreRemoved)); }
@@ -55,10 +90,12 @@ public:
     void play();
     void play(const QList<Phase> &phases);
     bool activate();
+    //Carries out a reply to S_COMMAND_ACT. It returns true if the play phase ends.
+    bool activate(const QVariant &reply);
 
-    void skipPhase(Phase phase) { m_skippedPhase.insert(phase); }
+    void skipPhase(Phase phase) { UndoJournal::Save(m_skippedPhase); m_skippedPhase.insert(phase); }
     bool isPhaseSkipped(Phase phase) { return m_skippedPhase.contains(phase); }
-    void clearSkippedPhase() { m_skippedPhase.clear(); }
+    void clearSkippedPhase() { UndoJournal::Save(m_skippedPhase); m_skippedPhase.clear(); }
 
     void showPrompt(const QString &message, int number);
     void showPrompt(const QString &message, const Card *card);
@@ -79,6 +116,9 @@ public:
     void broadcastProperty(const char *name, const QVariant &value, ServerPlayer *except = nullptr) const;
     void unicastPropertyTo(const char *name, ServerPlayer *player);
 
+    //The value of a property as other players know it
+    QVariant publicProperty(const char *name) const;
+
     void addSkillHistory(const Skill *skill);
     void addSkillHistory(const Skill *skill, const QList<Card *> &cards);
     void addSkillHistory(const Skill *skill, const QList<ServerPlayer *> &targets);
@@ -100,14 +140,58 @@ public:
 
     QList<const General *> askForGeneral(const QList<const General *> &candidates, int num);
 
+    //Properties, skills, histories, tags and skipped phases. Card areas are saved by GameLogic.
+    //restore() sends no notification and triggers no event.
+    QVariant snapshot() const;
+    void restore(const QVariant &snapshot);
+
+    //This player as the viewer sees it, in the format of Client::saveState(). Hidden handcards
+    //are sent as a count and properties broadcast with a fake value keep that value.
+    QVariant resyncState(const ServerPlayer *viewer) const;
+
+    //Sends the resync frame if the agent has changed since the last one.
+    //It must be called from the thread of the game logic.
+    void resyncIfNeeded();
+
+private slots:
+    //Sends the batch whose deadline has passed. It runs in the thread that owns the logic object,
+    //the one of Server, like the agents.
+    void flushExpiredNotifications(uint serial);
+
 private:
+    void watchAgent();
+    void deliver(int command, const QVariant &data);
+    //Sends the held notifications. m_batchMutex must be locked.
+    void deliverBatch();
+    //The deadline has cancelled the request if cancelled is true
+    void addReplyRecord(const QVariant &reply, bool cancelled = false);
     void addTriggerSkill(const Skill *skill);
     void removeTriggerSkill(const Skill *skill);
 
     GameLogic *m_logic;
     CRoom *m_room;
     CServerAgent *m_agent;
+    QMetaObject::Connection m_disconnection;
+    QAtomicInt m_disconnected;
+    int m_requestCommand;
+    int m_requestTimeout;
+    QElapsedTimer m_requestTimer;
     QSet<Phase> m_skippedPhase;
+    QAtomicInt m_resyncPending;
+    mutable QVariantMap m_hiddenProperties;
+    QSet<QString> m_publicTags;
+    Ai *m_ai;
+    QVariant m_aiReply;
+    bool m_hasAiReply;
+    //Notifications held for the agent, and the timer wheel deadline that sends them
+    QMutex m_batchMutex;
+    QVariantList m_batch;
+    TimerWheel::Handle m_batchDeadline;
+    uint m_batchSerial;
+    //The request whose deadline is pending in the timer wheel, or 0
+    QMutex m_waitingMutex;
+    uint m_waitingSerial;
+    uint m_lastSerial;
 };
 
 #endif // SERVERPLAYER_H
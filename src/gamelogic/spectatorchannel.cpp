@@ -0,0 +1,177 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+#include "gamelogic.h"
+#include "package.h"
+#include "roomsettings.h"
+#include "spectatorchannel.h"
+
+#include <CRoom>
+
+#include <QDateTime>
+#include <QIODevice>
+#include <QMutexLocker>
+
+const qint64 SpectatorChannel::MaxPendingBytes = 256 * 1024;
+
+SpectatorChannel::SpectatorChannel(GameLogic *logic)
+    : m_logic(logic)
+    , m_flushQueued(false)
+{
+    m_timer.start();
+}
+
+SpectatorChannel::~SpectatorChannel()
+{
+}
+
+void SpectatorChannel::addSpectator(QIODevice *device)
+{
+    m_mutex.lock();
+    m_joining << device;
+    m_mutex.unlock();
+    m_spectatorNum.ref();
+
+    connect(device, &QObject::destroyed, this, [this, device](){
+        removeSpectator(device);
+    });
+}
+
+void SpectatorChannel::removeSpectator(QIODevice *device)
+{
+    bool removed = false;
+
+    m_mutex.lock();
+    if (m_joining.removeOne(device)) {
+        removed = true;
+    } else {
+        for (int i = 0; i < m_joins.length(); i++) {
+            if (m_joins[i].devices.removeOne(device)) {
+                removed = true;
+                break;
+            }
+        }
+    }
+    m_mutex.unlock();
+
+    if (!removed)
+        removed = m_spectators.removeOne(device);
+
+    if (removed) {
+        m_spectatorNum.deref();
+        disconnect(device, &QObject::destroyed, this, nullptr);
+    }
+}
+
+void SpectatorChannel::publish(int command, const QVariant &data)
+{
+    if (m_spectatorNum.load() == 0)
+        return;
+
+    ReplayFrame frame;
+    frame.type = ReplayFrame::Broadcast;
+    frame.timestamp = m_timer.elapsed();
+    frame.command = command;
+    frame.data = data;
+
+    //The state must be read in the thread of the game logic, but it's taken outside the lock
+    //and serialized in the thread of the channel
+    m_mutex.lock();
+    bool joining = !m_joining.isEmpty();
+    m_mutex.unlock();
+    QVariant state;
+    if (joining)
+        state = m_logic->resyncState(nullptr);
+
+    QMutexLocker locker(&m_mutex);
+    m_frames.append(frame);
+    if (state.isValid() && !m_joining.isEmpty()) {
+        //The state already includes the effect of this frame, so it's skipped for new spectators
+        Join join;
+        join.devices.swap(m_joining);
+        join.keyframe.type = ReplayFrame::Keyframe;
+        join.keyframe.timestamp = frame.timestamp;
+        join.keyframe.data = state;
+        join.frameIndex = m_frames.length();
+        m_joins << join;
+    }
+
+    if (!m_flushQueued) {
+        m_flushQueued = true;
+        QMetaObject::invokeMethod(this, "flush", Qt::QueuedConnection);
+    }
+}
+
+void SpectatorChannel::flush()
+{
+    QVector<ReplayFrame> frames;
+    QList<Join> joins;
+    m_mutex.lock();
+    frames.swap(m_frames);
+    joins.swap(m_joins);
+    m_flushQueued = false;
+    m_mutex.unlock();
+
+    QByteArray stream;
+    QVector<int> offsets;
+    offsets.reserve(frames.length() + 1);
+    foreach (const ReplayFrame &frame, frames) {
+        offsets << stream.length();
+        stream.append(ReplayFile::Serialize(frame));
+    }
+    offsets << stream.length();
+
+    QList<QIODevice *> spectators = m_spectators;
+    foreach (QIODevice *device, spectators) {
+        if (device->bytesToWrite() > MaxPendingBytes)
+            dropSpectator(device);
+        else
+            device->write(stream);
+    }
+
+    if (joins.isEmpty())
+        return;
+
+    if (m_header.isEmpty()) {
+        ReplayHeader header;
+        header.roomId = m_logic->room()->id();
+        header.startTime = QDateTime::currentMSecsSinceEpoch() - m_timer.elapsed();
+        header.mode = m_logic->settings()->mode;
+        foreach (const Package *package, m_logic->packages())
+            header.packages << package->name();
+        m_header = ReplayFile::Serialize(header);
+    }
+
+    foreach (const Join &join, joins) {
+        QByteArray data = m_header;
+        data.append(ReplayFile::Serialize(join.keyframe));
+        data.append(stream.mid(offsets.at(join.frameIndex)));
+        foreach (QIODevice *device, join.devices) {
+            device->write(data);
+            m_spectators << device;
+        }
+    }
+}
+
+void SpectatorChannel::dropSpectator(QIODevice *device)
+{
+    removeSpectator(device);
+    device->close();
+    emit spectatorDropped(device);
+}
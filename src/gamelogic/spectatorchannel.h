@@ -0,0 +1,93 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+#ifndef SPECTATORCHANNEL_H
+#define SPECTATORCHANNEL_H
+
+#include "replayfile.h"
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QObject>
+#include <QVector>
+
+class GameLogic;
+class QIODevice;
+
+/* Streams the public view of a room to spectators.
+ *
+ * The stream is in the format of a replay file: a header without the seed, a keyframe of the
+ * public state and then the public notifications. The thread of the game logic only queues
+ * the implicitly shared payload. Frames are serialized once per room in the thread of the
+ * channel, and the same bytes are written to every spectator.
+ *
+ * A spectator that falls more than MaxPendingBytes behind is dropped.
+ */
+class SpectatorChannel : public QObject
+{
+    Q_OBJECT
+
+public:
+    SpectatorChannel(GameLogic *logic);
+    ~SpectatorChannel();
+
+    static const qint64 MaxPendingBytes;
+
+    //It must be called from the thread of the channel. The spectator receives a keyframe
+    //the next time the game logic publishes anything.
+    void addSpectator(QIODevice *device);
+    void removeSpectator(QIODevice *device);
+    int spectatorNum() const { return m_spectatorNum.load(); }
+
+    //It must be called from the thread of the game logic. Nothing is done if nobody's watching.
+    void publish(int command, const QVariant &data);
+
+signals:
+    void spectatorDropped(QIODevice *device);
+
+private slots:
+    void flush();
+
+private:
+    struct Join
+    {
+        QList<QIODevice *> devices;
+        ReplayFrame keyframe;
+        int frameIndex;
+    };
+
+    void dropSpectator(QIODevice *device);
+
+    GameLogic *m_logic;
+    QElapsedTimer m_timer;
+    QAtomicInt m_spectatorNum;
+
+    QMutex m_mutex;
+    QVector<ReplayFrame> m_frames;
+    QList<QIODevice *> m_joining;
+    QList<Join> m_joins;
+    bool m_flushQueued;
+
+    //Only used in the thread of the channel
+    QList<QIODevice *> m_spectators;
+    QByteArray m_header;
+};
+
+#endif // SPECTATORCHANNEL_H
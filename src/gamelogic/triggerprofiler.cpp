@@ -0,0 +1,239 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+
+#include "eventhandler.h"
+#include "triggerprofiler.h"
+#include "util.h"
+
+#include <QAtomicInt>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QSet>
+
+namespace {
+
+QAtomicInt Enabled(0);
+
+struct GlobalRecords
+{
+    QMutex mutex;
+    QSet<const TriggerProfiler *> profilers;
+    TriggerProfiler::EventRecord finished[EventTypeCount];
+};
+
+GlobalRecords *Global()
+{
+    static GlobalRecords records;
+    return &records;
+}
+
+QVariantMap ToVariant(const TriggerProfiler::EventRecord *records)
+{
+    QVariantMap data;
+    for (int i = 0; i < EventTypeCount; i++) {
+        const TriggerProfiler::EventRecord &record = records[i];
+        if (record.count > 0 || !record.handlers.isEmpty())
+            data[QString::number(i)] = record.toVariant();
+    }
+    return data;
+}
+
+}
+
+TriggerProfiler::HandlerRecord::HandlerRecord()
+    : triggerableCount(0)
+    , triggerableHits(0)
+    , triggerableTime(0)
+    , costCount(0)
+    , costTime(0)
+    , effectCount(0)
+    , effectTime(0)
+{
+}
+
+void TriggerProfiler::HandlerRecord::merge(const HandlerRecord &record)
+{
+    triggerableCount += record.triggerableCount;
+    triggerableHits += record.triggerableHits;
+    triggerableTime += record.triggerableTime;
+    costCount += record.costCount;
+    costTime += record.costTime;
+    effectCount += record.effectCount;
+    effectTime += record.effectTime;
+}
+
+QVariantMap TriggerProfiler::HandlerRecord::toVariant() const
+{
+    QVariantMap data;
+    data["triggerableCount"] = triggerableCount;
+    data["triggerableHits"] = triggerableHits;
+    data["triggerableHitRate"] = triggerableCount > 0 ? double(triggerableHits) / triggerableCount : 0.0;
+    data["triggerableTime"] = triggerableTime;
+    data["costCount"] = costCount;
+    data["costTime"] = costTime;
+    data["effectCount"] = effectCount;
+    data["effectTime"] = effectTime;
+    return data;
+}
+
+TriggerProfiler::EventRecord::EventRecord()
+    : count(0)
+    , time(0)
+{
+}
+
+void TriggerProfiler::EventRecord::merge(const EventRecord &record)
+{
+    count += record.count;
+    time += record.time;
+
+    QHashIterator<QString, HandlerRecord> iter(record.handlers);
+    while (iter.hasNext()) {
+        iter.next();
+        handlers[iter.key()].merge(iter.value());
+    }
+}
+
+QVariantMap TriggerProfiler::EventRecord::toVariant() const
+{
+    QVariantMap data;
+    data["count"] = count;
+    data["time"] = time;
+
+    QVariantMap handlerData;
+    QHashIterator<QString, HandlerRecord> iter(handlers);
+    while (iter.hasNext()) {
+        iter.next();
+        handlerData[iter.key()] = iter.value().toVariant();
+    }
+    data["handlers"] = handlerData;
+    return data;
+}
+
+TriggerProfiler::Timer::Timer(TriggerProfiler *profiler, EventType event, const EventHandler *handler, Stage stage)
+    : m_profiler(profiler)
+    , m_event(event)
+    , m_handler(handler)
+    , m_stage(stage)
+    , m_hit(false)
+    , m_cpuStart(-1)
+{
+    if (m_profiler) {
+        m_cpuStart = qThreadCpuTime();
+        if (m_cpuStart < 0)
+            m_timer.start();
+    }
+}
+
+TriggerProfiler::Timer::~Timer()
+{
+    if (m_profiler) {
+        qint64 nsecs = m_cpuStart >= 0 ? (qThreadCpuTime() - m_cpuStart) * 1000 : m_timer.nsecsElapsed();
+        m_profiler->record(m_event, m_handler, m_stage, m_hit, nsecs);
+    }
+}
+
+TriggerProfiler::TriggerProfiler()
+{
+    GlobalRecords *global = Global();
+    QMutexLocker locker(&global->mutex);
+    global->profilers.insert(this);
+}
+
+TriggerProfiler::~TriggerProfiler()
+{
+    GlobalRecords *global = Global();
+    QMutexLocker locker(&global->mutex);
+    global->profilers.remove(this);
+    mergeTo(global->finished);
+}
+
+bool TriggerProfiler::IsEnabled()
+{
+    return Enabled.load() != 0;
+}
+
+void TriggerProfiler::SetEnabled(bool enabled)
+{
+    Enabled.store(enabled ? 1 : 0);
+}
+
+void TriggerProfiler::record(EventType event, const EventHandler *handler, Stage stage, bool hit, qint64 nsecs)
+{
+    QMutexLocker locker(&m_mutex);
+    EventRecord &record = m_records[event];
+    if (stage == TriggerStage) {
+        record.count++;
+        record.time += nsecs;
+        return;
+    }
+
+    HandlerRecord &handlerRecord = record.handlers[handler->name()];
+    switch (stage) {
+    case TriggerableStage:
+        handlerRecord.triggerableCount++;
+        if (hit)
+            handlerRecord.triggerableHits++;
+        handlerRecord.triggerableTime += nsecs;
+        break;
+    case CostStage:
+        handlerRecord.costCount++;
+        handlerRecord.costTime += nsecs;
+        break;
+    case EffectStage:
+        handlerRecord.effectCount++;
+        handlerRecord.effectTime += nsecs;
+        break;
+    default:;
+    }
+}
+
+QVariantMap TriggerProfiler::toVariant() const
+{
+    QMutexLocker locker(&m_mutex);
+    return ToVariant(m_records);
+}
+
+void TriggerProfiler::mergeTo(EventRecord *records) const
+{
+    QMutexLocker locker(&m_mutex);
+    for (int i = 0; i < EventTypeCount; i++)
+        records[i].merge(m_records[i]);
+}
+
+QVariantMap TriggerProfiler::GlobalVariant()
+{
+    GlobalRecords *global = Global();
+    QMutexLocker locker(&global->mutex);
+
+    EventRecord records[EventTypeCount];
+    for (int i = 0; i < EventTypeCount; i++)
+        records[i].merge(global->finished[i]);
+    foreach (const TriggerProfiler *profiler, global->profilers)
+        profiler->mergeTo(records);
+
+    return ToVariant(records);
+}
+
+QByteArray TriggerProfiler::Dump()
+{
+    return QJsonDocument(QJsonObject::fromVariantMap(GlobalVariant())).toJson();
+}
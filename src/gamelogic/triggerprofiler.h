@@ -0,0 +1,118 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+
+#ifndef TRIGGERPROFILER_H
+#define TRIGGERPROFILER_H
+
+#include "eventtype.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QVariant>
+
+class EventHandler;
+
+/* Records how often each event is triggered and how much time each handler spends in
+ * triggerable(), onCost() and effect(). Every GameLogic owns one while profiling is enabled,
+ * and the records of all rooms, running or finished, are merged into a process-wide dump.
+ * Times are in nanoseconds of CPU time used by the game thread, so the time spent waiting for
+ * replies in onCost() or effect() isn't charged to the handler. The platforms without a thread
+ * CPU clock fall back to wall-clock time.
+ */
+class TriggerProfiler
+{
+public:
+    enum Stage
+    {
+        TriggerStage,
+        TriggerableStage,
+        CostStage,
+        EffectStage
+    };
+
+    struct HandlerRecord
+    {
+        qint64 triggerableCount;
+        qint64 triggerableHits;
+        qint64 triggerableTime;
+        qint64 costCount;
+        qint64 costTime;
+        qint64 effectCount;
+        qint64 effectTime;
+
+        HandlerRecord();
+        void merge(const HandlerRecord &record);
+        QVariantMap toVariant() const;
+    };
+
+    struct EventRecord
+    {
+        qint64 count;
+        qint64 time;
+        QHash<QString, HandlerRecord> handlers;
+
+        EventRecord();
+        void merge(const EventRecord &record);
+        QVariantMap toVariant() const;
+    };
+
+    //Times one stage and records it when it goes out of scope. It does nothing without a profiler.
+    class Timer
+    {
+    public:
+        Timer(TriggerProfiler *profiler, EventType event, const EventHandler *handler = nullptr, Stage stage = TriggerStage);
+        ~Timer();
+
+        void setHit(bool hit) { m_hit = hit; }
+
+    private:
+        TriggerProfiler *m_profiler;
+        EventType m_event;
+        const EventHandler *m_handler;
+        Stage m_stage;
+        bool m_hit;
+        qint64 m_cpuStart;
+        QElapsedTimer m_timer;
+    };
+
+    TriggerProfiler();
+    ~TriggerProfiler();
+
+    static bool IsEnabled();
+    static void SetEnabled(bool enabled);
+
+    void record(EventType event, const EventHandler *handler, Stage stage, bool hit, qint64 nsecs);
+
+    QVariantMap toVariant() const;
+
+    //Process-wide records of all the rooms
+    static QVariantMap GlobalVariant();
+    static QByteArray Dump();
+
+private:
+    void mergeTo(EventRecord *records) const;
+
+    mutable QMutex m_mutex;
+    EventRecord m_records[EventTypeCount];
+};
+
+#endif // TRIGGERPROFILER_H
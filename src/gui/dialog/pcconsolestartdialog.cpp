@@ -17,13 +17,13 @@
     Mogara
 *********************************************************************/
 
+#include "ai.h"
 #include "client.h"
 #include "pcconsolestartdialog.h"
 #include "server.h"
 
 #include <CRoom>
 #include <CServerUser>
-#include <CServerRobot>
 
 #include <QCoreApplication>
 
@@ -46,15 +46,19 @@ void PcConsoleStartDialog::start(const QString &screenName, const QString &avata
         return;
     }
 
-    connect(server, &Server::robotAdded, [](CServerRobot *robot){
-        robot->initAi("script/Ai/smart-ai.js");
-    });
+    //Robots are answered by the native AI in the thread of the game logic, so they need
+    //neither a script nor notifications
+    Ai::SetEnabled(true);
 
     m_client->connectToHost(QHostAddress::LocalHost, port);
 }
 
 void PcConsoleStartDialog::onServerConnected()
 {
+    //Client signs up by itself when it follows a migrated game
+    if (m_client->isMigrating())
+        return;
+
     m_client->signup("", "", m_screenName, m_avatar);
     enterLobby();
     m_client->createRoom();
@@ -45,6 +45,10 @@ void StartGameDialog::connectToServer(const QString &serverAddress)
 
 void StartGameDialog::onServerConnected()
 {
+    //Client signs up by itself when it follows a migrated game
+    if (m_client->isMigrating())
+        return;
+
     m_client->signup("", "", m_screenName, m_avatar);
 }
 
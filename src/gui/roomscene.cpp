@@ -90,6 +90,7 @@ RoomScene::RoomScene(QQuickItem *parent)
     connect(m_client, &Client::optionRequested, this, &RoomScene::showOptions);
     connect(m_client, &Client::arrangeCardRequested, this, &RoomScene::onArrangeCardRequested);
     connect(m_client, &Client::gameOver, this, &RoomScene::onGameOver);
+    connect(m_client, &Client::stateRestored, this, &RoomScene::onStateRestored);
 
     GameLogger *logger = new GameLogger(m_client, this);
     connect(logger, &GameLogger::logAdded, this, &RoomScene::addLog);
@@ -572,6 +573,45 @@ void RoomScene::onGameOver(const QList<const ClientPlayer *> &winners)
     showGameOverBox(winnerList);
 }
 
+void RoomScene::onStateRestored()
+{
+    //A resync frame replaces the table at once, so the cards of each player are dealt
+    //from the draw pile again
+    QVariantMap drawPile;
+    drawPile["seat"] = 0;
+    drawPile["type"] = AreaTypeToString(CardArea::DrawPile);
+
+    QVariantList paths;
+    QList<const ClientPlayer *> players = m_client->players();
+    foreach (const ClientPlayer *player, players) {
+        const CardArea *areas[] = {player->handcardArea(), player->equipArea(), player->delayedTrickArea()};
+        for (const CardArea *area : areas) {
+            if (area->length() <= 0)
+                continue;
+
+            QVariantMap to;
+            to["seat"] = player->seat();
+            to["type"] = AreaTypeToString(area->type());
+            to["name"] = area->name();
+
+            QVariantList cards;
+            foreach (const Card *card, area->cards()) {
+                QVariantMap cardData = convertToMap(card);
+                cardData["subtype"] = card ? card->subtype() : 0;
+                cards << cardData;
+            }
+
+            QVariantMap path;
+            path["from"] = drawPile;
+            path["to"] = to;
+            path["cards"] = cards;
+            paths << path;
+        }
+    }
+
+    moveCards(paths);
+}
+
 QVariantMap RoomScene::convertToMap(const Card *card) const
 {
     QVariantMap data;
@@ -100,6 +100,7 @@ private:
     void onCardShown(const ClientPlayer *from, const QList<const Card *> &cards);
     void onArrangeCardRequested(const QList<Card *> &cards, const QList<int> &capacities, const QStringList &areaNames);
     void onGameOver(const QList<const ClientPlayer *> &winners);
+    void onStateRestored();
 
     QVariantMap convertToMap(const Card *card) const;
 
@@ -17,6 +17,10 @@
     Mogara
 *********************************************************************/
 
+#include "client.h"
+#include "replayer.h"
+#include "spectator.h"
+
 #include <QGuiApplication>
 #include <QLocale>
 #include <QTranslator>
@@ -56,6 +60,37 @@ int main(int argc, char *argv[])
     window.setSource(QUrl(QsSrc"script/main.qml"));
     window.show();
 
+    //--replay FILE plays a replay recorded by the server in the room scene, from the round
+    //given by --replay-round and at the speed given by --replay-speed
+    QStringList arguments = app.arguments();
+    int replayIndex = arguments.indexOf("--replay");
+    if (replayIndex >= 0) {
+        Replayer *replayer = new Replayer(Client::instance(), &app);
+        if (!replayer->open(arguments.value(replayIndex + 1)))
+            return 1;
+
+        int speedIndex = arguments.indexOf("--replay-speed");
+        if (speedIndex >= 0)
+            replayer->setSpeed(arguments.value(speedIndex + 1).toDouble());
+        int roundIndex = arguments.indexOf("--replay-round");
+        if (roundIndex >= 0 && !replayer->seekToRound(arguments.value(roundIndex + 1).toInt()))
+            qWarning("The replay has no round %s", qPrintable(arguments.value(roundIndex + 1)));
+        replayer->play();
+    }
+
+    //--spectate HOST:PORT:ROOM watches a room through the spectator port of a server
+    int spectateIndex = arguments.indexOf("--spectate");
+    if (spectateIndex >= 0) {
+        QStringList target = arguments.value(spectateIndex + 1).split(':');
+        QHostAddress host;
+        if (target.length() != 3 || !host.setAddress(target.at(0))) {
+            qWarning("--spectate needs the room in the form of host:port:room.");
+            return 1;
+        }
+        Spectator *spectator = new Spectator(Client::instance(), &app);
+        spectator->watch(host, target.at(1).toUShort(), target.at(2).toUInt());
+    }
+
     cRegisterUrlScheme(window.title());
 
     return app.exec();
@@ -74,7 +74,8 @@ void Slash::effect(GameLogic *logic, CardEffectStruct &cardEffect)
         if (logic->trigger(SlashProceed, effect.from, data))
             break;
 
-        while (effect.jink.length() < effect.jinkNum) {
+        //useCard() does nothing once the game is interrupted, so no jink would ever be added
+        while (effect.jink.length() < effect.jinkNum && !logic->isInterrupted()) {
             QVariantList args;
             args << "player" << effect.from->id();
             args << effect.jinkNum;
@@ -92,6 +93,9 @@ void Slash::effect(GameLogic *logic, CardEffectStruct &cardEffect)
         }
     } while (false);
 
+    if (logic->isInterrupted())
+        return;
+
     if (effect.jink.length() < effect.jinkNum) {
         if (effect.to->isAlive()) {
             logic->trigger(SlashHit, effect.from, data);
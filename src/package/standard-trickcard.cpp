@@ -27,6 +27,7 @@
 #include "standardpackage.h"
 #include "standard-trickcard.h"
 #include "eventtype.h"
+#include "undojournal.h"
 
 AmazingGrace::AmazingGrace(Card::Suit suit, int number)
     : GlobalEffect(suit, number)
@@ -47,26 +48,23 @@ void AmazingGrace::use(GameLogic *logic, CardUseStruct &use)
 
     logic->moveCards(move);
 
-    CRoom *room = logic->room();
-    room->broadcastNotification(S_COMMAND_SHOW_AMAZING_GRACE);
+    logic->broadcastNotification(S_COMMAND_SHOW_AMAZING_GRACE);
 
-    try {
-        GlobalEffect::use(logic, use);
+    GlobalEffect::use(logic, use);
+
+    EventType interruption = logic->takeInterruption();
+    if (interruption != GameFinish)
         clearRestCards(logic);
-    } catch (EventType e) {
-        if (e == TurnBroken || e == StageChange)
-            clearRestCards(logic);
-        throw e;
-    }
+    if (interruption != InvalidEvent)
+        logic->interrupt(interruption);
 }
 
 void AmazingGrace::effect(GameLogic *logic, CardEffectStruct &effect)
 {
     int timeout = logic->settings()->timeout * 1000;
 
-    CServerAgent *agent = effect.to->agent();
-    agent->request(S_COMMAND_TAKE_AMAZING_GRACE, QVariant(), timeout);
-    uint cardId = agent->waitForReply(timeout).toUInt();
+    effect.to->request(S_COMMAND_TAKE_AMAZING_GRACE, QVariant(), timeout);
+    uint cardId = effect.to->waitForReply(timeout).toUInt();
 
     Card *takenCard = nullptr;
     const CardArea *wugu = logic->wugu();
@@ -91,8 +89,7 @@ void AmazingGrace::effect(GameLogic *logic, CardEffectStruct &effect)
 
 void AmazingGrace::clearRestCards(GameLogic *logic) const
 {
-    CRoom *room = logic->room();
-    room->broadcastNotification(S_COMMAND_CLEAR_AMAZING_GRACE);
+    logic->broadcastNotification(S_COMMAND_CLEAR_AMAZING_GRACE);
 
     const CardArea *wugu = logic->wugu();
     if (wugu->length() <= 0)
@@ -354,6 +351,7 @@ bool Collateral::targetFilter(const QList<const Player *> &targets, const Player
 
 void Collateral::onUse(GameLogic *logic, CardUseStruct &use)
 {
+    UndoJournal::Save(m_victim);
     m_victim = use.to.at(1);
     use.to.removeAt(1);
     SingleTargetTrick::onUse(logic, use);
@@ -0,0 +1,88 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+
+#include "metricsexporter.h"
+
+#include <QTcpServer>
+#include <QTcpSocket>
+
+namespace {
+
+//Scrapers send small requests, so anything longer is dropped
+const int MaxRequestSize = 8192;
+
+QByteArray Response(const QByteArray &status, const QByteArray &contentType, const QByteArray &body)
+{
+    QByteArray response = "HTTP/1.1 " + status + "\r\n";
+    response += "Content-Type: " + contentType + "\r\n";
+    response += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+    response += "Connection: close\r\n\r\n";
+    response += body;
+    return response;
+}
+
+}
+
+MetricsExporter::MetricsExporter(const Collector &collector, QObject *parent)
+    : QObject(parent)
+    , m_collector(collector)
+    , m_server(new QTcpServer(this))
+{
+    connect(m_server, &QTcpServer::newConnection, this, &MetricsExporter::onNewConnection);
+}
+
+bool MetricsExporter::listen(const QHostAddress &address, ushort port)
+{
+    return m_server->listen(address, port);
+}
+
+void MetricsExporter::onNewConnection()
+{
+    while (m_server->hasPendingConnections()) {
+        QTcpSocket *socket = m_server->nextPendingConnection();
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket](){
+            onReadyRead(socket);
+        });
+        connect(socket, &QTcpSocket::disconnected, socket, &QTcpSocket::deleteLater);
+    }
+}
+
+void MetricsExporter::onReadyRead(QTcpSocket *socket)
+{
+    if (socket->bytesAvailable() > MaxRequestSize) {
+        socket->abort();
+        return;
+    }
+
+    //Wait for the whole header
+    QByteArray request = socket->peek(MaxRequestSize);
+    if (!request.contains("\r\n\r\n"))
+        return;
+    socket->readAll();
+
+    QList<QByteArray> requestLine = request.left(request.indexOf("\r\n")).split(' ');
+    QByteArray method = requestLine.value(0);
+    QByteArray path = requestLine.value(1);
+    if (method == "GET" && (path == "/metrics" || path.startsWith("/metrics?")))
+        socket->write(Response("200 OK", "text/plain; version=0.0.4; charset=utf-8", m_collector()));
+    else
+        socket->write(Response("404 Not Found", "text/plain; charset=utf-8", "Not Found\n"));
+    socket->disconnectFromHost();
+}
@@ -0,0 +1,54 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+
+#ifndef METRICSEXPORTER_H
+#define METRICSEXPORTER_H
+
+#include <QHostAddress>
+#include <QObject>
+
+#include <functional>
+
+class QTcpServer;
+class QTcpSocket;
+
+/* Serves GET /metrics over HTTP in the text exposition format of Prometheus.
+ * The text is built by the collector when a scraper asks for it.
+ */
+class MetricsExporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef std::function<QByteArray()> Collector;
+
+    MetricsExporter(const Collector &collector, QObject *parent = nullptr);
+
+    bool listen(const QHostAddress &address, ushort port);
+
+private:
+    void onNewConnection();
+    void onReadyRead(QTcpSocket *socket);
+
+    Collector m_collector;
+    QTcpServer *m_server;
+};
+
+#endif // METRICSEXPORTER_H
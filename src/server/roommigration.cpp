@@ -0,0 +1,214 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+
+#include "roommigration.h"
+
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QMutex>
+
+namespace {
+
+struct Arrivals
+{
+    QMutex mutex;
+    QList<QVariantMap> games;
+};
+
+Arrivals *GlobalArrivals()
+{
+    static Arrivals arrivals;
+    return &arrivals;
+}
+
+QStringList SortedUsers(const QVariant &users)
+{
+    QStringList names = users.toStringList();
+    names.sort();
+    return names;
+}
+
+//Writes a frame and waits for the reply of the other side
+QVariantMap Exchange(const QString &name, const QVariantMap &frame, int timeout)
+{
+    QElapsedTimer timer;
+    timer.start();
+    auto remaining = [&timer, timeout](){
+        return qMax<int>(1, timeout - int(timer.elapsed()));
+    };
+
+    QLocalSocket socket;
+    socket.connectToServer(name);
+    if (!socket.waitForConnected(remaining()))
+        return QVariantMap();
+
+    QDataStream stream(&socket);
+    stream << QVariant(frame);
+    while (socket.bytesToWrite() > 0) {
+        if (!socket.waitForBytesWritten(remaining()))
+            return QVariantMap();
+    }
+
+    forever {
+        QVariant reply;
+        stream.startTransaction();
+        stream >> reply;
+        if (stream.commitTransaction())
+            return reply.toMap();
+        if (timer.elapsed() >= timeout || !socket.waitForReadyRead(remaining()))
+            return QVariantMap();
+    }
+}
+
+}
+
+RoomMigration::RoomMigration(QObject *parent)
+    : QObject(parent)
+    , m_server(new QLocalServer(this))
+{
+    connect(m_server, &QLocalServer::newConnection, this, &RoomMigration::onNewConnection);
+}
+
+bool RoomMigration::listen(const QString &name)
+{
+    //A socket left by a process that crashed would make it fail
+    QLocalServer::removeServer(name);
+    return m_server->listen(name);
+}
+
+bool RoomMigration::Send(const QString &name, const QVariantMap &game, int timeout)
+{
+    QVariantMap frame;
+    frame["command"] = "game";
+    frame["game"] = game;
+    return Exchange(name, frame, timeout)["accepted"].toBool();
+}
+
+bool RoomMigration::SendDrain(const QString &name, const QString &target, const QString &host, ushort port, int timeout)
+{
+    QVariantMap frame;
+    frame["command"] = "drain";
+    frame["target"] = target;
+    frame["host"] = host;
+    frame["port"] = port;
+    return Exchange(name, frame, timeout)["accepted"].toBool();
+}
+
+QVariantMap RoomMigration::Query(const QString &name, const QVariantMap &frame, int timeout)
+{
+    return Exchange(name, frame, timeout);
+}
+
+QVariantMap RoomMigration::TakeArrival(const QStringList &users)
+{
+    QStringList names = users;
+    names.sort();
+
+    Arrivals *arrivals = GlobalArrivals();
+    QMutexLocker locker(&arrivals->mutex);
+    for (int i = 0; i < arrivals->games.length(); i++) {
+        if (SortedUsers(arrivals->games.at(i)["users"]) == names)
+            return arrivals->games.takeAt(i);
+    }
+    return QVariantMap();
+}
+
+int RoomMigration::ArrivalNum()
+{
+    Arrivals *arrivals = GlobalArrivals();
+    QMutexLocker locker(&arrivals->mutex);
+    return arrivals->games.length();
+}
+
+bool RoomMigration::AssignRoom(const QString &owner, uint roomId)
+{
+    Arrivals *arrivals = GlobalArrivals();
+    QMutexLocker locker(&arrivals->mutex);
+    for (QVariantMap &game : arrivals->games) {
+        if (game["owner"].toString() == owner && !game.contains("targetRoomId")) {
+            game["targetRoomId"] = roomId;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool RoomMigration::FindArrival(const QString &user, uint *roomId, QString *owner)
+{
+    Arrivals *arrivals = GlobalArrivals();
+    QMutexLocker locker(&arrivals->mutex);
+    foreach (const QVariantMap &game, arrivals->games) {
+        if (game["users"].toStringList().contains(user)) {
+            *roomId = game["targetRoomId"].toUInt();
+            if (owner)
+                *owner = game["owner"].toString();
+            return true;
+        }
+    }
+    return false;
+}
+
+void RoomMigration::onNewConnection()
+{
+    while (m_server->hasPendingConnections()) {
+        QLocalSocket *socket = m_server->nextPendingConnection();
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket](){
+            onReadyRead(socket);
+        });
+        connect(socket, &QLocalSocket::disconnected, socket, &QLocalSocket::deleteLater);
+    }
+}
+
+void RoomMigration::onReadyRead(QLocalSocket *socket)
+{
+    QDataStream stream(socket);
+    forever {
+        QVariant data;
+        stream.startTransaction();
+        stream >> data;
+        if (!stream.commitTransaction())
+            return;
+
+        const QVariantMap frame = data.toMap();
+        QString command = frame["command"].toString();
+        QVariantMap reply;
+        if (command == "game") {
+            QVariantMap game = frame["game"].toMap();
+            bool accepted = game.contains("snapshot");
+            if (accepted) {
+                Arrivals *arrivals = GlobalArrivals();
+                QMutexLocker locker(&arrivals->mutex);
+                arrivals->games << game;
+            }
+            reply["accepted"] = accepted;
+        } else if (command == "drain") {
+            QString target = frame["target"].toString();
+            bool accepted = !target.isEmpty();
+            if (accepted)
+                emit drainRequested(target, frame["host"].toString(), ushort(frame["port"].toUInt()));
+            reply["accepted"] = accepted;
+        } else if (m_handler) {
+            reply = m_handler(frame);
+        }
+        stream << QVariant(reply);
+    }
+}
@@ -0,0 +1,87 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+
+#ifndef ROOMMIGRATION_H
+#define ROOMMIGRATION_H
+
+#include <QObject>
+#include <QVariant>
+
+#include <functional>
+
+class QLocalServer;
+class QLocalSocket;
+
+/* Hands games over between server processes on the same host through a local socket.
+ *
+ * A game is sent at the start of a turn as its snapshot, along with the screen names of its
+ * users. The receiving process keeps it until a room of the same users starts a game, which
+ * then resumes from the snapshot. The owner of the game recreates its room, and Server leads
+ * the other users to it. A process listening on a socket also takes a drain command,
+ * which asks it to hand all of its games over to another socket. Other commands are passed to
+ * the command handler, so that operators can query the process through the same socket.
+ */
+class RoomMigration : public QObject
+{
+    Q_OBJECT
+
+public:
+    RoomMigration(QObject *parent = nullptr);
+
+    bool listen(const QString &name);
+
+    //It takes a frame with "command" and returns the reply
+    typedef std::function<QVariantMap(const QVariantMap &)> CommandHandler;
+    void setCommandHandler(const CommandHandler &handler) { m_handler = handler; }
+
+    //Sends a game and waits until it's accepted. It can be called from any thread.
+    static bool Send(const QString &name, const QVariantMap &game, int timeout);
+
+    //Asks the process listening on the name to hand its games over to the target socket,
+    //and its users over to the host and port of the target.
+    static bool SendDrain(const QString &name, const QString &target, const QString &host, ushort port, int timeout);
+
+    //Sends a command to the handler of the process listening on the name, and returns its reply
+    static QVariantMap Query(const QString &name, const QVariantMap &frame, int timeout);
+
+    //Takes the game that has arrived for the users, or returns an empty map
+    static QVariantMap TakeArrival(const QStringList &users);
+    static int ArrivalNum();
+
+    //Records the room the owner of an arrived game has created for it. It returns false if
+    //no game without a room has arrived for the owner.
+    static bool AssignRoom(const QString &owner, uint roomId);
+
+    //It returns whether a game has arrived for the user, and the id of its room, which is 0
+    //until the owner creates the room
+    static bool FindArrival(const QString &user, uint *roomId, QString *owner = nullptr);
+
+signals:
+    void drainRequested(const QString &target, const QString &host, ushort port);
+
+private:
+    void onNewConnection();
+    void onReadyRead(QLocalSocket *socket);
+
+    QLocalServer *m_server;
+    CommandHandler m_handler;
+};
+
+#endif // ROOMMIGRATION_H
@@ -20,25 +20,270 @@
 #include "engine.h"
 #include "gamelogic.h"
 #include "gamemode.h"
+#include "metrics.h"
+#include "metricsexporter.h"
+#include "protocol.h"
+#include "replystatistics.h"
+#include "roommigration.h"
 #include "roomsettings.h"
 #include "server.h"
+#include "spectatorgate.h"
+#include "util.h"
 
 #include <CRoom>
 #include <CServerUser>
 
+namespace {
+
+//Writes the samples of a metric in the text exposition format
+class MetricWriter
+{
+public:
+    MetricWriter(QByteArray &text)
+        : m_text(text)
+    {
+    }
+
+    void begin(const char *name, const char *type, const char *help)
+    {
+        m_text += QByteArray("# HELP ") + name + ' ' + help + '\n';
+        m_text += QByteArray("# TYPE ") + name + ' ' + type + '\n';
+    }
+
+    void sample(const QByteArray &name, const QByteArray &labels, double value)
+    {
+        m_text += name;
+        if (!labels.isEmpty())
+            m_text += '{' + labels + '}';
+        m_text += ' ' + QByteArray::number(value, 'g', 15) + '\n';
+    }
+
+private:
+    QByteArray &m_text;
+};
+
+}
+
 Server::Server(QObject *parent)
     : CServer(parent)
+    , m_metricsExporter(nullptr)
+    , m_spectatorGate(nullptr)
 {
     CRoom *lobby = this->lobby();
     lobby->setName(tr("QSanguosha Lobby"));
 
-    connect(this, &CServer::roomCreated, [](CRoom *room){
+    connect(this, &CServer::roomCreated, [this](CRoom *room){
         GameLogic *logic = new GameLogic(room);
         room->setGameLogic(logic);
+        m_logics << logic;
 
         room->setSettings(new RoomSettings);
         CServerUser *owner = room->owner();
         room->setName(tr("%1's Room").arg(owner->screenName()));
         room->broadcastConfig();
+
+        if (RoomMigration::AssignRoom(owner->screenName(), room->id()))
+            leadArrivingUsers();
+    });
+
+    connect(this, &CServer::userAdded, [this](CServerUser *user){
+        uint roomId = 0;
+        if (RoomMigration::FindArrival(user->screenName(), &roomId)) {
+            m_arrivingUsers << user;
+            if (roomId > 0)
+                leadArrivingUsers();
+        }
     });
 }
+
+void Server::leadArrivingUsers()
+{
+    m_arrivingUsers.removeAll(nullptr);
+    for (int i = 0; i < m_arrivingUsers.length(); i++) {
+        CServerUser *user = m_arrivingUsers.at(i);
+        uint roomId = 0;
+        QString owner;
+        if (RoomMigration::FindArrival(user->screenName(), &roomId, &owner) && roomId == 0)
+            continue;
+
+        //The owner has entered the room by creating it
+        if (roomId > 0 && user->screenName() != owner) {
+            QVariantMap data;
+            data["roomId"] = roomId;
+            user->notify(S_COMMAND_MIGRATE, data);
+        }
+        m_arrivingUsers.removeAt(i);
+        i--;
+    }
+}
+
+QVariantList Server::roomUsage()
+{
+    m_logics.removeAll(nullptr);
+    QVariantList rooms;
+    foreach (GameLogic *logic, m_logics) {
+        QVariantMap usage = logic->usage();
+        usage["name"] = logic->room()->name();
+        rooms << usage;
+    }
+    return rooms;
+}
+
+bool Server::killRoom(uint roomId)
+{
+    GameLogic *logic = findLogic(roomId);
+    if (logic == nullptr)
+        return false;
+    logic->kill();
+    return true;
+}
+
+bool Server::throttleRoom(uint roomId, int usecs)
+{
+    GameLogic *logic = findLogic(roomId);
+    if (logic == nullptr)
+        return false;
+    logic->setThrottle(usecs);
+    return true;
+}
+
+QByteArray Server::metrics()
+{
+    QByteArray text;
+    MetricWriter writer(text);
+
+    m_logics.removeAll(nullptr);
+    int waitingNum = 0;
+    int playingNum = 0;
+    int hibernatingNum = 0;
+    int humanNum = 0;
+    int robotNum = 0;
+    //Players are counted by the game threads, as their agents are theirs to read
+    foreach (GameLogic *logic, m_logics) {
+        if (!logic->isRunning()) {
+            waitingNum++;
+            continue;
+        }
+        if (logic->isHibernating())
+            hibernatingNum++;
+        else
+            playingNum++;
+        humanNum += logic->humanNum();
+        robotNum += logic->robotNum();
+    }
+
+    writer.begin("qsanguosha_rooms", "gauge", "Rooms by the state of their game.");
+    writer.sample("qsanguosha_rooms", "state=\"waiting\"", waitingNum);
+    writer.sample("qsanguosha_rooms", "state=\"playing\"", playingNum);
+    writer.sample("qsanguosha_rooms", "state=\"hibernating\"", hibernatingNum);
+
+    writer.begin("qsanguosha_players", "gauge", "Players of games in progress.");
+    writer.sample("qsanguosha_players", "kind=\"human\"", humanNum);
+    writer.sample("qsanguosha_players", "kind=\"robot\"", robotNum);
+
+    Metrics::Totals totals = Metrics::Collect();
+    writer.begin("qsanguosha_games_finished_total", "counter", "Games finished since the process started.");
+    writer.sample("qsanguosha_games_finished_total", QByteArray(), totals.gamesFinished);
+
+    const QByteArray robotLabels[] = {"ai=\"heuristic\"", "ai=\"search\""};
+    writer.begin("qsanguosha_robot_games_total", "counter", "Games finished by robots, by the way they play.");
+    for (int i = 0; i < 2; i++)
+        writer.sample("qsanguosha_robot_games_total", robotLabels[i], totals.robotGames[i]);
+    writer.begin("qsanguosha_robot_wins_total", "counter", "Games won by robots, by the way they play.");
+    for (int i = 0; i < 2; i++)
+        writer.sample("qsanguosha_robot_wins_total", robotLabels[i], totals.robotWins[i]);
+
+    writer.begin("qsanguosha_triggers_total", "counter", "Events triggered, by event type.");
+    for (int event = 0; event < EventTypeCount; event++) {
+        if (totals.triggers[event] > 0)
+            writer.sample("qsanguosha_triggers_total", "event=\"" + Metrics::EventName(event) + '"', totals.triggers[event]);
+    }
+
+    writer.begin("qsanguosha_messages_total", "counter", "Messages sent to agents, by command.");
+    for (int command = 0; command < SANGUOSHA_COMMAND_COUNT; command++) {
+        if (totals.messages[command] > 0)
+            writer.sample("qsanguosha_messages_total", "command=\"" + Metrics::CommandName(command) + '"', totals.messages[command]);
+    }
+
+    writer.begin("qsanguosha_message_bytes_total", "counter", "JSON bytes of messages sent to agents, by command.");
+    for (int command = 0; command < SANGUOSHA_COMMAND_COUNT; command++) {
+        if (totals.messages[command] > 0)
+            writer.sample("qsanguosha_message_bytes_total", "command=\"" + Metrics::CommandName(command) + '"', totals.messageBytes[command]);
+    }
+
+    //Latencies are kept as histograms with bounded errors, and exported as summaries
+    static const QList<QPair<QByteArray, QString>> quantiles = {
+        {"0.5", "p50"}, {"0.9", "p90"}, {"0.99", "p99"}, {"0.999", "p99.9"}
+    };
+    const QVariantMap replies = ReplyStatistics::GlobalVariant();
+    writer.begin("qsanguosha_reply_latency_microseconds", "summary", "Latency of replies, by command and kind of agent.");
+    for (QVariantMap::const_iterator i = replies.constBegin(); i != replies.constEnd(); i++) {
+        const QVariantMap agents = i.value().toMap();
+        for (QVariantMap::const_iterator j = agents.constBegin(); j != agents.constEnd(); j++) {
+            const QVariantMap record = j.value().toMap();
+            QByteArray labels = "command=\"" + Metrics::CommandName(i.key().toInt()) + "\",agent=\"" + j.key().toLatin1() + '"';
+            typedef QPair<QByteArray, QString> Quantile;
+            foreach (const Quantile &quantile, quantiles)
+                writer.sample("qsanguosha_reply_latency_microseconds", labels + ",quantile=\"" + quantile.first + '"', record[quantile.second].toDouble());
+            writer.sample("qsanguosha_reply_latency_microseconds_sum", labels, record["sum"].toDouble());
+            writer.sample("qsanguosha_reply_latency_microseconds_count", labels, record["count"].toDouble());
+        }
+    }
+
+    writer.begin("qsanguosha_reply_timeouts_total", "counter", "Requests that timed out, by command and kind of agent.");
+    for (QVariantMap::const_iterator i = replies.constBegin(); i != replies.constEnd(); i++) {
+        const QVariantMap agents = i.value().toMap();
+        for (QVariantMap::const_iterator j = agents.constBegin(); j != agents.constEnd(); j++) {
+            QByteArray labels = "command=\"" + Metrics::CommandName(i.key().toInt()) + "\",agent=\"" + j.key().toLatin1() + '"';
+            writer.sample("qsanguosha_reply_timeouts_total", labels, j.value().toMap()["timeouts"].toDouble());
+        }
+    }
+
+    qint64 residentMemory = qResidentMemory();
+    if (residentMemory >= 0) {
+        writer.begin("process_resident_memory_bytes", "gauge", "Resident memory size in bytes.");
+        writer.sample("process_resident_memory_bytes", QByteArray(), residentMemory);
+    }
+
+    return text;
+}
+
+bool Server::listenMetrics(const QHostAddress &address, ushort port)
+{
+    if (m_metricsExporter == nullptr) {
+        m_metricsExporter = new MetricsExporter([this](){
+            return metrics();
+        }, this);
+    }
+    return m_metricsExporter->listen(address, port);
+}
+
+bool Server::listenSpectators(const QHostAddress &address, ushort port)
+{
+    if (m_spectatorGate == nullptr) {
+        m_spectatorGate = new SpectatorGate([this](uint roomId){
+            GameLogic *logic = findLogic(roomId);
+            return logic ? logic->spectators() : nullptr;
+        }, this);
+    }
+    return m_spectatorGate->listen(address, port);
+}
+
+GameLogic *Server::findLogic(uint roomId)
+{
+    m_logics.removeAll(nullptr);
+    foreach (GameLogic *logic, m_logics) {
+        if (logic->room()->id() == roomId)
+            return logic;
+    }
+    return nullptr;
+}
+
+void Server::drain(const QString &target, const QString &host, ushort port)
+{
+    m_logics.removeAll(nullptr);
+    foreach (GameLogic *logic, m_logics) {
+        if (logic->isRunning())
+            logic->migrate(target, host, port);
+    }
+}
@@ -22,10 +22,50 @@
 
 #include <CServer>
 
+#include <QHostAddress>
+#include <QPointer>
+
+class CServerUser;
+class GameLogic;
+class MetricsExporter;
+class SpectatorGate;
+
 class Server : public CServer
 {
 public:
     Server(QObject *parent = nullptr);
+
+    //Hands every game in progress over to the process listening on the target socket.
+    //Their users are told to connect to the host and port.
+    void drain(const QString &target, const QString &host, ushort port);
+
+    //The usage of every room with a game logic, as GameLogic::usage() gives
+    QVariantList roomUsage();
+
+    //They return false if no room has the id
+    bool killRoom(uint roomId);
+    bool throttleRoom(uint roomId, int usecs);
+
+    //Metrics of the process in the text exposition format of Prometheus
+    QByteArray metrics();
+
+    //Serves metrics() at /metrics over HTTP. The address should be a local one.
+    bool listenMetrics(const QHostAddress &address, ushort port);
+
+    //Lets spectators watch the public view of rooms through the port. See SpectatorGate.
+    bool listenSpectators(const QHostAddress &address, ushort port);
+
+private:
+    GameLogic *findLogic(uint roomId);
+
+    //Sends users of a game migrated from another process to its room once the owner has
+    //created it
+    void leadArrivingUsers();
+
+    QList<QPointer<GameLogic>> m_logics;
+    QList<QPointer<CServerUser>> m_arrivingUsers;
+    MetricsExporter *m_metricsExporter;
+    SpectatorGate *m_spectatorGate;
 };
 
 #endif // SERVER_H
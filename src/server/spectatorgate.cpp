@@ -0,0 +1,74 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+#include "spectatorchannel.h"
+#include "spectatorgate.h"
+
+#include <QTcpServer>
+#include <QTcpSocket>
+
+namespace {
+
+//A room id fits in a short line, so anything longer is dropped
+const int MaxRequestSize = 32;
+
+}
+
+SpectatorGate::SpectatorGate(const Finder &finder, QObject *parent)
+    : QObject(parent)
+    , m_finder(finder)
+    , m_server(new QTcpServer(this))
+{
+    connect(m_server, &QTcpServer::newConnection, this, &SpectatorGate::onNewConnection);
+}
+
+bool SpectatorGate::listen(const QHostAddress &address, ushort port)
+{
+    return m_server->listen(address, port);
+}
+
+void SpectatorGate::onNewConnection()
+{
+    while (m_server->hasPendingConnections()) {
+        QTcpSocket *socket = m_server->nextPendingConnection();
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket](){
+            onReadyRead(socket);
+        });
+        connect(socket, &QTcpSocket::disconnected, socket, &QTcpSocket::deleteLater);
+    }
+}
+
+void SpectatorGate::onReadyRead(QTcpSocket *socket)
+{
+    if (!socket->canReadLine()) {
+        if (socket->bytesAvailable() > MaxRequestSize)
+            socket->abort();
+        return;
+    }
+
+    //Spectators only listen from now on
+    disconnect(socket, &QTcpSocket::readyRead, this, nullptr);
+    uint roomId = socket->readLine(MaxRequestSize).trimmed().toUInt();
+    SpectatorChannel *channel = roomId > 0 ? m_finder(roomId) : nullptr;
+    if (channel == nullptr) {
+        socket->disconnectFromHost();
+        return;
+    }
+    channel->addSpectator(socket);
+}
@@ -0,0 +1,56 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha.
+
+    This game engine is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the LICENSE file for more details.
+
+    Mogara
+*********************************************************************/
+
+#ifndef SPECTATORGATE_H
+#define SPECTATORGATE_H
+
+#include <QHostAddress>
+#include <QObject>
+
+#include <functional>
+
+class QTcpServer;
+class QTcpSocket;
+class SpectatorChannel;
+
+/* Lets spectators into rooms. A spectator connects to the port and sends the id of a room as
+ * a line. The socket is then handed to the spectator channel of the room, which streams the
+ * public view to it. Unknown rooms close the connection.
+ */
+class SpectatorGate : public QObject
+{
+    Q_OBJECT
+
+public:
+    //It returns null if no room has the id
+    typedef std::function<SpectatorChannel *(uint)> Finder;
+
+    SpectatorGate(const Finder &finder, QObject *parent = nullptr);
+
+    bool listen(const QHostAddress &address, ushort port);
+
+private:
+    void onNewConnection();
+    void onReadyRead(QTcpSocket *socket);
+
+    Finder m_finder;
+    QTcpServer *m_server;
+};
+
+#endif // SPECTATORGATE_H
@@ -0,0 +1,135 @@
+# Sources shared by the game, the dedicated server, the load generator and the benchmarks.
+# A project sets QSAN_MODULES before including it to add the client or the server.
+
+SOURCES += \
+    $$PWD/core/card.cpp \
+    $$PWD/core/cardarea.cpp \
+    $$PWD/core/cardpattern.cpp \
+    $$PWD/core/engine.cpp \
+    $$PWD/core/gamemode.cpp \
+    $$PWD/core/general.cpp \
+    $$PWD/core/heapaccount.cpp \
+    $$PWD/core/package.cpp \
+    $$PWD/core/payloadcompressor.cpp \
+    $$PWD/core/player.cpp \
+    $$PWD/core/protocol.cpp \
+    $$PWD/core/replayfile.cpp \
+    $$PWD/core/skill.cpp \
+    $$PWD/core/structs.cpp \
+    $$PWD/core/timerwheel.cpp \
+    $$PWD/core/undojournal.cpp \
+    $$PWD/core/util.cpp \
+    $$PWD/gamelogic/ai.cpp \
+    $$PWD/gamelogic/belieftracker.cpp \
+    $$PWD/gamelogic/event.cpp \
+    $$PWD/gamelogic/eventhandler.cpp \
+    $$PWD/gamelogic/gamelogic.cpp \
+    $$PWD/gamelogic/gamerule.cpp \
+    $$PWD/gamelogic/gametracer.cpp \
+    $$PWD/gamelogic/legalactions.cpp \
+    $$PWD/gamelogic/mctsai.cpp \
+    $$PWD/gamelogic/metrics.cpp \
+    $$PWD/gamelogic/replayrecorder.cpp \
+    $$PWD/gamelogic/replystatistics.cpp \
+    $$PWD/gamelogic/serverplayer.cpp \
+    $$PWD/gamelogic/spectatorchannel.cpp \
+    $$PWD/gamelogic/triggerprofiler.cpp \
+    $$PWD/mode/hegemonymode.cpp \
+    $$PWD/mode/standardmode.cpp \
+    $$PWD/package/hegstandardpackage.cpp \
+    $$PWD/package/hegstandard-qun.cpp \
+    $$PWD/package/hegstandard-shu.cpp \
+    $$PWD/package/hegstandard-wei.cpp \
+    $$PWD/package/hegstandard-wu.cpp \
+    $$PWD/package/standardpackage.cpp \
+    $$PWD/package/standard-basiccard.cpp \
+    $$PWD/package/standard-equipcard.cpp \
+    $$PWD/package/standard-qun.cpp \
+    $$PWD/package/standard-shu.cpp \
+    $$PWD/package/standard-trickcard.cpp \
+    $$PWD/package/standard-wei.cpp \
+    $$PWD/package/standard-wu.cpp \
+    $$PWD/package/systempackage.cpp \
+    $$PWD/package/maneuveringpackage.cpp \
+    $$PWD/server/roommigration.cpp \
+    $$PWD/server/roomsettings.cpp
+
+HEADERS += \
+    $$PWD/core/card.h \
+    $$PWD/core/cardarea.h \
+    $$PWD/core/cardpattern.h \
+    $$PWD/core/engine.h \
+    $$PWD/core/gamemode.h \
+    $$PWD/core/general.h \
+    $$PWD/core/heapaccount.h \
+    $$PWD/core/package.h \
+    $$PWD/core/payloadcompressor.h \
+    $$PWD/core/player.h \
+    $$PWD/core/protocol.h \
+    $$PWD/core/replayfile.h \
+    $$PWD/core/skill.h \
+    $$PWD/core/structs.h \
+    $$PWD/core/timerwheel.h \
+    $$PWD/core/undojournal.h \
+    $$PWD/core/util.h \
+    $$PWD/mode/hegemonymode.h \
+    $$PWD/mode/standardmode.h \
+    $$PWD/gamelogic/ai.h \
+    $$PWD/gamelogic/belieftracker.h \
+    $$PWD/gamelogic/event.h \
+    $$PWD/gamelogic/eventhandler.h \
+    $$PWD/gamelogic/eventtype.h \
+    $$PWD/gamelogic/gamelogic.h \
+    $$PWD/gamelogic/gamerule.h \
+    $$PWD/gamelogic/gametracer.h \
+    $$PWD/gamelogic/legalactions.h \
+    $$PWD/gamelogic/mctsai.h \
+    $$PWD/gamelogic/metrics.h \
+    $$PWD/gamelogic/replayrecorder.h \
+    $$PWD/gamelogic/replystatistics.h \
+    $$PWD/gamelogic/serverplayer.h \
+    $$PWD/gamelogic/spectatorchannel.h \
+    $$PWD/gamelogic/triggerprofiler.h \
+    $$PWD/package/hegstandardpackage.h \
+    $$PWD/package/standardpackage.h \
+    $$PWD/package/standard-basiccard.h \
+    $$PWD/package/standard-equipcard.h \
+    $$PWD/package/standard-trickcard.h \
+    $$PWD/package/systempackage.h \
+    $$PWD/package/maneuveringpackage.h \
+    $$PWD/server/roommigration.h \
+    $$PWD/server/roomsettings.h
+
+INCLUDEPATH += $$PWD \
+    $$PWD/core \
+    $$PWD/gamelogic \
+    $$PWD/package \
+    $$PWD/server
+
+# The client of the protocol, without the GUI
+contains(QSAN_MODULES, client) {
+    SOURCES += \
+        $$PWD/client/client.cpp \
+        $$PWD/client/clientplayer.cpp \
+        $$PWD/client/clientskill.cpp
+
+    HEADERS += \
+        $$PWD/client/client.h \
+        $$PWD/client/clientplayer.h \
+        $$PWD/client/clientskill.h
+
+    INCLUDEPATH += $$PWD/client
+}
+
+# The server that hosts rooms, with its metrics and spectator listeners
+contains(QSAN_MODULES, server) {
+    SOURCES += \
+        $$PWD/server/metricsexporter.cpp \
+        $$PWD/server/server.cpp \
+        $$PWD/server/spectatorgate.cpp
+
+    HEADERS += \
+        $$PWD/server/metricsexporter.h \
+        $$PWD/server/server.h \
+        $$PWD/server/spectatorgate.h
+}